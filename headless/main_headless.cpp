@@ -0,0 +1,540 @@
+// Headless runner of the animation scenes: steps the simulation without window nor OpenGL context,
+//  and reports the throughput (steps/s) and the time spent in each phase of the simulation.
+//
+// Usage: pgm_headless <cloth|spheres|mass_spring|rope|playback> [options]
+//  Run pgm_headless --help for the list of options.
+
+#include "scenes/animation/02_simulation/cloth_simulation.hpp"
+#include "scenes/animation/02_simulation/sphere_collision_simulation.hpp"
+#include "scenes/animation/02_simulation/mass_spring_simulation.hpp"
+#include "scenes/animation/02_simulation/rope_simulation.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace vcl;
+
+
+// ************************************** //
+// Command line options
+// ************************************** //
+
+struct headless_options
+{
+    std::string scene;
+    int steps = 1000;             // Number of simulation steps
+    float dt = -1.0f;             // Time step (negative: default of the scene/integrator)
+    int resolution = 50;          // Cloth: number of particles along each side
+    int particles = -1;           // Spheres and mass spring: number of particles (negative: default of the scene)
+    float radius = -1.0f;         // Spheres: radius of the particles (negative: default)
+    float radius_spread = 1.0f;   // Spheres: ratio between the largest and the smallest radius
+    int capacity = -1;            // Spheres: capacity of the pool of particles (negative: default, enlarged to the number of particles)
+    float lifetime = 0;           // Spheres: lifetime of the particles, 0: unlimited
+    float emit = 0;               // Spheres: interval between two emissions during the steps, 0: no emission
+    std::string integrator;       // Empty: default of the scene
+    std::string collider = "sphere";
+    std::string shape = "box";
+    std::string broadphase = "grid";
+    int threads = 0;              // Cloth and spheres: size of the thread pool (0: number of hardware threads, 1: no multithreading)
+    bool simd = true;
+    bool check_simd = false;      // Cloth: compare the vectorized and scalar forces after the steps
+    bool self_collision = false;
+    bool multigrid = false;
+    int iterations = -1;          // Cloth: iterations of the XPBD/projective dynamics solvers (negative: default)
+    bool chebyshev = true;
+    float rho = -1.0f;            // Cloth: spectral radius used by the Chebyshev acceleration (negative: default)
+    bool sleeping = false;
+    bool ccd = false;
+    float tearing = 0;        // Tearing ratio of the cloth, 0: no tearing
+    std::string load;             // Snapshot restored before the steps (replaces the initial state and the parameters)
+    std::string save;             // Snapshot written after the steps
+    unsigned int seed = 0;        // Spheres: seed of the random generator
+    std::string record;           // Cache file receiving the positions of the particles after each step
+    bool record_drop = false;     // Drop the frames instead of waiting when the writer of the cache is late
+    std::string cache;            // Playback: cache file read
+};
+
+static void print_usage()
+{
+    std::cout<<"Usage: pgm_headless <cloth|spheres|mass_spring|rope> [options]"<<std::endl
+             <<"  --steps N                     Number of simulation steps (default 1000)"<<std::endl
+             <<"  --dt h                        Time step (default: step used by the interactive scene)"<<std::endl
+             <<"  --resolution N                Cloth: N x N particles (default 50)"<<std::endl
+             <<"  --integrator explicit|implicit|xpbd|pd"<<std::endl
+             <<"               euler|verlet|rk4 Mass spring: symplectic Euler, velocity Verlet or Runge-Kutta 4"<<std::endl
+             <<"               implicit|explicit Rope: backward Euler solved along the rope (default) or symplectic Euler"<<std::endl
+             <<"  --collider sphere|mesh        Cloth: obstacle"<<std::endl
+             <<"  --self-collision on|off       Cloth"<<std::endl
+             <<"  --multigrid on|off            Cloth: multigrid solver of the implicit integrator"<<std::endl
+             <<"  --iterations N                Cloth: iterations of the xpbd and pd solvers, rope: maximal Newton iterations of the implicit solver"<<std::endl
+             <<"  --chebyshev on|off            Cloth: Chebyshev acceleration of the pd solver"<<std::endl
+             <<"  --rho r                       Cloth: spectral radius estimate of the Chebyshev acceleration"<<std::endl
+             <<"  --sleeping on|off             Cloth and spheres: skip the particles at rest"<<std::endl
+             <<"  --tearing r                   Cloth: break the springs stretched beyond r times their rest length"<<std::endl
+             <<"  --threads N|on|off            Cloth and spheres: number of threads of the pool (on: hardware threads, off: 1)"<<std::endl
+             <<"  --simd on|off                 Cloth and spheres: use the vectorized kernels"<<std::endl
+             <<"  --check-simd on|off           Cloth: compare the vectorized and scalar forces after the steps (exit code 1 above 1e-4)"<<std::endl
+             <<"  --load file                   Start from a saved state (its parameters replace the options)"<<std::endl
+             <<"  --save file                   Save the state after the steps"<<std::endl
+             <<"  --seed n                      Spheres: seed of the random generator"<<std::endl
+             <<"  --record file                 Cloth and spheres: stream the positions after each step to a cache file"<<std::endl
+             <<"  --record-drop on|off          Drop the frames when the writer of the cache is late instead of waiting (default off)"<<std::endl
+             <<"  --cache file                  Playback: cache file decoded frame by frame"<<std::endl
+             <<"  --particles N                 Spheres: number of particles (default 200), mass spring and rope: length of the chain (default 3, 1000)"<<std::endl
+             <<"  --radius r                    Spheres: radius of the particles (default 0.08)"<<std::endl
+             <<"  --radius-spread s             Spheres: radii drawn between r and s x r"<<std::endl
+             <<"  --capacity N                  Spheres: capacity of the pool of particles (default 2000)"<<std::endl
+             <<"  --lifetime t                  Spheres: remove the particles older than t seconds"<<std::endl
+             <<"  --emit t                      Spheres: emit a particle every t seconds during the steps"<<std::endl
+             <<"  --shape box|sphere|mesh       Spheres: container/obstacle"<<std::endl
+             <<"  --broadphase grid|sap         Spheres: uniform grid or sweep and prune"<<std::endl
+             <<"  --ccd on|off                  Spheres: continuous collision detection of the fast particles (default off)"<<std::endl;
+}
+
+static bool parse_on_off(const std::string& value)
+{
+    assert_vcl(value=="on" || value=="off", "Expect on or off, got "+value);
+    return value=="on";
+}
+
+static headless_options parse_options(int argc, char** argv)
+{
+    headless_options options;
+    options.scene = argv[1];
+    for(int k=2; k<argc; ++k)
+    {
+        const std::string name = argv[k];
+        assert_vcl(k+1<argc, "Missing value for option "+name);
+        const std::string value = argv[++k];
+
+        if(name=="--steps")               options.steps = std::atoi(value.c_str());
+        else if(name=="--dt")             options.dt = float(std::atof(value.c_str()));
+        else if(name=="--resolution")     options.resolution = std::atoi(value.c_str());
+        else if(name=="--particles")      options.particles = std::atoi(value.c_str());
+        else if(name=="--radius")         options.radius = float(std::atof(value.c_str()));
+        else if(name=="--radius-spread")  options.radius_spread = float(std::atof(value.c_str()));
+        else if(name=="--capacity")       options.capacity = std::atoi(value.c_str());
+        else if(name=="--lifetime")       options.lifetime = float(std::atof(value.c_str()));
+        else if(name=="--emit")           options.emit = float(std::atof(value.c_str()));
+        else if(name=="--integrator")     options.integrator = value;
+        else if(name=="--collider")       options.collider = value;
+        else if(name=="--shape")          options.shape = value;
+        else if(name=="--broadphase")     options.broadphase = value;
+        else if(name=="--threads")        options.threads = value=="on"? 0 : value=="off"? 1 : std::max(std::atoi(value.c_str()), 1);
+        else if(name=="--simd")           options.simd = parse_on_off(value);
+        else if(name=="--check-simd")     options.check_simd = parse_on_off(value);
+        else if(name=="--self-collision") options.self_collision = parse_on_off(value);
+        else if(name=="--multigrid")      options.multigrid = parse_on_off(value);
+        else if(name=="--iterations")     options.iterations = std::atoi(value.c_str());
+        else if(name=="--chebyshev")      options.chebyshev = parse_on_off(value);
+        else if(name=="--sleeping")       options.sleeping = parse_on_off(value);
+        else if(name=="--ccd")            options.ccd = parse_on_off(value);
+        else if(name=="--tearing")        options.tearing = float(std::atof(value.c_str()));
+        else if(name=="--load")           options.load = value;
+        else if(name=="--save")           options.save = value;
+        else if(name=="--record")         options.record = value;
+        else if(name=="--record-drop")    options.record_drop = parse_on_off(value);
+        else if(name=="--cache")          options.cache = value;
+        else if(name=="--seed")           options.seed = unsigned(std::atoi(value.c_str()));
+        else if(name=="--rho")            options.rho = float(std::atof(value.c_str()));
+        else
+            error_vcl("Unknown option "+name);
+    }
+    assert_vcl(options.steps>0, "The number of steps must be positive");
+    return options;
+}
+
+
+// ************************************** //
+// Report
+// ************************************** //
+
+// Print the total time, the throughput, and the time spent in each phase (name, accumulated seconds)
+static void print_timings(double total, int steps, const std::vector<std::pair<std::string,double> >& phases)
+{
+    std::cout<<std::fixed<<std::setprecision(3);
+    std::cout<<"total "<<total<<" s, "<<std::setprecision(1)<<double(steps)/total<<" steps/s"<<std::endl;
+    std::cout<<std::left<<std::setw(20)<<"phase"<<std::right<<std::setw(12)<<"total (s)"<<std::setw(16)<<"per step (ms)"<<std::setw(10)<<"share"<<std::endl;
+    for(const auto& phase : phases)
+        std::cout<<std::left<<std::setw(20)<<phase.first<<std::right<<std::setprecision(3)<<std::setw(12)<<phase.second
+                 <<std::setw(16)<<1000.0*phase.second/double(steps)
+                 <<std::setprecision(1)<<std::setw(9)<<100.0*phase.second/total<<"%"<<std::endl;
+}
+
+
+// FNV-1a hash of the particle positions: two runs are identical when their checksums are equal
+static uint64_t positions_checksum(const std::vector<vec3>& positions)
+{
+    uint64_t hash = 14695981039346656037ull;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(positions.data());
+    for(size_t k=0; k<positions.size()*sizeof(vec3); ++k)
+        hash = (hash^bytes[k])*1099511628211ull;
+    return hash;
+}
+
+// Restore the state of a simulation from options.load (if any), and report the loading time
+template <typename SIMULATION>
+static bool load_state(SIMULATION& simulation, const headless_options& options)
+{
+    if(options.load.empty())
+        return true;
+    const auto t0 = std::chrono::steady_clock::now();
+    if(!simulation.load_state(options.load))
+        return false;
+    const double time = std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+    std::cout<<"state loaded from "<<options.load<<" in "<<std::setprecision(2)<<std::fixed<<1000.0*time<<" ms"<<std::endl;
+    return true;
+}
+
+template <typename SIMULATION>
+static bool save_state(const SIMULATION& simulation, const headless_options& options)
+{
+    if(options.save.empty())
+        return true;
+    if(!simulation.save_state(options.save))
+        return false;
+    std::cout<<"state saved in "<<options.save<<std::endl;
+    return true;
+}
+
+
+// Open the cache file receiving the frames, if any
+static bool open_record(frame_cache_writer& record, const headless_options& options)
+{
+    if(options.record.empty())
+        return true;
+    if(!record.open(options.record, 32, 4, options.record_drop? FRAME_CACHE_DROP : FRAME_CACHE_WAIT)) {
+        std::cerr<<"Cannot create "<<options.record<<std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Complete the cache file and report its compression
+static void close_record(frame_cache_writer& record)
+{
+    if(!record.is_open())
+        return;
+    const auto t0 = std::chrono::steady_clock::now();
+    record.close();
+    const double time = std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+    std::cout<<"record: "<<record.frames()<<" frames, "<<std::setprecision(1)<<std::fixed<<double(record.bytes_raw())/1e6<<" MB of positions written in "
+             <<double(record.bytes_written())/1e6<<" MB (ratio "<<std::setprecision(2)<<double(record.bytes_raw())/double(std::max(record.bytes_written(),size_t(1)))
+             <<"), "<<record.frames_dropped()<<" frames dropped, "<<std::setprecision(1)<<1000*record.wait_time()<<" ms waited for the writer during the steps and "
+             <<1000*time<<" ms at the end"<<std::endl;
+}
+
+
+// ************************************** //
+// Scenes
+// ************************************** //
+
+static int run_cloth(const headless_options& options)
+{
+    static const std::map<std::string,integrator_type> integrators = {{"explicit",EXPLICIT_EULER}, {"implicit",IMPLICIT_EULER}, {"xpbd",XPBD}, {"pd",PROJECTIVE_DYNAMICS}};
+    const std::string integrator = options.integrator.empty()? "explicit" : options.integrator;
+    assert_vcl(integrators.count(integrator)>0, "Unknown integrator "+integrator);
+    assert_vcl(options.collider=="sphere" || options.collider=="mesh", "Unknown collider "+options.collider);
+
+    cloth_simulation simulation;
+    simulation.set_default_parameters();
+    simulation.initialize(size_t(options.resolution));
+
+    simulation.user_parameters.integrator = integrators.at(integrator);
+    simulation.user_parameters.self_collision = options.self_collision;
+    simulation.user_parameters.multigrid = options.multigrid;
+    simulation.user_parameters.chebyshev = options.chebyshev;
+    simulation.user_parameters.sleeping = options.sleeping;
+    simulation.user_parameters.tearing = options.tearing>0;
+    if(options.tearing>0)
+        simulation.user_parameters.tearing_ratio = options.tearing;
+    if(options.iterations>0) {
+        simulation.user_parameters.xpbd_iterations = options.iterations;
+        simulation.user_parameters.pd_iterations = options.iterations;
+    }
+    if(options.rho>0)
+        simulation.user_parameters.chebyshev_rho = options.rho;
+    simulation.collision_shapes.collider = options.collider=="mesh"? MESH_COLLIDER : SPHERE_COLLIDER;
+    simulation.set_threads(size_t(options.threads));
+    simulation.simd = options.simd && simd_support()!=simd_instruction_set::none;
+    if(!load_state(simulation, options))
+        return 1;
+
+    const bool implicit = simulation.user_parameters.integrator!=EXPLICIT_EULER;
+    const float h = options.dt>0? options.dt : (implicit? 0.02f : 0.001f);
+
+    std::cout<<"cloth: "<<simulation.position.size()<<" particles, "<<simulation.springs.size()<<" springs, "
+             <<integrator<<" integrator, "<<options.steps<<" steps of "<<h<<" s"<<std::endl;
+    std::cout<<"threads: "<<(simulation.multithreading? int(simulation.pool.size()) : 1)
+             <<", simd: "<<(simulation.simd? simd_instruction_set_name(simd_support()) : "none")<<std::endl;
+
+    frame_cache_writer record;
+    if(!open_record(record, options))
+        return 1;
+
+    long solver_iterations = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    for(int k=0; k<options.steps && !simulation.simulation_diverged; ++k) {
+        simulation.step(h);
+        solver_iterations += simulation.implicit_solver.iterations;
+        if(record.is_open())
+            record.push(float(k+1)*h, &simulation.position[0].x, 3*simulation.position.size());
+    }
+    const double total = std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+    close_record(record);
+
+    const cloth_timings_structure& t = simulation.timings;
+    print_timings(total, int(t.steps), {{"forces",t.forces}, {"integration",t.integration}, {"collisions",t.collisions},
+                                         {"self collision",t.self_collision}, {"constraints",t.constraints}});
+    if(simulation.user_parameters.integrator==IMPLICIT_EULER)
+        std::cout<<"implicit solver: "<<(options.multigrid && simulation.implicit_solver.multigrid_available? "multigrid" : "jacobi")<<" preconditioned CG, "
+                 <<double(solver_iterations)/double(std::max(t.steps,size_t(1)))<<" iterations per step"<<std::endl;
+    if(simulation.user_parameters.integrator==PROJECTIVE_DYNAMICS)
+        std::cout<<"projective dynamics: "<<simulation.user_parameters.pd_iterations<<" iterations per step"
+                 <<(options.chebyshev? " (Chebyshev)" : "")<<", "<<simulation.projective_dynamics.factorizations<<" factorization(s)"<<std::endl;
+
+    if(options.sleeping)
+        std::cout<<"sleeping: "<<simulation.sleeping.bands_asleep<<"/"<<simulation.sleeping.asleep.size()<<" bands asleep"<<std::endl;
+    if(options.tearing>0)
+        std::cout<<"tearing: "<<simulation.tearing.springs_broken<<" springs broken, "<<simulation.position.size()-simulation.Nu*simulation.Nv<<" particles added"<<std::endl;
+
+    std::cout<<"checksum: "<<std::hex<<positions_checksum(simulation.position.data)<<std::dec<<std::endl;
+
+    // The vectorized kernels must reproduce the scalar forces up to the rounding of the float operations
+    if(options.check_simd) {
+        const float tolerance = 1e-4f;
+        if(simd_support()==simd_instruction_set::none)
+            std::cout<<"check simd: no vectorized kernels on this CPU"<<std::endl;
+        else {
+            const float difference = simulation.check_simd_kernels();
+            std::cout<<"check simd ("<<simd_instruction_set_name(simd_support())<<"): relative difference with the scalar forces "
+                     <<std::scientific<<std::setprecision(2)<<difference<<std::fixed<<(difference>tolerance? " (above the tolerance)" : "")<<std::endl;
+            if(difference>tolerance)
+                return 1;
+        }
+    }
+
+    if(simulation.simulation_diverged) {
+        std::cout<<"simulation diverged after "<<t.steps<<" steps"<<std::endl;
+        return 1;
+    }
+    return save_state(simulation, options)? 0 : 1;
+}
+
+static int run_spheres(const headless_options& options)
+{
+    static const std::map<std::string,intersection_type> shapes = {{"box",BOX}, {"sphere",SPHERE}, {"mesh",MESH}};
+    assert_vcl(shapes.count(options.shape)>0, "Unknown shape "+options.shape);
+    static const std::map<std::string,broadphase_type> broadphases = {{"grid",GRID_BROADPHASE}, {"sap",SWEEP_AND_PRUNE_BROADPHASE}};
+    assert_vcl(broadphases.count(options.broadphase)>0, "Unknown broadphase "+options.broadphase);
+
+    const int N_particle = options.particles>=0? options.particles : 200;
+
+    sphere_collision_simulation simulation;
+    simulation.seed = options.seed;
+    if(options.capacity>=0)
+        simulation.max_particles = size_t(options.capacity);
+    else
+        simulation.max_particles = std::max(simulation.max_particles, size_t(N_particle));
+    simulation.lifetime = options.lifetime;
+    simulation.initialize();
+    simulation.current_inter = shapes.at(options.shape);
+    simulation.broadphase = broadphases.at(options.broadphase);
+    simulation.sleeping = options.sleeping;
+    simulation.ccd = options.ccd;
+    simulation.simd = options.simd && simd_support()!=simd_instruction_set::none;
+    simulation.set_threads(size_t(options.threads));
+    if(options.radius>0)
+        simulation.particle_radius = options.radius;
+    simulation.particle_radius_spread = options.radius_spread;
+
+    // All the particles are emitted at once, spread in the upper half of the container to avoid initial overlaps
+    if(options.load.empty()) {
+        for(int k=0; k<N_particle && simulation.emit_particle(); ++k) {
+            const vec3 p = {rand_interval(-0.5f,0.5f), rand_interval(0.2f,0.5f), rand_interval(-0.5f,0.5f)};
+            simulation.particles.set_position(simulation.particles.size()-1, p);
+        }
+    }
+    else if(!load_state(simulation, options))
+        return 1;
+
+    const float dt = options.dt>0? options.dt : 0.02f;
+    const vec3 gravity_direction = {0,-1,0};
+
+    std::cout<<"spheres: "<<simulation.particles.size()<<" particles in "<<options.shape<<", "<<options.steps<<" steps of "<<dt<<" s"<<std::endl;
+    std::cout<<"threads: "<<(simulation.multithreading? int(simulation.pool.size()) : 1)
+             <<", simd: "<<(simulation.simd? simd_instruction_set_name(simd_support()) : "none")
+             <<", broadphase: "<<(simulation.broadphase==SWEEP_AND_PRUNE_BROADPHASE? "sweep and prune" : "grid")<<std::endl;
+
+    frame_cache_writer record;
+    if(!open_record(record, options))
+        return 1;
+
+    // Emission during the steps, as in the interactive scene (the particles are emitted at the center of the box)
+    const int emit_steps = options.emit>0? std::max(int(std::round(options.emit/dt)),1) : 0;
+
+    std::vector<vec3> positions;
+    const auto t0 = std::chrono::steady_clock::now();
+    for(int k=0; k<options.steps; ++k) {
+        if(emit_steps>0 && k%emit_steps==0)
+            simulation.emit_particle();
+        simulation.compute_time_step(dt, gravity_direction);
+        if(record.is_open()) {
+            positions.resize(simulation.particles.size());
+            for(size_t i=0; i<positions.size(); ++i)
+                positions[i] = simulation.particles.position(i);
+            record.push(float(k+1)*dt, positions.empty()? nullptr : &positions[0].x, 3*positions.size());
+        }
+    }
+    const double total = std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+    close_record(record);
+
+    const sphere_collision_timings_structure& t = simulation.timings;
+    print_timings(total, int(t.steps), {{"integration",t.integration}, {"particle collisions",t.particle_collisions}, {"border collisions",t.border_collisions}});
+    if(options.sleeping)
+        std::cout<<"sleeping: "<<simulation.particles_asleep<<"/"<<simulation.particles.size()<<" particles asleep"<<std::endl;
+    if(options.ccd)
+        std::cout<<"ccd: "<<simulation.ccd_events<<" impacts handled within the steps"<<std::endl;
+    if(simulation.broadphase==SWEEP_AND_PRUNE_BROADPHASE)
+        std::cout<<"sweep and prune: axis "<<"xyz"[simulation.sap.axis]<<", "<<simulation.sap.swaps<<" swaps of the insertion sort at the last update"<<std::endl;
+    std::cout<<"pool: "<<simulation.particles.size()<<"/"<<simulation.max_particles<<" particles, "<<simulation.particles_culled<<" culled"<<std::endl;
+
+    positions.resize(simulation.particles.size());
+    for(size_t k=0; k<simulation.particles.size(); ++k)
+        positions[k] = simulation.particles.position(k);
+    std::cout<<"checksum: "<<std::hex<<positions_checksum(positions)<<std::dec<<std::endl;
+    return save_state(simulation, options)? 0 : 1;
+}
+
+// Decode all the frames of a cache in order (as the playback of the scenes), report the decoding speed and the checksum of the last frame
+static int run_playback(const headless_options& options)
+{
+    frame_cache_reader cache;
+    if(!cache.open(options.cache)) {
+        std::cerr<<"Cannot open the cache "<<options.cache<<std::endl;
+        return 1;
+    }
+    if(cache.size()==0) {
+        std::cout<<"empty cache"<<std::endl;
+        return 0;
+    }
+
+    std::vector<vec3> positions;
+    const auto t0 = std::chrono::steady_clock::now();
+    for(size_t k=0; k<cache.size(); ++k) {
+        const std::vector<float>& frame = cache.frame(k);
+        positions.resize(frame.size()/3);
+        for(size_t i=0; i<positions.size(); ++i)
+            positions[i] = {frame[3*i], frame[3*i+1], frame[3*i+2]};
+    }
+    const double total = std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+
+    std::cout<<"playback: "<<cache.size()<<" frames ("<<cache.time(0)<<" s to "<<cache.time(cache.size()-1)<<" s), "
+             <<std::setprecision(1)<<std::fixed<<double(cache.size())/total<<" frames/s"<<std::endl;
+    std::cout<<"checksum: "<<std::hex<<positions_checksum(positions)<<std::dec<<std::endl;
+    return 0;
+}
+
+static int run_mass_spring(const headless_options& options)
+{
+    static const std::map<std::string,mass_spring_integrator> integrators = {{"euler",SYMPLECTIC_EULER}, {"verlet",VELOCITY_VERLET}, {"rk4",RUNGE_KUTTA_4}};
+    const std::string integrator = options.integrator.empty()? "euler" : options.integrator;
+    assert_vcl(integrators.count(integrator)>0, "Unknown integrator "+integrator);
+
+    mass_spring_simulation simulation;
+    simulation.integrator = integrators.at(integrator);
+    simulation.initialize(options.particles>=0? size_t(options.particles) : 3);
+    const double energy = simulation.chain.energy();
+
+    const float dt = options.dt>0? options.dt : 0.01f;
+    std::cout<<"mass spring: chain of "<<simulation.chain.size()<<" particles, "<<integrator<<" integrator, "
+             <<options.steps<<" steps of "<<dt<<" s"<<std::endl;
+
+    const auto t0 = std::chrono::steady_clock::now();
+    for(int k=0; k<options.steps; ++k)
+        simulation.compute_time_step(dt);
+    const double total = std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+
+    print_timings(total, options.steps, {{"step",total}});
+    std::cout<<"final position of the last particle: "<<simulation.chain.position(simulation.chain.size()-1)<<std::endl;
+    std::cout<<"energy: "<<std::defaultfloat<<std::setprecision(6)<<energy<<" -> "<<simulation.chain.energy()<<std::endl;
+    return 0;
+}
+
+static int run_rope(const headless_options& options)
+{
+    static const std::map<std::string,rope_integrator> integrators = {{"implicit",ROPE_IMPLICIT}, {"explicit",ROPE_SYMPLECTIC_EULER}};
+    const std::string integrator = options.integrator.empty()? "implicit" : options.integrator;
+    assert_vcl(integrators.count(integrator)>0, "Unknown integrator "+integrator);
+
+    rope_simulation simulation;
+    if(options.particles>=0)
+        simulation.N = size_t(options.particles);
+    simulation.integrator = integrators.at(integrator);
+    simulation.initialize();
+    if(options.iterations>0)
+        simulation.solver.iterations = options.iterations;
+    const double energy = simulation.rope.energy();
+
+    const vcl::mass_spring_system_double& rope = simulation.rope;
+    const float explicit_dt = simulation.explicit_time_step();
+    const float dt = options.dt>0? options.dt : (simulation.integrator==ROPE_IMPLICIT? 0.01f : explicit_dt);
+    std::cout<<"rope: "<<rope.size()<<" particles, "<<integrator<<" integrator, "<<options.steps<<" steps of "<<dt<<" s"
+             <<" (explicit stability limit "<<2*explicit_dt<<" s)"<<std::endl;
+
+    const auto t0 = std::chrono::steady_clock::now();
+    for(int k=0; k<options.steps; ++k)
+        simulation.compute_time_step(dt);
+    const double total = std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+
+    const rope_timings_structure& t = simulation.timings;
+    print_timings(total, int(t.steps), {{"prediction",t.prediction}, {"solve",t.solve}, {"update",t.update}});
+    if(simulation.integrator==ROPE_IMPLICIT)
+        std::cout<<"implicit solver, last step: "<<simulation.solver.iterations_done<<"/"<<simulation.solver.iterations
+                 <<" newton iterations, "<<simulation.solver.line_search<<" halvings, residual "<<std::scientific<<std::setprecision(2)
+                 <<simulation.solver.residual<<std::fixed<<std::endl;
+    std::cout<<"final position of the free end: "<<rope.position(rope.size()-1)<<std::endl;
+    std::cout<<"max stretch: "<<std::defaultfloat<<std::setprecision(4)<<100*simulation.max_stretch()<<"%"<<std::endl;
+    std::cout<<"energy: "<<std::setprecision(6)<<energy<<" -> "<<rope.energy()<<std::endl;
+    std::vector<vec3> positions(rope.size());
+    for(size_t k=0; k<rope.size(); ++k)
+        positions[k] = rope.position(k);
+    std::cout<<"checksum: "<<std::hex<<positions_checksum(positions)<<std::dec<<std::endl;
+    return 0;
+}
+
+// ************************************** //
+// Start program
+// ************************************** //
+
+int main(int argc, char** argv)
+{
+    if(argc<2 || std::string(argv[1])=="--help") {
+        print_usage();
+        return argc<2? 1 : 0;
+    }
+
+    const headless_options options = parse_options(argc, argv);
+
+    if(options.scene=="cloth")
+        return run_cloth(options);
+    if(options.scene=="spheres")
+        return run_spheres(options);
+    if(options.scene=="mass_spring")
+        return run_mass_spring(options);
+    if(options.scene=="rope")
+        return run_rope(options);
+    if(options.scene=="playback")
+        return run_playback(options);
+
+    std::cerr<<"Unknown scene "<<options.scene<<std::endl;
+    print_usage();
+    return 1;
+}
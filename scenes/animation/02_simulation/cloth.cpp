@@ -1,6 +1,4 @@
-
 #include "cloth.hpp"
-#include <cmath>
 
 
 #ifdef SCENE_CLOTH
@@ -8,189 +6,13 @@
 using namespace vcl;
 
 
-// Fill value of force applied on each particle
-// - Gravity
-// - Drag
-// - Spring force
-// - Wind force
-//
-float current_magnitude = 0.f;
-void scene_model::compute_forces()
-{
-    const size_t N = force.size();        // Total number of particles of the cloth Nu x Nv
-    const int N_dim = int(force.dimension[0]); // Number of particles along one dimension (square dimension)
-
-    simulation_parameters.m = user_parameters.m / float(N); // Constant total mass
-
-    // Get simuation parameters
-    const float K  = user_parameters.K;
-    const float m  = simulation_parameters.m;
-    const float L0 = simulation_parameters.L0;
-
-    // Gravity
-    const vec3 g = {0,-9.81f,0};
-    for(size_t k=0; k<N; ++k)
-        force[k] = m*g;
-
-    // Drag
-    const float mu = user_parameters.mu;
-    for(size_t k=0; k<N; ++k)
-        force[k] = force[k]-mu*speed[k];
-
-    // Wind
-    const vec3 w = {-current_magnitude, 0, 0};
-    for(int ku=0; ku<N_dim; ++ku) {
-        for(int kv=0; kv<N_dim; ++kv) {
-            int current = ku * N_dim + kv;
-            vec3 normal {0, 0, 0};
-            unsigned nb_normal = 0;
-            if (ku > 0){
-                int up = (ku - 1) * N_dim + kv;
-                if (kv > 0){
-                    int left = ku * N_dim + kv - 1;
-                    vec3 temp = normalize(cross(normalize(position[up] - position[current]),
-                                              normalize(position[left] - position[current])));
-                    if (temp[0] > 0)
-                        temp = -temp;
-                    normal += temp;
-                    nb_normal++;
-                }
-                if (kv < N_dim - 1)
-                {
-                    int right = ku * N_dim + kv + 1;
-                    vec3 temp = normalize(cross(normalize(position[up] - position[current]),
-                                              normalize(position[right] - position[current])));
-                    if (temp[0] > 0)
-                        temp = -temp;
-                    normal += temp;
-                    nb_normal++;
-                }
-            }
-            if (ku < N_dim - 1){
-                int down = (ku + 1) * N_dim + kv;
-                if (kv > 0){
-                    int left = ku * N_dim + kv - 1;
-                    vec3 temp = normalize(cross(normalize(position[down] - position[current]),
-                                              normalize(position[left] - position[current])));
-                    if (temp[0] > 0)
-                        temp = -temp;
-                    normal += temp;
-                    nb_normal++;
-                }
-                if (kv < N_dim - 1)
-                {
-                    int right = ku * N_dim + kv + 1;
-                    vec3 temp = normalize(cross(normalize(position[down] - position[current]),
-                                              normalize(position[right] - position[current])));
-                    if (temp[0] > 0)
-                        temp = -temp;
-                    normal += temp;
-                    nb_normal++;
-                }
-            }
-
-            normal /= nb_normal;
-            force[current] += w * 0.001f * dot(normalize(w), normal);
-        }
-    }
-
-    // Springs
-    for(int ku=0; ku<N_dim; ++ku) {
-        for(int kv=0; kv<N_dim; ++kv) {
-            // To do ...
-            // Compute spring forces force(ku,kv) = ...
-            int current = ku * N_dim + kv;
-
-            for (int i = -2; i < 3; i++) {
-                for (int j = -2; j < 3; j++)
-                {
-                    if ((i == 0 && j == 0) || (abs(i) == 2 && abs(j) == 1)
-                        || (abs(i) == 1 && abs(j) == 2) || (abs(i) == 2 && abs(j) == 2))
-                        continue;
-
-                    if (ku+i >= 0 && ku+i < N_dim && kv+j >= 0 && kv+j < N_dim)
-                    {
-                        vec3 const pji = position[(ku+i) * N_dim + kv+j] - position[current];
-                        float const L = norm(pji);
-
-                        float Lij = L0; // L0 for structural springs
-                        
-                        if (i != 0 && j!= 0)    // L0 for shearing springs
-                            Lij = sqrt(2 * L0*L0);
-
-                        if (abs(i) == 2 || abs(j) == 2) // L0 for bending springs
-                            Lij = 2 * L0;
-
-                        force[current] = force[current] + K * (L - Lij) * pji / L;
-                    }
-                }
-            }
-        }
-    }
-}
-
-
-// Handle detection and response to collision with the shape described in "collision_shapes" variable
-void scene_model::collision_constraints()
-{
-    //Ground collision
-    const size_t N = force.size();        // Total number of particles of the cloth Nu x Nv
-    for (size_t k = 0; k < N; ++k)
-    {
-        if (position[k][1] < collision_shapes.ground_height)
-            position[k][1] = collision_shapes.ground_height;
-    }
-    
-    //Sphere collision
-    for (size_t k = 0; k < N; ++k)
-    {
-        float detection = norm(position[k] - collision_shapes.sphere_p);
-        if (detection <= collision_shapes.sphere_r + 0.01f)
-        {
-            vec3 u = (position[k] - collision_shapes.sphere_p) / norm(position[k] - collision_shapes.sphere_p);
-            float m1 = user_parameters.m / (float)(N);
-            float m2 = 100.f;
-            float j = 2 * (m1 * m2) / (m1 + m2) * dot(- speed[k], u);
-
-            speed[k] = 0.5f * speed[k] + 0.5f * j/(user_parameters.m / (float)(N));
-
-            float d = collision_shapes.sphere_r + 0.01f - norm(position[k] - collision_shapes.sphere_p);
-            //speed[k] = 0.1f * speed[k];
-            position[k] = position[k] + d/2.f*u;
-        }
-    }
-}
-
-
-
-// Initialize the geometrical model
+// Initialize the cloth simulation and its visual model
 void scene_model::initialize()
 {
     // Number of samples of the model (total number of particles is N_cloth x N_cloth)
-    const size_t N_cloth = 50;
-
-    // Rest length (length of an edge)
-    simulation_parameters.L0 = 1.0f/float(N_cloth-1);
-
-    // Create cloth mesh in its initial position
-    // Horizontal grid of length 1 x 1
-    const mesh base_cloth = mesh_primitive_grid(N_cloth,N_cloth,{0,1,-0.5f},{1,0,0},{0,0,1});
-
-    // Set particle position from cloth geometry
-    position = buffer2D_from_vector(base_cloth.position, N_cloth, N_cloth);
-
-    // Set hard positional constraints
-    positional_constraints[0] = position[0];
-    positional_constraints[N_cloth*(N_cloth-1)] = position[N_cloth*(N_cloth-1)];
-
-    // Init particles data (speed, force)
-    speed.resize(position.dimension); speed.fill({0,0,0});
-    force.resize(position.dimension); force.fill({0,0,0});
-
-
-    // Store connectivity and normals
-    connectivity = base_cloth.connectivity;
-    normals      = normal(position.data,connectivity);
+    const size_t N_cloth = size_t(gui_resolution);
+    cache_playback.close(); // The simulation restarts: the playback is interrupted
+    const mesh base_cloth = simulation.initialize(N_cloth);
 
     // Send data to GPU
     cloth.clear();
@@ -198,9 +20,8 @@ void scene_model::initialize()
     cloth.uniform.shading.specular = 0.0f;
     cloth.shader = shader_mesh;
     cloth.texture_id = texture_cloth;
-
-    simulation_diverged = false;
-    force_simulation    = false;
+    cloth_topology_version = simulation.tearing.version;
+    cloth_vertices_gpu = simulation.position.size();
 
     timer.update();
 }
@@ -214,21 +35,15 @@ void scene_model::setup_data(std::map<std::string,GLuint>& shaders, scene_struct
     texture_wood  = create_texture_gpu(image_load_png("scenes/animation/02_simulation/assets/wood.png"));
     shader_mesh = shaders["mesh_bf"];
 
+    // Default value for simulation parameters and collision shapes
+    simulation.set_default_parameters();
+    gui_resolution = 50;
+
     // Initialize cloth geometry and particles
     initialize();
 
-    // Default value for simulation parameters
-    user_parameters.K    = 100.0f;
-    user_parameters.m    = 5.0f;
-    user_parameters.wind = 0.0f;
-    user_parameters.mu   = 0.02f;
-
-    // Set collision shapes
-    collision_shapes.sphere_p = {0,0.1f,0};
-    collision_shapes.sphere_r = 0.1f;
-    collision_shapes.ground_height = 0.1f;
-
     // Init visual models
+    const collision_shapes_structure& collision_shapes = simulation.collision_shapes;
     sphere = mesh_drawable(mesh_primitive_sphere(1.0f,{0,0,0},60,60));
     sphere.shader = shaders["mesh"];
     sphere.uniform.color = {1,0,0};
@@ -237,68 +52,129 @@ void scene_model::setup_data(std::map<std::string,GLuint>& shaders, scene_struct
     ground.shader = shaders["mesh_bf"];
     ground.texture_id = texture_wood;
 
+    obstacle = mesh_drawable(cloth_simulation::obstacle_mesh());
+    obstacle.shader = shaders["mesh"];
+    obstacle.uniform.color = {1,0,0};
+
     gui_display_texture = true;
     gui_display_wireframe = false;
+    gui_fixed_time_step = false;
+    cache_time = 0.0f;
 }
 
 void scene_model::frame_draw(std::map<std::string,GLuint>& shaders, scene_structure& scene, gui_structure& gui)
 {
-    const float dt = timer.update();
+    float dt = timer.update();
+    if(gui_fixed_time_step && dt>0)
+        dt = timer.scale/60.0f; // Same steps whatever the frame rate: a saved state can be replayed identically
     set_gui();
 
-    // Force constant simulation time step
-    float h = dt<=1e-6f? 0.0f : timer.scale*0.001f;
-
-    if( (!simulation_diverged || force_simulation) && h>0)
+    if(cache_playback.size()>0)
+        playback_frame();
+    else
     {
-        // Iterate over a fixed number of substeps between each frames
-        const size_t number_of_substeps = 4;
-        for(size_t k=0; (!simulation_diverged  || force_simulation) && k<number_of_substeps; ++k)
-        {
-            current_magnitude = user_parameters.wind + (user_parameters.wind / 2.f) * sinf(0.1*dt);
-            
-            compute_forces();
-            numerical_integration(h);
-            collision_constraints();                 // Detect and solve collision with other shapes
-
-            hard_constraints();                      // Enforce hard positional constraints
-
-            normal(position.data, connectivity, normals); // Update normals of the cloth
-            detect_simulation_divergence();               // Check if the simulation seems to diverge
+        simulation.simulate(dt, timer.scale);
+
+        // Stop the animation when the simulation diverges (it can be forced to continue with the Start button)
+        if(simulation.simulation_diverged && !simulation.force_simulation)
+            timer.stop();
+
+        // The recorded frames are compressed and written by the thread of the cache
+        if(cache_record.is_open() && dt>0) {
+            cache_time += dt;
+            cache_record.push(cache_time, &simulation.position[0].x, 3*simulation.position.size());
         }
     }
 
-
-    cloth.update_position(position.data);
-    cloth.update_normal(normals.data);
+    update_cloth_topology();
+    cloth.update_position(simulation.position);
+    cloth.update_normal(simulation.normals);
 
     display_elements(shaders, scene, gui);
 
 }
 
-void scene_model::numerical_integration(float h)
+// Restore the state saved by the Save button, the visual model is rebuilt as the number of particles may have changed
+void scene_model::load_state()
 {
-    const size_t NN = position.size();
-    const float m = simulation_parameters.m;
-
-    for(size_t k=0; k<NN; ++k)
-    {
-        vec3& p = position[k];
-        vec3& v = speed[k];
-        const vec3& f = force[k];
+    if(!simulation.load_state(state_filename))
+        return;
+    cache_playback.close();
+
+    mesh cloth_mesh;
+    cloth_mesh.position = simulation.position;
+    cloth_mesh.normal = simulation.normals;
+    cloth_mesh.texture_uv = simulation.texture_uv;
+    cloth_mesh.connectivity = simulation.connectivity;
+    cloth_mesh.fill_empty_fields();
+
+    const GLuint shader = cloth.shader;
+    cloth.clear();
+    cloth = mesh_drawable(cloth_mesh);
+    cloth.uniform.shading.specular = 0.0f;
+    cloth.shader = shader;
+    cloth.texture_id = texture_cloth;
+    cloth_topology_version = simulation.tearing.version;
+    cloth_vertices_gpu = simulation.position.size();
+}
 
-        v = v + h*f/m;
-        p = p + h*v;
+// Replace the cloth by the recorded frames (the simulation is suspended until the end of the playback)
+void scene_model::start_playback()
+{
+    cache_record.close();
+    if(!cache_playback.open(cache_filename) || cache_playback.size()<2) {
+        std::cerr<<"No frames recorded in "<<cache_filename<<std::endl;
+        cache_playback.close();
+        return;
     }
+    position_before_playback = simulation.position;
+    playback_timer.t_min = cache_playback.time(0);
+    playback_timer.t_max = cache_playback.time(cache_playback.size()-1);
+    playback_timer.t = playback_timer.t_min;
+    playback_timer.start();
+}
+
+void scene_model::stop_playback()
+{
+    cache_playback.close();
+    simulation.position = position_before_playback;
+    simulation.compute_triangle_normals();
+    simulation.compute_vertex_normals();
 }
 
-void scene_model::hard_constraints()
+// Display the recorded frame at the time of the playback timer
+//  Frames recorded with another number of particles (before a tear) are skipped
+void scene_model::playback_frame()
 {
-    // Fixed positions of the cloth
-    for(const auto& constraints : positional_constraints)
-        position[constraints.first] = constraints.second;
+    playback_timer.update();
+    const std::vector<float>& frame = cache_playback.frame(cache_playback.frame_at(playback_timer.t));
+    if(frame.size()!=3*simulation.position.size())
+        return;
+
+    for(size_t k=0; k<simulation.position.size(); ++k)
+        simulation.position[k] = {frame[3*k], frame[3*k+1], frame[3*k+2]};
+    simulation.compute_triangle_normals();
+    simulation.compute_vertex_normals();
 }
 
+// Send to the GPU the particles added and the triangles modified by the tearing of the cloth
+void scene_model::update_cloth_topology()
+{
+    if(cloth_topology_version==simulation.tearing.version)
+        return;
+
+    const size_t N = simulation.position.size();
+    cloth.update_texture_uv(simulation.texture_uv, cloth_vertices_gpu);
+    buffer<vec4> color(N);
+    color.fill({1,1,1,1});
+    cloth.update_color(color, cloth_vertices_gpu);
+    if(simulation.tearing.first_modified_triangle<simulation.connectivity.size())
+        cloth.update_connectivity(simulation.connectivity, simulation.tearing.first_modified_triangle);
+
+    simulation.tearing.first_modified_triangle = size_t(-1);
+    cloth_topology_version = simulation.tearing.version;
+    cloth_vertices_gpu = N;
+}
 
 void scene_model::display_elements(std::map<std::string,GLuint>& shaders, scene_structure& scene, gui_structure& )
 {
@@ -321,16 +197,20 @@ void scene_model::display_elements(std::map<std::string,GLuint>& shaders, scene_
 
     // Display positional constraint using spheres
     sphere.uniform.transform.scaling = 0.02f;
-    for(const auto& constraints : positional_constraints)  {
+    for(const auto& constraints : simulation.positional_constraints)  {
         sphere.uniform.transform.translation = constraints.second;
         draw(sphere, scene.camera, shaders["mesh"]);
     }
 
 
-    // Display sphere used for collision
-    sphere.uniform.transform.scaling     = collision_shapes.sphere_r;
-    sphere.uniform.transform.translation = collision_shapes.sphere_p;
-    draw(sphere, scene.camera, shaders["mesh"]);
+    // Display shape used for collision
+    if(simulation.collision_shapes.collider==MESH_COLLIDER)
+        draw(obstacle, scene.camera);
+    else {
+        sphere.uniform.transform.scaling     = simulation.collision_shapes.sphere_r;
+        sphere.uniform.transform.translation = simulation.collision_shapes.sphere_p;
+        draw(sphere, scene.camera, shaders["mesh"]);
+    }
 
     // Display ground
     draw(ground, scene.camera);
@@ -338,67 +218,115 @@ void scene_model::display_elements(std::map<std::string,GLuint>& shaders, scene_
 }
 
 
-// Automatic detection of divergence: stop the simulation if detected
-void scene_model::detect_simulation_divergence()
-{
-    const size_t NN = position.size();
-    for(size_t k=0; simulation_diverged==false && k<NN; ++k)
-    {
-        const float f = norm(force[k]);
-        const vec3& p = position[k];
-
-        if( std::isnan(f) ) // detect NaN in force
-        {
-            std::cout<<"NaN detected in forces"<<std::endl;
-            simulation_diverged = true;
-        }
-
-        if( f>1000.0f ) // detect strong force magnitude
-        {
-            std::cout<<" **** Warning : Strong force magnitude detected "<<f<<" at vertex "<<k<<" ****"<<std::endl;
-            simulation_diverged = true;
-        }
-
-        if( std::isnan(p.x) || std::isnan(p.y) || std::isnan(p.z) ) // detect NaN in position
-        {
-            std::cout<<"NaN detected in positions"<<std::endl;
-            simulation_diverged = true;
-        }
-
-        if(simulation_diverged==true)
-        {
-            std::cerr<<" **** Simulation has diverged **** "<<std::endl;
-            std::cerr<<" > Stop simulation iterations"<<std::endl;
-            timer.stop();
-        }
-    }
-
-}
-
-
 void scene_model::set_gui()
 {
+    user_parameters_structure& user_parameters = simulation.user_parameters;
+
     ImGui::SliderFloat("Time scale", &timer.scale, 0.05f, 2.0f, "%.2f s");
-    ImGui::SliderFloat("Stiffness", &user_parameters.K, 1.0f, 400.0f, "%.2f s");
+    int integrator = user_parameters.integrator;
+    ImGui::RadioButton("Explicit", &integrator, EXPLICIT_EULER); ImGui::SameLine();
+    ImGui::RadioButton("Implicit", &integrator, IMPLICIT_EULER); ImGui::SameLine();
+    ImGui::RadioButton("XPBD", &integrator, XPBD); ImGui::SameLine();
+    ImGui::RadioButton("Projective dynamics", &integrator, PROJECTIVE_DYNAMICS);
+    user_parameters.integrator = integrator_type(integrator);
+
+    // The explicit integrator diverges at high stiffness with fixed substeps, XPBD and projective dynamics remain stable at any stiffness
+    const bool explicit_fixed_steps = user_parameters.integrator==EXPLICIT_EULER && !user_parameters.adaptive_time_step;
+    const bool unconditionally_stable = user_parameters.integrator==XPBD || user_parameters.integrator==PROJECTIVE_DYNAMICS;
+    const float K_max = unconditionally_stable? 1000000.0f : (explicit_fixed_steps? 400.0f : 20000.0f);
+    user_parameters.K = std::min(user_parameters.K, K_max);
+    ImGui::SliderFloat("Stiffness", &user_parameters.K, 1.0f, K_max, "%.2f s", unconditionally_stable? 4.0f : 1.0f);
     ImGui::SliderFloat("Damping", &user_parameters.mu, 0.0f, 0.1f, "%.3f s");
     ImGui::SliderFloat("Mass", &user_parameters.m, 1.0f, 15.0f, "%.2f s");
     ImGui::SliderFloat("Wind", &user_parameters.wind, 0.0f, 400.0f, "%.2f s");
 
+    if(user_parameters.integrator==IMPLICIT_EULER) {
+        ImGui::Checkbox("Multigrid",&user_parameters.multigrid); ImGui::SameLine();
+        ImGui::Text("CG iterations: %d (error %.1e)", simulation.implicit_solver.iterations, double(simulation.implicit_solver.error));
+    }
+    if(user_parameters.integrator==XPBD)
+        ImGui::SliderInt("Iterations", &user_parameters.xpbd_iterations, 1, 100);
+    if(user_parameters.integrator==PROJECTIVE_DYNAMICS) {
+        ImGui::SliderInt("Iterations", &user_parameters.pd_iterations, 1, 50);
+        ImGui::Checkbox("Chebyshev",&user_parameters.chebyshev);
+        if(user_parameters.chebyshev) {
+            ImGui::SameLine();
+            ImGui::SliderFloat("Spectral radius", &user_parameters.chebyshev_rho, 0.5f, 0.999f, "%.3f");
+        }
+        ImGui::Text("Factorizations: %d", simulation.projective_dynamics.factorizations);
+    }
+
+    int collider = simulation.collision_shapes.collider;
+    ImGui::RadioButton("Sphere", &collider, SPHERE_COLLIDER); ImGui::SameLine();
+    ImGui::RadioButton("Mesh obstacle", &collider, MESH_COLLIDER);
+    simulation.collision_shapes.collider = collider_type(collider);
+
+    ImGui::Checkbox("Adaptive time step",&user_parameters.adaptive_time_step);
+    if(user_parameters.adaptive_time_step)
+        ImGui::SliderFloat("Frame budget", &user_parameters.frame_budget, 1.0f, 50.0f, "%.1f ms");
+    ImGui::Text("Substeps: %d/%d (h = %.2e s), %.2f ms per frame", simulation.time_stepping.substeps, simulation.time_stepping.substeps_required, double(simulation.time_stepping.h), double(simulation.time_stepping.compute_time));
+
+    ImGui::Checkbox("Self collision",&user_parameters.self_collision);
+    ImGui::Checkbox("Sleeping",&user_parameters.sleeping);
+    if(simulation.sleeping_active()) {
+        ImGui::SameLine();
+        ImGui::Text("(%d/%d regions asleep)", simulation.sleeping.bands_asleep, int(simulation.sleeping.asleep.size()));
+    }
+    ImGui::Checkbox("Tearing",&user_parameters.tearing);
+    if(user_parameters.tearing) {
+        ImGui::SliderFloat("Tearing ratio", &user_parameters.tearing_ratio, 1.05f, 3.0f, "%.2f");
+        ImGui::Text("%d springs broken, %d particles added", int(simulation.tearing.springs_broken), int(simulation.position.size()-simulation.Nu*simulation.Nv));
+    }
     ImGui::Checkbox("Wireframe",&gui_display_wireframe);
     ImGui::Checkbox("Texture",&gui_display_texture);
+    ImGui::Checkbox("Multithreading",&simulation.multithreading); ImGui::SameLine();
+    ImGui::Text("(%d threads)", int(simulation.pool.size()));
+    ImGui::Checkbox("SIMD",&simulation.simd); ImGui::SameLine();
+    ImGui::Text("(%s)", simd_instruction_set_name(simd_support()).c_str()); ImGui::SameLine();
+    if(ImGui::Button("Check SIMD")) simulation.check_simd_kernels();
+    if(simulation.simd_check_error>=0)
+        ImGui::Text("SIMD/scalar max relative difference: %.2e", double(simulation.simd_check_error));
 
     bool const stop  = ImGui::Button("Stop anim"); ImGui::SameLine();
     bool const start = ImGui::Button("Start anim");
 
     if(stop)  timer.stop();
     if(start) {
-        if( simulation_diverged )
-            force_simulation=true;
+        if( simulation.simulation_diverged )
+            simulation.force_simulation=true;
         timer.start();
     }
 
+    ImGui::SliderInt("Resolution", &gui_resolution, 10, 512); ImGui::SameLine(); // Applied on restart
     bool const restart = ImGui::Button("Restart");
     if(restart) initialize();
+
+    // Frames streamed to the cache file, replayed without simulation
+    bool record = cache_record.is_open();
+    if(ImGui::Checkbox("Record", &record)) {
+        if(record && cache_playback.size()==0) {
+            cache_time = 0.0f;
+            cache_record.open(cache_filename, 32, 4, FRAME_CACHE_DROP); // The display is not slowed down by a late writer
+        }
+        else
+            cache_record.close();
+    }
+    if(cache_record.is_open()) {
+        ImGui::SameLine();
+        ImGui::Text("(%d frames, %d dropped, %.1f MB)", int(cache_record.frames()), int(cache_record.frames_dropped()), double(cache_record.bytes_written())/1e6);
+    }
+    bool playback = cache_playback.size()>0;
+    if(ImGui::Checkbox("Playback", &playback)) {
+        if(playback) start_playback();
+        else stop_playback();
+    }
+    if(cache_playback.size()>0)
+        ImGui::SliderFloat("Cache time", &playback_timer.t, playback_timer.t_min, playback_timer.t_max, "%.2f s");
+
+    ImGui::Checkbox("Fixed time step", &gui_fixed_time_step);
+    if(ImGui::Button("Save state")) simulation.save_state(state_filename);
+    ImGui::SameLine();
+    if(ImGui::Button("Load state")) load_state();
 }
 
 
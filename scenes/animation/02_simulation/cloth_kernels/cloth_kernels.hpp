@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+
+// Vectorized kernels of the cloth spring forces, working on structure of arrays (x,y,z stored in separate arrays).
+//  The scalar code of the cloth scene remains the reference: the kernels reproduce its sequence of floating point
+//  operations so that both paths give the same values.
+//  Each kernel only processes full vector registers and returns the number of elements processed: the remaining
+//  elements are left to the scalar code.
+//
+// Kernels are provided for SSE2 (4 floats) and AVX2 (8 floats). The caller is responsible to select a version supported by the CPU (vcl::simd_support()).
+
+// Force applied by the springs [0,N[ on their first extremity: f = K (L-L0) (pj-pi)/L
+//  i, j: index of the extremities of the springs, L0: rest lengths. Positions are read in (px,py,pz), forces written in (fx,fy,fz).
+size_t spring_forces_sse(const float* px, const float* py, const float* pz, const int* i, const int* j, const float* L0, float K, float* fx, float* fy, float* fz, size_t N);
+size_t spring_forces_avx(const float* px, const float* py, const float* pz, const int* i, const int* j, const float* L0, float K, float* fx, float* fy, float* fz, size_t N);
+
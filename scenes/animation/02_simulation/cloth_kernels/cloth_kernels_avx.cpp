@@ -0,0 +1,39 @@
+#include "cloth_kernels.hpp"
+
+// This file is compiled with AVX2 enabled (see CMakeLists.txt and Makefile): its functions must only be called after checking the CPU support.
+// It must not use non-inlined code shared with other translation units (such as the STL) that could be compiled with AVX2 instructions.
+#if defined(__AVX2__) || (defined(_MSC_VER) && defined(_M_X64))
+
+#include <immintrin.h>
+#include "cloth_kernels_impl.hpp"
+
+namespace
+{
+struct pack_avx
+{
+    typedef __m256 type;
+    static const size_t size = 8;
+
+    static type load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, type a) { _mm256_storeu_ps(p, a); }
+    static type set1(float a) { return _mm256_set1_ps(a); }
+    static type add(type a, type b) { return _mm256_add_ps(a, b); }
+    static type sub(type a, type b) { return _mm256_sub_ps(a, b); }
+    static type mul(type a, type b) { return _mm256_mul_ps(a, b); }
+    static type div(type a, type b) { return _mm256_div_ps(a, b); }
+    static type sqrt(type a) { return _mm256_sqrt_ps(a); }
+    static type gather(const float* p, const int* index) { return _mm256_i32gather_ps(p, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(index)), 4); }
+};
+}
+
+size_t spring_forces_avx(const float* px, const float* py, const float* pz, const int* i, const int* j, const float* L0, float K, float* fx, float* fy, float* fz, size_t N)
+{
+    return cloth_kernels::spring_forces<pack_avx>(px, py, pz, i, j, L0, K, fx, fy, fz, N);
+}
+
+#else
+
+// AVX2 is not available for this compiler/architecture: everything is left to the scalar code
+size_t spring_forces_avx(const float*, const float*, const float*, const int*, const int*, const float*, float, float*, float*, float*, size_t) { return 0; }
+
+#endif
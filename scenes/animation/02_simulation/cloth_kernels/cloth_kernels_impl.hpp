@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+
+// Generic implementation of the cloth kernels, instantiated for each instruction set with a "pack" type P providing:
+//  P::type, P::size, load, store, set1, add, sub, mul, div, sqrt, gather
+// Only included by the translation units of the kernels.
+
+namespace cloth_kernels
+{
+
+template <typename P>
+size_t spring_forces(const float* px, const float* py, const float* pz, const int* i, const int* j, const float* L0, float K, float* fx, float* fy, float* fz, size_t N)
+{
+    typedef typename P::type T;
+    const T vK = P::set1(K);
+
+    size_t s = 0;
+    for(; s+P::size<=N; s+=P::size)
+    {
+        const T dx = P::sub(P::gather(px, j+s), P::gather(px, i+s));
+        const T dy = P::sub(P::gather(py, j+s), P::gather(py, i+s));
+        const T dz = P::sub(P::gather(pz, j+s), P::gather(pz, i+s));
+
+        const T L = P::sqrt( P::add(P::add(P::mul(dx,dx), P::mul(dy,dy)), P::mul(dz,dz)) );
+        const T a = P::mul(vK, P::sub(L, P::load(L0+s)));
+
+        P::store(fx+s, P::div(P::mul(a,dx), L));
+        P::store(fy+s, P::div(P::mul(a,dy), L));
+        P::store(fz+s, P::div(P::mul(a,dz), L));
+    }
+    return s;
+}
+
+}
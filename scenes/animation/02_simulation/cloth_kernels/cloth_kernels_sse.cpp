@@ -0,0 +1,37 @@
+#include "cloth_kernels.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+
+#include <emmintrin.h>
+#include "cloth_kernels_impl.hpp"
+
+namespace
+{
+struct pack_sse
+{
+    typedef __m128 type;
+    static const size_t size = 4;
+
+    static type load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, type a) { _mm_storeu_ps(p, a); }
+    static type set1(float a) { return _mm_set1_ps(a); }
+    static type add(type a, type b) { return _mm_add_ps(a, b); }
+    static type sub(type a, type b) { return _mm_sub_ps(a, b); }
+    static type mul(type a, type b) { return _mm_mul_ps(a, b); }
+    static type div(type a, type b) { return _mm_div_ps(a, b); }
+    static type sqrt(type a) { return _mm_sqrt_ps(a); }
+    static type gather(const float* p, const int* index) { return _mm_set_ps(p[index[3]], p[index[2]], p[index[1]], p[index[0]]); }
+};
+}
+
+size_t spring_forces_sse(const float* px, const float* py, const float* pz, const int* i, const int* j, const float* L0, float K, float* fx, float* fy, float* fz, size_t N)
+{
+    return cloth_kernels::spring_forces<pack_sse>(px, py, pz, i, j, L0, K, fx, fy, fz, N);
+}
+
+#else
+
+// No SSE2 on this architecture: everything is left to the scalar code
+size_t spring_forces_sse(const float*, const float*, const float*, const int*, const int*, const float*, float, float*, float*, float*, size_t) { return 0; }
+
+#endif
@@ -0,0 +1,310 @@
+#include "cloth_multigrid.hpp"
+
+#include "vcl/base/error/error.hpp"
+
+#include <algorithm>
+
+
+void cloth_multigrid::block_matrix::multiply(const Eigen::VectorXf& x, Eigen::VectorXf& y) const
+{
+    const int N = int(rows());
+    y.resize(3*N);
+    for(int i=0; i<N; ++i) {
+        Eigen::Vector3f yi = Eigen::Vector3f::Zero();
+        for(int e=row_offset[i]; e<row_offset[i+1]; ++e)
+            yi += block[e]*x.segment<3>(3*column[e]);
+        y.segment<3>(3*i) = yi;
+    }
+}
+
+void cloth_multigrid::block_matrix::residual(const Eigen::VectorXf& b, const Eigen::VectorXf& x, Eigen::VectorXf& r) const
+{
+    const int N = int(rows());
+    r.resize(3*N);
+    for(int i=0; i<N; ++i) {
+        Eigen::Vector3f ri = b.segment<3>(3*i);
+        for(int e=row_offset[i]; e<row_offset[i+1]; ++e)
+            ri -= block[e]*x.segment<3>(3*column[e]);
+        r.segment<3>(3*i) = ri;
+    }
+}
+
+
+cloth_multigrid::cloth_multigrid()
+    :smoothing_steps(2), smoothing_weight(0.6f)
+{}
+
+// Interpolation weights of the fine index f from the coarse indices: f=2c is a coarse node, f=2c+1 lies between c and c+1
+static int coarse_neighbors(int f, int index[2], float weight[2])
+{
+    if(f%2==0) {
+        index[0] = f/2; weight[0] = 1.0f;
+        return 1;
+    }
+    index[0] = f/2;   weight[0] = 0.5f;
+    index[1] = f/2+1; weight[1] = 0.5f;
+    return 2;
+}
+
+// Index of the block (i,j) in the block matrix
+static int block_index(const cloth_multigrid::block_matrix& A, int i, int j)
+{
+    const auto begin = A.column.begin()+A.row_offset[i];
+    const auto end   = A.column.begin()+A.row_offset[i+1];
+    const auto it = std::lower_bound(begin, end, j);
+    assert_vcl(it!=end && *it==j, "Block is not in the sparsity pattern");
+    return int(it-A.column.begin());
+}
+
+void cloth_multigrid::initialize(int Nu, int Nv, const Eigen::SparseMatrix<float>& A, int coarsest_size)
+{
+    assert_vcl(Nu>0 && Nv>0 && coarsest_size>=2, "Invalid grid size");
+    assert_vcl(A.rows()==3*Nu*Nv && A.cols()==3*Nu*Nv && A.isCompressed(), "Invalid matrix size");
+
+    levels.clear();
+    level_structure fine;
+    fine.Nu = Nu;
+    fine.Nv = Nv;
+    levels.push_back(fine);
+
+    // Block pattern of the finest level: each block (i,j) of A is found from the first row of each of its 3 columns
+    //  The row blocks of a column block are visited in increasing order for the 3 columns: the k-th entry is the same block
+    const int N = Nu*Nv;
+    block_matrix& A0 = levels[0].A;
+    A0.row_offset.assign(N+1, 0);
+    for(int j=0; j<N; ++j)
+        for(int k=A.outerIndexPtr()[3*j]; k<A.outerIndexPtr()[3*j+1]; ++k)
+            if(A.innerIndexPtr()[k]%3==0)
+                A0.row_offset[A.innerIndexPtr()[k]/3+1]++;
+    for(int i=0; i<N; ++i)
+        A0.row_offset[i+1] += A0.row_offset[i];
+    A0.column.resize(A0.row_offset[N]);
+    A0.block.resize(A0.row_offset[N]);
+    fine_value_offset.resize(3*A0.row_offset[N]);
+
+    std::vector<int> cursor(A0.row_offset.begin(), A0.row_offset.end()-1);
+    std::vector<int> blocks_of_column;
+    for(int j=0; j<N; ++j) {
+        blocks_of_column.clear();
+        for(int k=A.outerIndexPtr()[3*j]; k<A.outerIndexPtr()[3*j+1]; ++k) {
+            const int row = A.innerIndexPtr()[k];
+            if(row%3!=0)
+                continue;
+            const int e = cursor[row/3]++;
+            A0.column[e] = j;
+            blocks_of_column.push_back(e);
+        }
+        for(int c=0; c<3; ++c) {
+            size_t n = 0;
+            for(int k=A.outerIndexPtr()[3*j+c]; k<A.outerIndexPtr()[3*j+c+1]; ++k)
+                if(A.innerIndexPtr()[k]%3==0)
+                    fine_value_offset[3*blocks_of_column[n++]+c] = k;
+            assert_vcl(n==blocks_of_column.size(), "The matrix must be made of full 3x3 blocks");
+        }
+    }
+
+    // Coarser levels
+    while(levels.back().Nu>coarsest_size || levels.back().Nv>coarsest_size)
+    {
+        level_structure c;
+        {
+            level_structure& f = levels.back();
+            c.Nu = f.Nu>coarsest_size? f.Nu/2+1 : f.Nu; // The last coarse node may lie beyond the fine grid when Nu is even
+            c.Nv = f.Nv>coarsest_size? f.Nv/2+1 : f.Nv;
+
+            // Bilinear prolongation (a direction which is not coarsened is copied)
+            f.parent_offset.assign(1, 0);
+            f.parent.clear();
+            f.parent_weight.clear();
+            for(int fu=0; fu<f.Nu; ++fu) {
+                int iu[2], iv[2];
+                float wu[2], wv[2];
+                int nu = 1, nv = 1;
+                if(c.Nu<f.Nu) nu = coarse_neighbors(fu, iu, wu); else { iu[0] = fu; wu[0] = 1.0f; }
+                for(int fv=0; fv<f.Nv; ++fv) {
+                    if(c.Nv<f.Nv) nv = coarse_neighbors(fv, iv, wv); else { iv[0] = fv; wv[0] = 1.0f; }
+                    for(int a=0; a<nu; ++a) {
+                        for(int b=0; b<nv; ++b) {
+                            f.parent.push_back(iu[a]*c.Nv+iv[b]);
+                            f.parent_weight.push_back(wu[a]*wv[b]);
+                        }
+                    }
+                    f.parent_offset.push_back(int(f.parent.size()));
+                }
+            }
+
+            // Sparsity pattern of the Galerkin product: block (I,J) exists if I is a parent of i, J a parent of j, and (i,j) is a block of A
+            const int Nc = c.Nu*c.Nv;
+            std::vector<std::vector<int> > rows(Nc);
+            const int Nf = f.Nu*f.Nv;
+            for(int i=0; i<Nf; ++i)
+                for(int a=f.parent_offset[i]; a<f.parent_offset[i+1]; ++a)
+                    for(int e=f.A.row_offset[i]; e<f.A.row_offset[i+1]; ++e)
+                        for(int b=f.parent_offset[f.A.column[e]]; b<f.parent_offset[f.A.column[e]+1]; ++b)
+                            rows[f.parent[a]].push_back(f.parent[b]);
+
+            c.A.row_offset.assign(1, 0);
+            for(std::vector<int>& row : rows) {
+                std::sort(row.begin(), row.end());
+                row.erase(std::unique(row.begin(), row.end()), row.end());
+                c.A.column.insert(c.A.column.end(), row.begin(), row.end());
+                c.A.row_offset.push_back(int(c.A.column.size()));
+            }
+            c.A.block.resize(c.A.column.size());
+
+            // Target block of each term of the product, in the order of the loops of update
+            f.galerkin_target.clear();
+            for(int i=0; i<Nf; ++i)
+                for(int a=f.parent_offset[i]; a<f.parent_offset[i+1]; ++a)
+                    for(int e=f.A.row_offset[i]; e<f.A.row_offset[i+1]; ++e)
+                        for(int b=f.parent_offset[f.A.column[e]]; b<f.parent_offset[f.A.column[e]+1]; ++b)
+                            f.galerkin_target.push_back(block_index(c.A, f.parent[a], f.parent[b]));
+        }
+        levels.push_back(c);
+    }
+
+    for(level_structure& level : levels) {
+        const int N_level = level.Nu*level.Nv;
+        level.x.setZero(3*N_level);
+        level.b.setZero(3*N_level);
+        level.r.setZero(3*N_level);
+        level.inverse_diagonal.resize(N_level);
+    }
+}
+
+void cloth_multigrid::update(const Eigen::SparseMatrix<float>& A)
+{
+    assert_vcl(!levels.empty() && A.nonZeros()==Eigen::Index(3*fine_value_offset.size()), "Multigrid not initialized for this matrix");
+
+    // Finest level: copy of the values of A
+    block_matrix& A0 = levels[0].A;
+    const float* value = A.valuePtr();
+    for(size_t e=0; e<A0.block.size(); ++e)
+        for(int c=0; c<3; ++c)
+            for(int r=0; r<3; ++r)
+                A0.block[e](r,c) = value[fine_value_offset[3*e+c]+r];
+
+    for(size_t l=0; l<levels.size(); ++l)
+    {
+        level_structure& level = levels[l];
+
+        // Galerkin product with the finer level
+        if(l>0) {
+            const level_structure& f = levels[l-1];
+            std::fill(level.A.block.begin(), level.A.block.end(), Eigen::Matrix3f::Zero());
+            const int Nf = f.Nu*f.Nv;
+            size_t t = 0;
+            for(int i=0; i<Nf; ++i)
+                for(int a=f.parent_offset[i]; a<f.parent_offset[i+1]; ++a)
+                    for(int e=f.A.row_offset[i]; e<f.A.row_offset[i+1]; ++e) {
+                        const int j = f.A.column[e];
+                        for(int b=f.parent_offset[j]; b<f.parent_offset[j+1]; ++b)
+                            level.A.block[f.galerkin_target[t++]] += (f.parent_weight[a]*f.parent_weight[b]) * f.A.block[e];
+                    }
+        }
+
+        const int N = level.Nu*level.Nv;
+        for(int i=0; i<N; ++i)
+            level.inverse_diagonal[i] = level.A.block[block_index(level.A, i, i)].inverse();
+    }
+
+    // Direct solver on the coarsest level
+    const block_matrix& Ac = levels.back().A;
+    std::vector<Eigen::Triplet<float> > triplets;
+    for(int i=0; i<int(Ac.rows()); ++i)
+        for(int e=Ac.row_offset[i]; e<Ac.row_offset[i+1]; ++e)
+            for(int c=0; c<3; ++c)
+                for(int r=0; r<3; ++r)
+                    triplets.push_back(Eigen::Triplet<float>(3*i+r, 3*Ac.column[e]+c, Ac.block[e](r,c)));
+    Eigen::SparseMatrix<float> A_coarse(3*Ac.rows(), 3*Ac.rows());
+    A_coarse.setFromTriplets(triplets.begin(), triplets.end());
+    coarse_solver.compute(A_coarse);
+}
+
+// Damped block Jacobi iteration on level.x
+void cloth_multigrid::smooth(size_t l)
+{
+    level_structure& level = levels[l];
+    level.A.residual(level.b, level.x, level.r);
+    const int N = level.Nu*level.Nv;
+    for(int k=0; k<N; ++k)
+        level.x.segment<3>(3*k) += smoothing_weight * (level.inverse_diagonal[k]*level.r.segment<3>(3*k));
+}
+
+// Approximate solution of A x = b on the level (x starts from 0), the operation is symmetric (same pre and post smoothing)
+void cloth_multigrid::v_cycle(size_t l)
+{
+    level_structure& level = levels[l];
+    if(l+1==levels.size()) {
+        level.x = coarse_solver.solve(level.b);
+        return;
+    }
+
+    level.x.setZero();
+    for(int k=0; k<smoothing_steps; ++k)
+        smooth(l);
+
+    // Restriction of the residual
+    level_structure& coarse = levels[l+1];
+    level.A.residual(level.b, level.x, level.r);
+    coarse.b.setZero();
+    const int N = level.Nu*level.Nv;
+    for(int i=0; i<N; ++i)
+        for(int a=level.parent_offset[i]; a<level.parent_offset[i+1]; ++a)
+            coarse.b.segment<3>(3*level.parent[a]) += level.parent_weight[a]*level.r.segment<3>(3*i);
+
+    v_cycle(l+1);
+
+    // Prolongation of the coarse correction
+    for(int i=0; i<N; ++i)
+        for(int a=level.parent_offset[i]; a<level.parent_offset[i+1]; ++a)
+            level.x.segment<3>(3*i) += level.parent_weight[a]*coarse.x.segment<3>(3*level.parent[a]);
+
+    for(int k=0; k<smoothing_steps; ++k)
+        smooth(l);
+}
+
+int cloth_multigrid::solve(const Eigen::VectorXf& b, Eigen::VectorXf& x, int max_iterations, float tolerance, float& error)
+{
+    const block_matrix& A = levels[0].A;
+
+    const float norm_b = b.norm();
+    if(norm_b==0.0f) {
+        x.setZero();
+        error = 0.0f;
+        return 0;
+    }
+
+    A.residual(b, x, r);
+    error = r.norm()/norm_b;
+    if(error<tolerance)
+        return 0;
+
+    levels[0].b = r;
+    v_cycle(0);
+    z = levels[0].x;
+    p = z;
+    float rz = r.dot(z);
+
+    int iteration = 0;
+    while(iteration<max_iterations)
+    {
+        A.multiply(p, Ap);
+        const float alpha = rz/p.dot(Ap);
+        x += alpha*p;
+        r -= alpha*Ap;
+        ++iteration;
+
+        error = r.norm()/norm_b;
+        if(error<tolerance)
+            break;
+
+        levels[0].b = r;
+        v_cycle(0);
+        z = levels[0].x;
+        const float rz_new = r.dot(z);
+        p = z + (rz_new/rz)*p;
+        rz = rz_new;
+    }
+    return iteration;
+}
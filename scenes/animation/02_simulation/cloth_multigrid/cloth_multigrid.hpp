@@ -0,0 +1,68 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <vector>
+
+// Geometric multigrid solver of the implicit cloth system A x = b.
+//  The unknowns are 3D vectors attached to the nodes of a regular Nu x Nv grid (node (ku,kv) has index ku*Nv+kv,
+//  its 3 coordinates are consecutive in x). Each coarser level keeps one node out of two in each direction:
+//  - prolongation P: bilinear interpolation of the coarse nodes, restriction: P^t
+//  - coarse operators: Galerkin product P^t A P, recomputed when the values of A change (update)
+//  - smoother: damped 3x3 block Jacobi, direct solve on the coarsest level
+// A V-cycle is used as preconditioner of a conjugate gradient: the number of iterations remains almost constant
+// when the resolution of the cloth increases, unlike a conjugate gradient with a Jacobi preconditioner.
+//
+// The operators of the levels are stored as sparse matrices of 3x3 blocks (one block per pair of coupled nodes).
+struct cloth_multigrid
+{
+    // Sparse matrix of 3x3 blocks, compressed by rows: the blocks of row i are stored in [row_offset[i], row_offset[i+1][
+    struct block_matrix
+    {
+        std::vector<int> row_offset;
+        std::vector<int> column;
+        std::vector<Eigen::Matrix3f> block;
+
+        size_t rows() const { return row_offset.empty()? 0 : row_offset.size()-1; }
+        void multiply(const Eigen::VectorXf& x, Eigen::VectorXf& y) const;   // y = A x
+        void residual(const Eigen::VectorXf& b, const Eigen::VectorXf& x, Eigen::VectorXf& r) const; // r = b - A x
+    };
+
+    struct level_structure
+    {
+        int Nu, Nv;                                    // Size of the grid of the level
+        block_matrix A;                                // Operator of the level
+
+        // Bilinear interpolation weights from the next coarser level: node k is interpolated from the coarse nodes
+        //  parent[parent_offset[k] .. parent_offset[k+1][ with weights parent_weight
+        std::vector<int> parent_offset;
+        std::vector<int> parent;
+        std::vector<float> parent_weight;
+        std::vector<int> galerkin_target;              // Index of the coarse block receiving each term of the Galerkin product
+
+        std::vector<Eigen::Matrix3f> inverse_diagonal; // Inverse of the 3x3 diagonal blocks of A (smoother)
+        Eigen::VectorXf x, b, r;                       // Solution, right hand side and residual of the level
+    };
+
+    std::vector<level_structure> levels;
+    std::vector<int> fine_value_offset;  // Offset in the values of the Eigen matrix of each column of the blocks of the finest level
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<float> > coarse_solver;
+
+    int smoothing_steps;    // Number of smoothing iterations before and after the coarse correction
+    float smoothing_weight; // Damping of the Jacobi smoother
+
+    Eigen::VectorXf r, z, p, Ap; // Vectors of the conjugate gradient
+
+    cloth_multigrid();
+
+    // Build the hierarchy of grids down to a grid of at most coarsest_size x coarsest_size nodes
+    //  A gives the sparsity pattern of the system (made of full 3x3 blocks, with the 3 rows of each block stored contiguously)
+    void initialize(int Nu, int Nv, const Eigen::SparseMatrix<float>& A, int coarsest_size=9);
+    // Compute the coarse operators and the smoothers for the current values of A (same sparsity pattern as in initialize)
+    void update(const Eigen::SparseMatrix<float>& A);
+    // Preconditioned conjugate gradient, x is used as initial guess. Return the number of iterations, error is the final relative residual
+    int solve(const Eigen::VectorXf& b, Eigen::VectorXf& x, int max_iterations, float tolerance, float& error);
+
+    void smooth(size_t level);
+    void v_cycle(size_t level);
+};
@@ -0,0 +1,1940 @@
+#include "cloth_simulation.hpp"
+#include "cloth_kernels/cloth_kernels.hpp"
+#include "vcl/shape/mesh/mesh_primitive/mesh_primitive.hpp"
+#include "vcl/simulation/mass_spring_system/mass_spring_system.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <iostream>
+
+using namespace vcl;
+
+
+// Default values of the parameters and of the collision shapes
+void cloth_simulation::set_default_parameters()
+{
+    multithreading = pool.size()>1;
+    simd = simd_support()!=simd_instruction_set::none;
+    simd_check_error = -1.0f;
+
+    user_parameters.K    = 100.0f;
+    user_parameters.m    = 5.0f;
+    user_parameters.wind = 0.0f;
+    user_parameters.mu   = 0.02f;
+    user_parameters.integrator = EXPLICIT_EULER;
+    user_parameters.xpbd_iterations = 20;
+    user_parameters.self_collision = false;
+    user_parameters.adaptive_time_step = false;
+    user_parameters.frame_budget = 12.0f;
+    user_parameters.multigrid = false;
+    user_parameters.pd_iterations = 10;
+    user_parameters.chebyshev = true;
+    user_parameters.chebyshev_rho = 0.9f;
+    user_parameters.sleeping = false;
+    user_parameters.tearing = false;
+    user_parameters.tearing_ratio = 1.5f;
+    current_magnitude = 0.0f;
+
+    sleeping.rows = 4;
+    sleeping.speed_threshold = 0.02f;
+    sleeping.acceleration_threshold = 0.5f;
+    sleeping.time_window = 0.5f;
+    sleeping.bands_asleep = 0;
+
+    // Set collision shapes
+    collision_shapes.sphere_p = {0,0.1f,0};
+    collision_shapes.sphere_r = 0.1f;
+    collision_shapes.ground_height = 0.1f;
+
+    // Mesh obstacle: its distance field is computed once, any closed mesh can be used (for instance loaded with mesh_load_file_obj)
+    collision_shapes.obstacle = sdf_grid_from_mesh(obstacle_mesh(), 64, 0.05f);
+    collision_shapes.collider = SPHERE_COLLIDER;
+}
+
+// Mesh used as obstacle in MESH_COLLIDER mode
+mesh cloth_simulation::obstacle_mesh()
+{
+    return mesh_primitive_torus(0.2f, 0.06f, {0.45f,0.35f,0}, {0,1,0}, 40, 80);
+}
+
+// Initialize the particles, springs and solvers for a cloth of N_cloth x N_cloth particles
+//  Return the mesh of the cloth in its initial position (used to create its visual model)
+mesh cloth_simulation::initialize(size_t N_cloth)
+{
+    assert_vcl(N_cloth>=3, "The cloth needs at least 3x3 particles");
+    sleeping.bands_asleep = 0; // The bands are rebuilt by initialize_sleeping
+    tearing = tearing_structure();
+
+    // Rest length (length of an edge)
+    simulation_parameters.L0 = 1.0f/float(N_cloth-1);
+
+    // Create cloth mesh in its initial position
+    // Horizontal grid of length 1 x 1
+    const mesh base_cloth = mesh_primitive_grid(N_cloth,N_cloth,{0,1,-0.5f},{1,0,0},{0,0,1});
+
+    // Set particle position from cloth geometry
+    position = base_cloth.position;
+    texture_uv = base_cloth.texture_uv;
+    Nu = N_cloth;
+    Nv = N_cloth;
+    grid_index.resize(position.size());
+    for(size_t k=0; k<position.size(); ++k)
+        grid_index[k] = int(k);
+
+    // Set hard positional constraints
+    positional_constraints.clear();
+    positional_constraints[0] = position[0];
+    positional_constraints[N_cloth*(N_cloth-1)] = position[N_cloth*(N_cloth-1)];
+
+    // Init particles data (speed, force)
+    speed.resize(position.size()); speed.fill({0,0,0});
+    force.resize(position.size()); force.fill({0,0,0});
+    particles_soa.x.resize(position.size());
+    particles_soa.y.resize(position.size());
+    particles_soa.z.resize(position.size());
+
+
+    // Store connectivity and normals
+    connectivity = base_cloth.connectivity;
+    initialize_normals();
+
+    simulation_diverged = false;
+    force_simulation    = false;
+    time_stepping = time_stepping_structure();
+    reset_timings();
+
+    initialize_springs();
+    initialize_implicit_solver();
+    initialize_xpbd_solver();
+    initialize_projective_dynamics();
+    initialize_self_collision();
+    initialize_sleeping();
+
+    return base_cloth;
+}
+
+// Version of the content of the cloth snapshots, to be incremented when the saved data change
+static const uint32_t cloth_snapshot_version = 1;
+
+// Save the state of the simulation (particles, topology, parameters and state of the solvers kept between the steps)
+//  The data rebuilt from the topology (adjacency, factorizations, spatial hash) are not saved
+bool cloth_simulation::save_state(const std::string& filename) const
+{
+    snapshot_writer snapshot("cloth", cloth_snapshot_version);
+
+    const uint64_t grid_size[2] = {Nu, Nv};
+    snapshot.write("grid_size", grid_size);
+    snapshot.write("user_parameters", user_parameters);
+    snapshot.write("simulation", simulation_parameters);
+    snapshot.write("wind", current_magnitude);
+    snapshot.write("sphere_p", collision_shapes.sphere_p);
+    snapshot.write("sphere_r", collision_shapes.sphere_r);
+    snapshot.write("ground_height", collision_shapes.ground_height);
+    snapshot.write("collider", collision_shapes.collider);
+
+    snapshot.write("position", position.data);
+    snapshot.write("speed", speed.data);
+    snapshot.write("texture_uv", texture_uv.data);
+    snapshot.write("grid_index", grid_index);
+    snapshot.write("connectivity", connectivity.data);
+
+    snapshot.write("spring_i", springs.i);
+    snapshot.write("spring_j", springs.j);
+    snapshot.write("spring_L0", springs.L0);
+    snapshot.write("spring_type", springs.type);
+
+    std::vector<int> constraint_index;
+    std::vector<vec3> constraint_position;
+    for(const auto& constraint : positional_constraints) {
+        constraint_index.push_back(constraint.first);
+        constraint_position.push_back(constraint.second);
+    }
+    snapshot.write("constraint_index", constraint_index);
+    snapshot.write("constraint_p", constraint_position);
+
+    // Initial guess of the next implicit solve, and sleeping bands: needed for the replay to match the original run
+    snapshot.write_bytes("implicit_dv", implicit_solver.dv.data(), size_t(implicit_solver.dv.size())*sizeof(float));
+    snapshot.write("sleep_asleep", sleeping.asleep);
+    snapshot.write("sleep_rest_time", sleeping.rest_time);
+    snapshot.write("springs_broken", uint64_t(tearing.springs_broken));
+
+    const bool saved = snapshot.save(filename);
+    if(!saved)
+        std::cerr<<"Cannot write the cloth state in "<<filename<<std::endl;
+    return saved;
+}
+
+// Restore a state saved by save_state, the simulation is unchanged if the file cannot be read or is inconsistent
+bool cloth_simulation::load_state(const std::string& filename)
+{
+    snapshot_reader snapshot;
+    if(!snapshot.open(filename, "cloth", cloth_snapshot_version)) {
+        std::cerr<<"Cannot load the cloth state: "<<snapshot.error<<std::endl;
+        return false;
+    }
+
+    uint64_t grid_size[2] = {0, 0};
+    user_parameters_structure loaded_user_parameters = user_parameters_structure();
+    simulation_parameters_structure loaded_simulation_parameters = simulation_parameters_structure();
+    float loaded_magnitude = 0;
+    vec3 loaded_sphere_p;
+    float loaded_sphere_r = 0, loaded_ground_height = 0;
+    collider_type loaded_collider = collision_shapes.collider;
+    buffer<vec3> loaded_position, loaded_speed;
+    buffer<vec2> loaded_uv;
+    std::vector<int> loaded_grid_index;
+    buffer<uint3> loaded_connectivity;
+    springs_structure loaded_springs;
+    std::vector<int> constraint_index;
+    std::vector<vec3> constraint_position;
+    std::vector<float> dv;
+    std::vector<char> asleep;
+    std::vector<float> rest_time;
+    uint64_t springs_broken = 0;
+    bool valid = snapshot.read("grid_size", grid_size) && snapshot.read("user_parameters", loaded_user_parameters)
+            && snapshot.read("simulation", loaded_simulation_parameters) && snapshot.read("wind", loaded_magnitude)
+            && snapshot.read("sphere_p", loaded_sphere_p) && snapshot.read("sphere_r", loaded_sphere_r)
+            && snapshot.read("ground_height", loaded_ground_height) && snapshot.read("collider", loaded_collider)
+            && snapshot.read("position", loaded_position.data) && snapshot.read("speed", loaded_speed.data) && snapshot.read("texture_uv", loaded_uv.data)
+            && snapshot.read("grid_index", loaded_grid_index) && snapshot.read("connectivity", loaded_connectivity.data)
+            && snapshot.read("spring_i", loaded_springs.i) && snapshot.read("spring_j", loaded_springs.j)
+            && snapshot.read("spring_L0", loaded_springs.L0) && snapshot.read("spring_type", loaded_springs.type)
+            && snapshot.read("constraint_index", constraint_index) && snapshot.read("constraint_p", constraint_position)
+            && snapshot.read("implicit_dv", dv) && snapshot.read("sleep_asleep", asleep) && snapshot.read("sleep_rest_time", rest_time)
+            && snapshot.read("springs_broken", springs_broken);
+    if(!valid) {
+        std::cerr<<"Cannot load the cloth state: "<<filename<<" is corrupted ("<<snapshot.error<<")"<<std::endl;
+        return false;
+    }
+
+    // Sizes of the arrays, and indices of the particles used by the topology and the constraints
+    const size_t N = loaded_position.size();
+    const size_t N_spring = loaded_springs.i.size();
+    const uint64_t N_grid = grid_size[0]*grid_size[1];
+    auto in_range = [N](int k) { return k>=0 && size_t(k)<N; };
+    bool consistent = N>=N_grid && (grid_size[0]==0 || N_grid/grid_size[0]==grid_size[1])
+            && loaded_speed.size()==N && loaded_uv.size()==N && loaded_grid_index.size()==N
+            && loaded_springs.j.size()==N_spring && loaded_springs.L0.size()==N_spring && loaded_springs.type.size()==N_spring
+            && constraint_index.size()==constraint_position.size() && (dv.empty() || dv.size()==3*N);
+    for(size_t k=0; consistent && k<N; ++k)
+        consistent = loaded_grid_index[k]>=0 && uint64_t(loaded_grid_index[k])<N_grid;
+    for(size_t s=0; consistent && s<N_spring; ++s)
+        consistent = in_range(loaded_springs.i[s]) && in_range(loaded_springs.j[s]);
+    for(size_t t=0; consistent && t<loaded_connectivity.size(); ++t)
+        consistent = loaded_connectivity[t][0]<N && loaded_connectivity[t][1]<N && loaded_connectivity[t][2]<N;
+    for(size_t k=0; consistent && k<constraint_index.size(); ++k)
+        consistent = in_range(constraint_index[k]);
+    if(!consistent) {
+        std::cerr<<"Cannot load the cloth state: "<<filename<<" is corrupted (inconsistent sizes or indices of particles)"<<std::endl;
+        return false;
+    }
+
+    // Everything is read and checked: the state is replaced
+    std::swap(user_parameters, loaded_user_parameters);
+    std::swap(simulation_parameters, loaded_simulation_parameters);
+    current_magnitude = loaded_magnitude;
+    collision_shapes.sphere_p = loaded_sphere_p;
+    collision_shapes.sphere_r = loaded_sphere_r;
+    collision_shapes.ground_height = loaded_ground_height;
+    collision_shapes.collider = loaded_collider;
+    std::swap(position, loaded_position);
+    std::swap(speed, loaded_speed);
+    std::swap(texture_uv, loaded_uv);
+    std::swap(grid_index, loaded_grid_index);
+    std::swap(connectivity, loaded_connectivity);
+    std::swap(springs.i, loaded_springs.i);
+    std::swap(springs.j, loaded_springs.j);
+    std::swap(springs.L0, loaded_springs.L0);
+    std::swap(springs.type, loaded_springs.type);
+
+    Nu = size_t(grid_size[0]);
+    Nv = size_t(grid_size[1]);
+    force.resize(N); force.fill({0,0,0});
+    positional_constraints.clear();
+    for(size_t k=0; k<constraint_index.size(); ++k)
+        positional_constraints[constraint_index[k]] = constraint_position[k];
+
+    // Rebuild the data depending on the topology, then restore the state of the solvers
+    tearing.springs_broken = size_t(springs_broken);
+    tearing.first_modified_triangle = size_t(-1);
+    sleeping.bands_asleep = 0;
+    update_topology();
+    compute_triangle_normals();
+    compute_vertex_normals();
+
+    if(!dv.empty())
+        implicit_solver.dv = Eigen::Map<Eigen::VectorXf>(dv.data(), Eigen::Index(dv.size()));
+    if(asleep.size()==sleeping.asleep.size() && rest_time.size()==sleeping.rest_time.size()) {
+        sleeping.asleep = asleep;
+        sleeping.rest_time = rest_time;
+        sleeping.bands_asleep = int(std::count(asleep.begin(), asleep.end(), 1));
+    }
+    sleeping.sphere_p = collision_shapes.sphere_p;
+    sleeping.sphere_r = collision_shapes.sphere_r;
+    sleeping.ground_height = collision_shapes.ground_height;
+    sleeping.collider = collision_shapes.collider;
+    sleeping.user_parameters = user_parameters;
+    sleeping.positional_constraints = positional_constraints;
+
+    simulation_diverged = false;
+    force_simulation = false;
+    time_stepping = time_stepping_structure();
+    reset_timings();
+    return true;
+}
+
+// Advance the simulation over the elapsed time dt of a frame (dt is already multiplied by time_scale)
+void cloth_simulation::simulate(float dt, float time_scale)
+{
+    const bool implicit = user_parameters.integrator!=EXPLICIT_EULER;
+    float h = 0.0f;
+    int number_of_substeps = 0;
+    if(dt>1e-6f)
+    {
+        if(user_parameters.adaptive_time_step)
+        {
+            // Cover the elapsed (scaled) time with the smallest number of stable substeps
+            //  The elapsed time is bounded to avoid a burst of substeps after a pause of the application
+            const float dt_frame = std::min(dt, 0.1f);
+            number_of_substeps = int(std::ceil(dt_frame/stable_time_step()));
+            h = dt_frame/float(number_of_substeps);
+
+            // The matrix of projective dynamics is refactorized when h changes, and dt_frame/n changes at almost every frame:
+            //  the substeps keep the step of the current factorization while it is between 80% and 100% of h (stable, the
+            //  simulated time only lags slightly behind the elapsed time)
+            const float h_factorized = projective_dynamics.h;
+            if(user_parameters.integrator==PROJECTIVE_DYNAMICS && h_factorized>0 && h_factorized<=h && h_factorized>=0.8f*h)
+                h = h_factorized;
+        }
+        else
+        {
+            // Force constant simulation time step
+            //  The implicit, XPBD and projective dynamics integrators are stable with large steps: a single step is performed per frame
+            h = time_scale*(implicit? 0.02f : 0.001f);
+            number_of_substeps = implicit? 1 : 4;
+        }
+    }
+
+    time_stepping.substeps = 0;
+    time_stepping.substeps_required = number_of_substeps;
+    time_stepping.h = h;
+    const auto time_start = std::chrono::steady_clock::now();
+
+    if( (!simulation_diverged || force_simulation) && h>0)
+    {
+        for(int k=0; (!simulation_diverged  || force_simulation) && k<number_of_substeps; ++k)
+        {
+            // Stop when the next substep would exceed the compute budget of the frame: the simulation slows down instead of the frame rate
+            if(user_parameters.adaptive_time_step && k>0) {
+                const float elapsed = std::chrono::duration<float,std::milli>(std::chrono::steady_clock::now()-time_start).count();
+                if(elapsed*float(k+1)/float(k) > user_parameters.frame_budget)
+                    break;
+            }
+
+            current_magnitude = user_parameters.wind + (user_parameters.wind / 2.f) * sinf(0.1*dt);
+            step(h);
+            time_stepping.substeps++;
+        }
+    }
+    time_stepping.compute_time = std::chrono::duration<float,std::milli>(std::chrono::steady_clock::now()-time_start).count();
+
+    compute_vertex_normals();
+}
+
+// One substep of the simulation, the time spent in each phase is accumulated in timings
+void cloth_simulation::step(float h)
+{
+    typedef std::chrono::steady_clock clock;
+    auto seconds = [](clock::time_point a, clock::time_point b) { return std::chrono::duration<double>(b-a).count(); };
+
+    const clock::time_point t0 = clock::now();
+    prepare_sleeping();
+    compute_forces();
+    const clock::time_point t1 = clock::now();
+    numerical_integration(h);
+    const clock::time_point t2 = clock::now();
+    if(user_parameters.integrator!=XPBD)     // XPBD solves the collisions with its constraints
+        collision_constraints();             // Detect and solve collision with other shapes
+    const clock::time_point t3 = clock::now();
+    if(user_parameters.self_collision && sleeping.bands_asleep<int(sleeping.asleep.size()))
+        self_collision_constraints(h);       // Detect and solve collision of the cloth with itself
+    const clock::time_point t4 = clock::now();
+
+    hard_constraints();                      // Enforce hard positional constraints
+    if(user_parameters.tearing)
+        tear_springs();                      // Break the overstretched springs and split the cloth along the torn edges
+    update_sleeping(h);                      // Put to sleep the regions at rest, wake up the regions close to moving particles
+
+    compute_triangle_normals();                   // Update face normals of the cloth (used by the wind at next step)
+    detect_simulation_divergence();               // Check if the simulation seems to diverge
+    const clock::time_point t5 = clock::now();
+
+    timings.forces         += seconds(t0,t1);
+    timings.integration    += seconds(t1,t2);
+    timings.collisions     += seconds(t2,t3);
+    timings.self_collision += seconds(t3,t4);
+    timings.constraints    += seconds(t4,t5);
+    timings.steps++;
+}
+
+void cloth_simulation::reset_timings()
+{
+    timings = cloth_timings_structure();
+}
+
+// Fill value of force applied on each particle
+// - Gravity
+// - Drag
+// - Spring force
+// - Wind force
+//
+void cloth_simulation::compute_forces()
+{
+    const size_t N = force.size();        // Total number of particles of the cloth Nu x Nv
+
+    simulation_parameters.m = user_parameters.m / float(N); // Constant total mass
+
+    // Get simuation parameters
+    const float K  = user_parameters.K;
+    const float m  = simulation_parameters.m;
+    const float mu = user_parameters.mu;
+    const vec3 g = {0,-9.81f,0};
+    const vec3 w = {-current_magnitude, 0, 0};
+
+    // In XPBD and projective dynamics modes the springs are handled by the solver: only the external forces are computed
+    const bool spring_forces = user_parameters.integrator!=XPBD && user_parameters.integrator!=PROJECTIVE_DYNAMICS;
+
+    // Vectorized kernels work on a structure of arrays copy of the positions
+    const simd_instruction_set instruction_set = simd? simd_support() : simd_instruction_set::none;
+    if(instruction_set!=simd_instruction_set::none)
+    {
+        run_parallel(N, [&](size_t k_begin, size_t k_end)
+        {
+            for(size_t k=k_begin; k<k_end; ++k)
+            {
+                particles_soa.x[k] = position[k].x;
+                particles_soa.y[k] = position[k].y;
+                particles_soa.z[k] = position[k].z;
+            }
+        });
+    }
+
+    // Springs: the force is computed once per spring
+    auto compute_spring_forces = [&](size_t s_begin, size_t s_end)
+    {
+        size_t s = s_begin;
+        if(instruction_set==simd_instruction_set::avx2)
+            s += spring_forces_avx(&particles_soa.x[0], &particles_soa.y[0], &particles_soa.z[0], &springs.i[s], &springs.j[s], &springs.L0[s], K,
+                                   &springs.force_x[s], &springs.force_y[s], &springs.force_z[s], s_end-s);
+        else if(instruction_set==simd_instruction_set::sse2)
+            s += spring_forces_sse(&particles_soa.x[0], &particles_soa.y[0], &particles_soa.z[0], &springs.i[s], &springs.j[s], &springs.L0[s], K,
+                                   &springs.force_x[s], &springs.force_y[s], &springs.force_z[s], s_end-s);
+
+        for(; s<s_end; ++s)
+        {
+            const vec3 f = spring_force(position[springs.i[s]], position[springs.j[s]], springs.L0[s], K);
+            springs.force_x[s] = f.x;
+            springs.force_y[s] = f.y;
+            springs.force_z[s] = f.z;
+        }
+    };
+
+    // The springs of a sleeping band are skipped if the next band (containing their second extremity) is also sleeping
+    const size_t N_spring = spring_forces? springs.size() : 0;
+    const std::vector<int>& spring_offset = sleeping.spring_offset;
+    run_parallel(N_spring, [&](size_t s_begin, size_t s_end)
+    {
+        if(sleeping.bands_asleep==0) {
+            compute_spring_forces(s_begin, s_end);
+            return;
+        }
+        const size_t N_band = sleeping.asleep.size();
+        for(size_t b=0; b<N_band; ++b) {
+            const size_t begin = std::max(s_begin, size_t(spring_offset[b]));
+            const size_t end   = std::min(s_end, size_t(spring_offset[b+1]));
+            const bool next_asleep = b+1==N_band || sleeping.asleep[b+1];
+            if(begin<end && !(sleeping.asleep[b] && next_asleep))
+                compute_spring_forces(begin, end);
+        }
+    });
+
+    // Per-particle forces, computed on bands of rows of the grid
+    //  Spring forces are gathered from the adjacent springs in a fixed order: the result doesn't depend on the number of threads
+    run_parallel(N, [&](size_t k_begin, size_t k_end)
+    {
+        for(size_t k=k_begin; k<k_end; ++k)
+        {
+            if(asleep(k))
+                continue;
+
+            // Gravity and drag
+            force[k] = m*g - mu*speed[k];
+
+            // Wind
+            force[k] += wind_force(int(k), w);
+
+            // Springs
+            for(int e=springs.incident_offset[k]; spring_forces && e<springs.incident_offset[k+1]; ++e) {
+                const int s = springs.incident[e];
+                force[k] += springs.incident_sign[e] * vec3(springs.force_x[s], springs.force_y[s], springs.force_z[s]);
+            }
+        }
+    });
+}
+
+// Wind force applied on particle k: the wind pushes along the averaged normal of the triangles around the particle
+//  Uses the face normals cached by compute_triangle_normals(), oriented toward the negative x (facing the wind)
+vec3 cloth_simulation::wind_force(int k, const vec3& w) const
+{
+    vec3 normal {0, 0, 0};
+    unsigned nb_normal = 0;
+    for(int e=vertex_triangles_offset[k]; e<vertex_triangles_offset[k+1]; ++e) {
+        const vec3& n = triangle_normals[vertex_triangles[e]];
+        normal += n[0]>0? -n : n;
+        nb_normal++;
+    }
+
+    normal /= nb_normal;
+    return w * 0.001f * dot(normalize(w), normal);
+}
+
+// Compare the forces computed by the vectorized kernels against the scalar reference code on the current state
+float cloth_simulation::check_simd_kernels()
+{
+    const bool simd_previous = simd;
+
+    simd = false;
+    compute_forces();
+    const buffer<vec3> force_reference = force;
+
+    simd = true;
+    compute_forces();
+    simd = simd_previous;
+
+    // Relative to the largest component of the reference forces: the two paths only differ by the order of the float operations
+    float difference = 0.0f, scale = 0.0f;
+    for(size_t k=0; k<force.size(); ++k) {
+        for(size_t c=0; c<3; ++c) {
+            difference = std::max(difference, std::abs(force[k][c]-force_reference[k][c]));
+            scale = std::max(scale, std::abs(force_reference[k][c]));
+        }
+    }
+    simd_check_error = scale>0? difference/scale : difference;
+    return simd_check_error;
+}
+
+void cloth_simulation::set_threads(size_t number_of_threads)
+{
+    threads = number_of_threads;
+    pool.resize(threads);
+    multithreading = pool.size()>1;
+}
+
+// Apply f on contiguous ranges covering [0,N[, on the thread pool if multithreading is enabled
+void cloth_simulation::run_parallel(size_t N, const std::function<void(size_t,size_t)>& f)
+{
+    if(multithreading)
+        parallel_for(pool, 0, N, f);
+    else
+        f(0, N);
+}
+
+// Build the list of springs: each spring is listed once from its first extremity (ku,kv)
+//  - structural: (ku,kv+1), (ku+1,kv)
+//  - shearing: (ku+1,kv+1), (ku+1,kv-1)
+//  - bending: (ku,kv+2), (ku+2,kv)
+void cloth_simulation::initialize_springs()
+{
+    static const int du[6] = {0, 1, 1,  1, 0, 2};
+    static const int dv[6] = {1, 0, 1, -1, 2, 0};
+    static const spring_type type[6] = {STRUCTURAL, STRUCTURAL, SHEARING, SHEARING, BENDING, BENDING};
+    static const float length_factor[6] = {1.0f, 1.0f, std::sqrt(2.0f), std::sqrt(2.0f), 2.0f, 2.0f};
+
+    const int N_dim = int(Nu);
+    const float L0 = simulation_parameters.L0;
+
+    springs = springs_structure();
+    for(int ku=0; ku<N_dim; ++ku) {
+        for(int kv=0; kv<N_dim; ++kv) {
+            for(int k=0; k<6; ++k) {
+                const int u = ku+du[k];
+                const int v = kv+dv[k];
+                if( u>=N_dim || v<0 || v>=N_dim )
+                    continue;
+
+                springs.i.push_back(ku*N_dim+kv);
+                springs.j.push_back(u*N_dim+v);
+                springs.L0.push_back(length_factor[k]*L0);
+                springs.type.push_back(type[k]);
+            }
+        }
+    }
+    initialize_springs_adjacency();
+}
+
+// Force storage and adjacency of the springs: springs are stored in increasing index for each particle
+void cloth_simulation::initialize_springs_adjacency()
+{
+    springs.force_x.resize(springs.size());
+    springs.force_y.resize(springs.size());
+    springs.force_z.resize(springs.size());
+
+    const size_t N = position.size();
+    const size_t N_spring = springs.size();
+    springs.incident_offset.assign(N+1, 0);
+    for(size_t s=0; s<N_spring; ++s) {
+        springs.incident_offset[springs.i[s]+1]++;
+        springs.incident_offset[springs.j[s]+1]++;
+    }
+    for(size_t k=0; k<N; ++k)
+        springs.incident_offset[k+1] += springs.incident_offset[k];
+
+    std::vector<int> counter(springs.incident_offset.begin(), springs.incident_offset.end()-1);
+    springs.incident.resize(2*N_spring);
+    springs.incident_sign.resize(2*N_spring);
+    for(size_t s=0; s<N_spring; ++s) {
+        const int ki = counter[springs.i[s]]++;
+        springs.incident[ki] = int(s);
+        springs.incident_sign[ki] = 1.0f;
+
+        const int kj = counter[springs.j[s]]++;
+        springs.incident[kj] = int(s);
+        springs.incident_sign[kj] = -1.0f;
+    }
+}
+
+// Build the triangles adjacent to each vertex
+void cloth_simulation::initialize_normals()
+{
+    const size_t N = position.size();
+    const size_t N_tri = connectivity.size();
+
+    vertex_triangles_offset.assign(N+1, 0);
+    for(size_t t=0; t<N_tri; ++t)
+        for(size_t k=0; k<3; ++k)
+            vertex_triangles_offset[connectivity[t][k]+1]++;
+    for(size_t k=0; k<N; ++k)
+        vertex_triangles_offset[k+1] += vertex_triangles_offset[k];
+
+    std::vector<int> counter(vertex_triangles_offset.begin(), vertex_triangles_offset.end()-1);
+    vertex_triangles.resize(3*N_tri);
+    for(size_t t=0; t<N_tri; ++t)
+        for(size_t k=0; k<3; ++k)
+            vertex_triangles[counter[connectivity[t][k]]++] = int(t);
+
+    triangle_normals.resize(N_tri);
+    normals.resize(N);
+    compute_triangle_normals();
+    compute_vertex_normals();
+}
+
+// Face normals of the current positions, shared by the wind force and the rendering normals
+//  Expected to be called once per simulation step, after the positions have been updated.
+void cloth_simulation::compute_triangle_normals()
+{
+    const size_t N_tri = connectivity.size();
+
+    run_parallel(N_tri, [&](size_t t_begin, size_t t_end)
+    {
+        for(size_t t=t_begin; t<t_end; ++t)
+        {
+            const uint3& f = connectivity[t];
+            if(asleep(f[0]) && asleep(f[1]) && asleep(f[2]))
+                continue;
+            const vec3& p0 = position[f[0]];
+            const vec3 p10 = normalize(position[f[1]]-p0);
+            const vec3 p20 = normalize(position[f[2]]-p0);
+            triangle_normals[t] = normalize(cross(p10,p20));
+        }
+    });
+}
+
+// Vertex normals used for rendering: same result as vcl::normal(), but gathered per vertex from the cached face normals to run in parallel
+//  Only needed once per displayed frame.
+void cloth_simulation::compute_vertex_normals()
+{
+    const size_t N = position.size();
+
+    run_parallel(N, [&](size_t k_begin, size_t k_end)
+    {
+        for(size_t k=k_begin; k<k_end; ++k)
+        {
+            vec3 n = {0,0,0};
+            for(int e=vertex_triangles_offset[k]; e<vertex_triangles_offset[k+1]; ++e)
+                n += triangle_normals[vertex_triangles[e]];
+            normals[k] = normalize(n);
+        }
+    });
+}
+
+
+// Handle detection and response to collision with the shape described in "collision_shapes" variable
+void cloth_simulation::collision_constraints()
+{
+    const size_t N = force.size();        // Total number of particles of the cloth Nu x Nv
+    const float m1 = user_parameters.m / (float)(N);
+    const float m2 = 100.f;
+
+    run_parallel(N, [&](size_t k_begin, size_t k_end)
+    {
+        for (size_t k = k_begin; k < k_end; ++k)
+        {
+            if (asleep(k))
+                continue;
+
+            //Ground collision (the particle keeps its tangential speed only)
+            if (position[k][1] < collision_shapes.ground_height) {
+                position[k][1] = collision_shapes.ground_height;
+                if (speed[k][1] < 0)
+                    speed[k][1] = 0;
+            }
+
+            //Mesh obstacle collision: constant cost per particle using its distance field
+            if (collision_shapes.collider == MESH_COLLIDER)
+            {
+                vec3 gradient;
+                const float detection = collision_shapes.obstacle.distance(position[k], gradient);
+                if (detection <= 0.01f)
+                {
+                    const vec3 n = normalize(gradient);
+                    position[k] += (0.01f - detection) * n;
+                    const float vn = dot(speed[k], n);
+                    if (vn < 0)
+                        speed[k] -= vn * n;
+                }
+                continue;
+            }
+
+            //Sphere collision
+            float detection = norm(position[k] - collision_shapes.sphere_p);
+            if (detection <= collision_shapes.sphere_r + 0.01f)
+            {
+                vec3 u = (position[k] - collision_shapes.sphere_p) / norm(position[k] - collision_shapes.sphere_p);
+                float j = 2 * (m1 * m2) / (m1 + m2) * dot(- speed[k], u);
+
+                speed[k] = 0.5f * speed[k] + 0.5f * j/m1 * u;
+
+                float d = collision_shapes.sphere_r + 0.01f - norm(position[k] - collision_shapes.sphere_p);
+                position[k] = position[k] + d/2.f*u;
+            }
+        }
+    });
+}
+
+void cloth_simulation::initialize_self_collision()
+{
+    self_collision.thickness = 0.5f*simulation_parameters.L0;
+    self_collision.grid.initialize(position, simulation_parameters.L0);
+}
+
+// Signed distance d from p to the plane of the triangle (a,b,c) of unit normal n
+//  Return false if the projection of p is outside of the triangle
+static bool point_triangle_distance(const vec3& p, const vec3& a, const vec3& b, const vec3& c, vec3& n, float& d)
+{
+    const vec3 e1 = b-a;
+    const vec3 e2 = c-a;
+    n = cross(e1,e2);
+    const float area = norm(n);
+    if(area<1e-12f)
+        return false;
+    n /= area;
+
+    d = dot(p-a,n);
+    const vec3 q = p-d*n-a;
+    const float wb = dot(cross(q,e2),n)/area;
+    const float wc = dot(cross(e1,q),n)/area;
+    return wb>=0 && wc>=0 && wb+wc<=1;
+}
+
+// Push apart the particles closer than the thickness, and keep the particles on their side of the triangles
+//  Each particle only updates its own position and speed from the state before the pass: the result doesn't depend on the number of threads
+//  - Particle-particle: each particle of a pair moves by half of the penetration, and half of the approaching relative speed is removed
+//  - Particle-triangle: the particle is moved back at a distance 'thickness' of the triangle, on the side where it was at the beginning of the step.
+//    The position at the beginning of the step is p-h*v: a particle crossing a triangle during a large step is also detected.
+void cloth_simulation::self_collision_constraints(float h)
+{
+    const size_t N = position.size();
+    const int N_dim = int(Nv);
+    const float thickness = self_collision.thickness;
+    const spatial_hash& grid = self_collision.grid;
+
+    self_collision.grid.update(position);
+    self_collision.position = position;
+    self_collision.speed = speed;
+    const buffer<vec3>& p0 = self_collision.position;
+    const buffer<vec3>& v0 = self_collision.speed;
+
+    // Triangles are searched around the particles close enough to have a triangle containing p (or crossed by p during a step of moderate displacement)
+    const float radius = grid.cell_size;
+
+    // Particles close to each other in the grid of the cloth are not considered as colliding (the particles duplicated by the tears keep
+    //  the grid coordinates of their original particle)
+    auto topological_neighbors = [&](int a, int b) {
+        a = grid_index[a];
+        b = grid_index[b];
+        return std::abs(a/N_dim-b/N_dim)<=2 && std::abs(a%N_dim-b%N_dim)<=2;
+    };
+
+    // One range of particles per thread, each with its own candidate buffers (kept between the steps)
+    const size_t N_range = std::max(std::min(pool.size(), N), size_t(1));
+    self_collision.triangles.resize(N_range);
+    self_collision.triangle_visited.resize(N_range);
+    for(std::vector<char>& visited : self_collision.triangle_visited)
+        visited.resize(connectivity.size(), 0);
+
+    run_parallel(N_range, [&](size_t r_begin, size_t r_end)
+    {
+        for(size_t r=r_begin; r<r_end; ++r)
+        {
+            std::vector<int>& triangles = self_collision.triangles[r];
+            std::vector<char>& triangle_visited = self_collision.triangle_visited[r];
+            for(size_t k=r*N/N_range; k<(r+1)*N/N_range; ++k)
+            {
+                if(asleep(k))
+                    continue;
+
+                const vec3& p = p0[k];
+                vec3 dp = {0,0,0};
+                vec3 dv = {0,0,0};
+
+                grid.query(p, radius, [&](int j)
+                {
+                    if(topological_neighbors(int(k),j))
+                        return;
+                    const vec3 u = p-p0[j];
+                    const float L = norm(u);
+
+                    if(L<radius) {
+                        for(int e=vertex_triangles_offset[j]; e<vertex_triangles_offset[j+1]; ++e) {
+                            const int t = vertex_triangles[e];
+                            const uint3& f = connectivity[t];
+                            if(triangle_visited[t] || topological_neighbors(int(k),int(f[0])) || topological_neighbors(int(k),int(f[1])) || topological_neighbors(int(k),int(f[2])))
+                                continue;
+                            triangle_visited[t] = 1;
+                            triangles.push_back(t);
+                        }
+                    }
+
+                    if(L>=thickness || L<1e-6f)
+                        return;
+                    const vec3 n = u/L;
+                    dp += 0.5f*(thickness-L)*n;
+                    const float vn = dot(v0[k]-v0[j], n);
+                    if(vn<0)
+                        dv -= 0.5f*vn*n;
+                });
+
+                for(const int t : triangles)
+                {
+                    const uint3& f = connectivity[t];
+                    vec3 n;
+                    float d;
+                    if(!point_triangle_distance(p, p0[f[0]], p0[f[1]], p0[f[2]], n, d))
+                        continue;
+
+                    // Side of the triangle at the beginning of the step
+                    const float d_previous = dot((p-h*v0[k]) - (p0[f[0]]-h*v0[f[0]]), n);
+                    if(d_previous<0) {
+                        n = -n;
+                        d = -d;
+                    }
+                    if(d>=thickness)
+                        continue;
+
+                    dp += (thickness-d)*n;
+                    const float vn = dot(v0[k]-(v0[f[0]]+v0[f[1]]+v0[f[2]])/3.0f, n);
+                    if(vn<0)
+                        dv -= vn*n;
+                }
+
+                // The marks are cleared for the next particle
+                for(const int t : triangles)
+                    triangle_visited[t] = 0;
+                triangles.clear();
+
+                position[k] = p+dp;
+                speed[k] = v0[k]+dv;
+            }
+        }
+    });
+}
+
+// Offset in the value array of A of the coefficient (3*a, 3*b+column), the 3 rows of the block being contiguous
+static int block_offset(const Eigen::SparseMatrix<float>& A, int a, int b, int column)
+{
+    const int col = 3*b+column;
+    for(int k=A.outerIndexPtr()[col]; k<A.outerIndexPtr()[col+1]; ++k)
+        if(A.innerIndexPtr()[k]==3*a)
+            return k;
+    assert_vcl(false, "Block ("+str(a)+","+str(b)+") is not in the sparsity pattern");
+    return -1;
+}
+
+// Build the sparsity pattern of the implicit system: one 3x3 block per particle and two blocks per spring
+void cloth_simulation::initialize_implicit_solver()
+{
+    const int N = int(position.size());
+    const size_t N_spring = springs.size();
+
+    std::vector<Eigen::Triplet<float> > triplets;
+    for(int k=0; k<N; ++k)
+        for(int c=0; c<3; ++c)
+            for(int r=0; r<3; ++r)
+                triplets.push_back(Eigen::Triplet<float>(3*k+r, 3*k+c, 0.0f));
+
+    for(size_t s=0; s<N_spring; ++s) {
+        const int i = springs.i[s];
+        const int j = springs.j[s];
+        for(int c=0; c<3; ++c) {
+            for(int r=0; r<3; ++r) {
+                triplets.push_back(Eigen::Triplet<float>(3*i+r, 3*j+c, 0.0f));
+                triplets.push_back(Eigen::Triplet<float>(3*j+r, 3*i+c, 0.0f));
+            }
+        }
+    }
+
+    Eigen::SparseMatrix<float>& A = implicit_solver.A;
+    A.resize(3*N, 3*N);
+    A.setFromTriplets(triplets.begin(), triplets.end());
+    A.makeCompressed();
+
+    implicit_solver.offset_diagonal.resize(3*N);
+    for(int k=0; k<N; ++k)
+        for(int c=0; c<3; ++c)
+            implicit_solver.offset_diagonal[3*k+c] = block_offset(A, k, k, c);
+
+    implicit_solver.offset_spring.resize(6*N_spring);
+    for(size_t s=0; s<N_spring; ++s) {
+        const int i = springs.i[s];
+        const int j = springs.j[s];
+        for(int c=0; c<3; ++c) {
+            implicit_solver.offset_spring[6*s+c]   = block_offset(A, i, j, c);
+            implicit_solver.offset_spring[6*s+3+c] = block_offset(A, j, i, c);
+        }
+    }
+
+    implicit_solver.b.setZero(3*N);
+    implicit_solver.dv.setZero(3*N);
+    implicit_solver.pinned.resize(N);
+    implicit_solver.cg.setMaxIterations(100);
+    implicit_solver.cg.setTolerance(1e-4f);
+    implicit_solver.iterations = 0;
+    implicit_solver.error = 0.0f;
+
+    // The multigrid hierarchy is built on the grid of the cloth: it is not available once the cloth is torn
+    implicit_solver.multigrid_available = N==int(Nu*Nv);
+    if(implicit_solver.multigrid_available)
+        implicit_solver.multigrid.initialize(int(Nu), int(Nv), A);
+}
+
+// Update the sparsity pattern of the implicit system after a tear (particles [N_previous, N[ added, spring_origin: index of each spring
+//  before the tear) without rebuilding it
+//  - the blocks of the removed springs, and of the springs moved to an added particle, are kept in the pattern with zero values (they
+//    are not written by the assembly anymore)
+//  - the blocks of the added particles and of the springs attached to them are appended: their rows are after the rows of the previous
+//    particles, so each column keeps its previous coefficients first and the stored offsets are only shifted
+//  The velocity increment of the previous particles is kept as initial guess of the next solve.
+void cloth_simulation::update_implicit_solver(size_t N_previous, const std::vector<int>& spring_origin)
+{
+    const int N = int(position.size());
+    const int N0 = int(N_previous);
+    const size_t N_spring = springs.size();
+    Eigen::SparseMatrix<float>& A = implicit_solver.A;
+    std::vector<int>& offset_diagonal = implicit_solver.offset_diagonal;
+    std::vector<int>& offset_spring = implicit_solver.offset_spring;
+
+    // Previous blocks of the removed springs and of the springs attached to an added particle
+    std::vector<char> kept(offset_spring.size()/6, 0);
+    for(size_t s=0; s<N_spring; ++s)
+        kept[size_t(spring_origin[s])] = std::max(springs.i[s], springs.j[s])<N0;
+    for(size_t o=0; o<kept.size(); ++o)
+        if(!kept[o])
+            for(int c=0; c<6; ++c)
+                for(int r=0; r<3; ++r)
+                    A.valuePtr()[offset_spring[6*o+c]+r] = 0.0f;
+
+    // Added blocks, as (column, row) pairs of particles
+    std::vector<std::pair<int,int> > blocks;
+    for(int k=N0; k<N; ++k)
+        blocks.push_back(std::make_pair(k, k));
+    for(size_t s=0; s<N_spring; ++s) {
+        const int i = springs.i[s];
+        const int j = springs.j[s];
+        if(std::max(i,j)<N0)
+            continue;
+        blocks.push_back(std::make_pair(j, i));
+        blocks.push_back(std::make_pair(i, j));
+    }
+    std::sort(blocks.begin(), blocks.end());
+    blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+
+    Eigen::SparseMatrix<float> B(3*N, 3*N);
+    B.resizeNonZeros(A.nonZeros()+9*Eigen::Index(blocks.size()));
+    int n = 0;
+    size_t q = 0;
+    for(int col=0; col<3*N; ++col) {
+        B.outerIndexPtr()[col] = n;
+        if(col<3*N0) {
+            for(int k=A.outerIndexPtr()[col]; k<A.outerIndexPtr()[col+1]; ++k, ++n) {
+                B.innerIndexPtr()[n] = A.innerIndexPtr()[k];
+                B.valuePtr()[n] = A.valuePtr()[k];
+            }
+        }
+        size_t q_end = q;
+        for(; q_end<blocks.size() && blocks[q_end].first==col/3; ++q_end) {
+            for(int r=0; r<3; ++r, ++n) {
+                B.innerIndexPtr()[n] = 3*blocks[q_end].second+r;
+                B.valuePtr()[n] = 0.0f;
+            }
+        }
+        if(col%3==2)
+            q = q_end;
+    }
+    B.outerIndexPtr()[3*N] = n;
+
+    // Offsets of the previous coefficients are shifted by the coefficients inserted in the previous columns
+    auto shift = [&](int col) { return B.outerIndexPtr()[col]-A.outerIndexPtr()[col]; };
+    offset_diagonal.resize(size_t(3*N));
+    for(int k=0; k<N; ++k)
+        for(int c=0; c<3; ++c)
+            offset_diagonal[3*k+c] = k<N0? offset_diagonal[3*k+c]+shift(3*k+c) : block_offset(B, k, k, c);
+
+    std::vector<int> offset(6*N_spring);
+    for(size_t s=0; s<N_spring; ++s) {
+        const int i = springs.i[s];
+        const int j = springs.j[s];
+        const size_t o = size_t(spring_origin[s]);
+        const bool added = std::max(i,j)>=N0;
+        for(int c=0; c<3; ++c) {
+            offset[6*s+c]   = added? block_offset(B, i, j, c) : offset_spring[6*o+c]+shift(3*j+c);
+            offset[6*s+3+c] = added? block_offset(B, j, i, c) : offset_spring[6*o+3+c]+shift(3*i+c);
+        }
+    }
+    offset_spring.swap(offset);
+    A.swap(B);
+
+    implicit_solver.dv.conservativeResize(3*N);
+    implicit_solver.dv.tail(3*(N-N0)).setZero();
+    implicit_solver.b.setZero(3*N);
+    implicit_solver.pinned.resize(size_t(N));
+    implicit_solver.multigrid_available = false;
+}
+
+// Largest substep expected to be stable for the current integrator and parameters
+//  - explicit: h < 2/omega_max, where omega_max^2 is bounded by 2 K (number of springs of a particle) / m (Gershgorin bound of the stiffness matrix)
+//    and h < 2m/mu for the drag
+//  - all integrators: a particle should not move more than a fraction of the rest length per substep (CFL condition), otherwise
+//    the collisions and the self collisions are missed
+float cloth_simulation::stable_time_step() const
+{
+    const float h_max = 0.02f; // Step of the implicit integrators when the cloth moves slowly
+    const float L0 = simulation_parameters.L0;
+    const float m  = user_parameters.m / float(position.size());
+    const float K  = user_parameters.K;
+    const float mu = user_parameters.mu;
+
+    float v_max = 0.0f;
+    int incident_max = 0;
+    const size_t N = position.size();
+    for(size_t k=0; k<N; ++k) {
+        const vec3& v = speed[k];
+        v_max = std::max(v_max, v.x*v.x+v.y*v.y+v.z*v.z);
+        incident_max = std::max(incident_max, springs.incident_offset[k+1]-springs.incident_offset[k]);
+    }
+    v_max = std::sqrt(v_max);
+
+    float h = h_max;
+    if(user_parameters.integrator==EXPLICIT_EULER)
+    {
+        const float omega_max = std::sqrt(2.0f*K*float(incident_max)/m);
+        h = std::min(h, 0.9f*2.0f/omega_max);
+        if(mu>0)
+            h = std::min(h, 0.9f*2.0f*m/mu);
+    }
+    if(v_max>0)
+        h = std::min(h, 0.5f*L0/v_max);
+
+    return h;
+}
+
+void cloth_simulation::numerical_integration(float h)
+{
+    if(user_parameters.integrator==IMPLICIT_EULER) {
+        numerical_integration_implicit(h);
+        return ;
+    }
+    if(user_parameters.integrator==XPBD) {
+        numerical_integration_xpbd(h);
+        return ;
+    }
+    if(user_parameters.integrator==PROJECTIVE_DYNAMICS) {
+        numerical_integration_projective_dynamics(h);
+        return ;
+    }
+
+    const size_t NN = position.size();
+    const float m = simulation_parameters.m;
+
+    run_parallel(NN, [&](size_t k_begin, size_t k_end)
+    {
+        for(size_t k=k_begin; k<k_end; ++k)
+        {
+            if(asleep(k))
+                continue;
+
+            vec3& p = position[k];
+            vec3& v = speed[k];
+            const vec3& f = force[k];
+
+            v = v + h*f/m;
+            p = p + h*v;
+        }
+    });
+}
+
+// Backward Euler step (linearized): solve (M - h dF/dv - h^2 dF/dx) dv = h (F + h dF/dx v)
+//  Expects the forces F to be already computed. Drag gives dF/dv = -mu Id, wind and gravity are treated explicitly.
+void cloth_simulation::numerical_integration_implicit(float h)
+{
+    const int N = int(position.size());
+    const float K  = user_parameters.K;
+    const float mu = user_parameters.mu;
+    const float m  = simulation_parameters.m;
+    const float h2 = h*h;
+
+    float* value = implicit_solver.A.valuePtr();
+    Eigen::VectorXf& b = implicit_solver.b;
+    const std::vector<int>& offset_diagonal = implicit_solver.offset_diagonal;
+    const std::vector<int>& offset_spring = implicit_solver.offset_spring;
+    std::vector<bool>& pinned = implicit_solver.pinned;
+
+    std::fill(pinned.begin(), pinned.end(), false);
+    for(const auto& constraints : positional_constraints)
+        pinned[constraints.first] = true;
+
+    // Mass and drag terms on the diagonal, explicit forces in the right hand side
+    for(int k=0; k<N; ++k) {
+        for(int c=0; c<3; ++c) {
+            for(int r=0; r<3; ++r)
+                value[offset_diagonal[3*k+c]+r] = (r==c)? m+h*mu : 0.0f;
+            b[3*k+c] = h*force[k][c];
+        }
+    }
+
+    // Spring Jacobians
+    const size_t N_spring = springs.size();
+    for(size_t s=0; s<N_spring; ++s)
+    {
+        const int i = springs.i[s];
+        const int j = springs.j[s];
+
+        const vec3 pij = position[j]-position[i];
+        const float L = norm(pij);
+        const vec3 e = pij/L;
+
+        // dF_i/dx_j = K ( e e^t + alpha (Id - e e^t) )
+        //  alpha is clamped to positive values (compressed springs) to keep the system definite positive
+        const float alpha = std::max(1.0f-springs.L0[s]/L, 0.0f);
+        float J[3][3];
+        for(int c=0; c<3; ++c)
+            for(int r=0; r<3; ++r)
+                J[r][c] = K*( (1.0f-alpha)*e[r]*e[c] + (r==c? alpha : 0.0f) );
+
+        const vec3 vij = speed[j]-speed[i];
+        for(int r=0; r<3; ++r) {
+            const float Jv = J[r][0]*vij[0] + J[r][1]*vij[1] + J[r][2]*vij[2];
+            b[3*i+r] += h2*Jv;
+            b[3*j+r] -= h2*Jv;
+        }
+
+        // Pinned particles have a known zero increment: their coupling blocks are removed
+        const bool coupled = !pinned[i] && !pinned[j];
+        for(int c=0; c<3; ++c) {
+            for(int r=0; r<3; ++r) {
+                value[offset_diagonal[3*i+c]+r] += h2*J[r][c];
+                value[offset_diagonal[3*j+c]+r] += h2*J[r][c];
+                value[offset_spring[6*s+c]+r]   = coupled? -h2*J[r][c] : 0.0f;
+                value[offset_spring[6*s+3+c]+r] = coupled? -h2*J[r][c] : 0.0f;
+            }
+        }
+    }
+
+    for(int k=0; k<N; ++k) {
+        if(!pinned[k])
+            continue;
+        for(int c=0; c<3; ++c) {
+            for(int r=0; r<3; ++r)
+                value[offset_diagonal[3*k+c]+r] = (r==c)? 1.0f : 0.0f;
+            b[3*k+c] = 0.0f;
+        }
+    }
+
+    // Warm-started solve: the previous increment is used as initial guess
+    if(user_parameters.multigrid && implicit_solver.multigrid_available)
+    {
+        implicit_solver.multigrid.update(implicit_solver.A);
+        implicit_solver.iterations = implicit_solver.multigrid.solve(b, implicit_solver.dv, 100, 1e-4f, implicit_solver.error);
+    }
+    else
+    {
+        implicit_solver.cg.compute(implicit_solver.A);
+        implicit_solver.dv = implicit_solver.cg.solveWithGuess(b, implicit_solver.dv);
+        implicit_solver.iterations = int(implicit_solver.cg.iterations());
+        implicit_solver.error = implicit_solver.cg.error();
+    }
+
+    const Eigen::VectorXf& dv = implicit_solver.dv;
+    run_parallel(size_t(N), [&](size_t k_begin, size_t k_end)
+    {
+        for(size_t k=k_begin; k<k_end; ++k)
+        {
+            vec3& p = position[k];
+            vec3& v = speed[k];
+
+            v = v + vec3(dv[3*k], dv[3*k+1], dv[3*k+2]);
+            p = p + h*v;
+        }
+    });
+}
+
+void cloth_simulation::initialize_xpbd_solver()
+{
+    xpbd_solver.position_previous.resize(position.size());
+    xpbd_solver.inverse_mass.resize(position.size());
+    xpbd_solver.lambda.resize(springs.size());
+}
+
+// Extended position based dynamics step
+//  - Positions are predicted from the external forces (gravity, drag, wind), expected to be already computed
+//  - The constraints are then projected a fixed number of times (Gauss-Seidel order), independently of the time step
+//  - The speed is recovered from the displacement of the particles
+void cloth_simulation::numerical_integration_xpbd(float h)
+{
+    const size_t N = position.size();
+    const size_t N_spring = springs.size();
+    const float m = simulation_parameters.m;
+    const float alpha = 1.0f/(user_parameters.K*h*h); // Compliance of the constraints scaled by the time step
+    const float r = collision_shapes.sphere_r + 0.01f;
+
+    std::vector<float>& w = xpbd_solver.inverse_mass;
+    std::fill(w.begin(), w.end(), 1.0f/m);
+    for(const auto& constraints : positional_constraints)
+        w[constraints.first] = 0.0f;
+
+    // Prediction
+    run_parallel(N, [&](size_t k_begin, size_t k_end)
+    {
+        for(size_t k=k_begin; k<k_end; ++k)
+        {
+            xpbd_solver.position_previous[k] = position[k];
+            if(w[k]>0) {
+                speed[k] = speed[k] + h*force[k]/m;
+                position[k] = position[k] + h*speed[k];
+            }
+        }
+    });
+
+    // Constraints projection
+    std::fill(xpbd_solver.lambda.begin(), xpbd_solver.lambda.end(), 0.0f);
+    for(int iteration=0; iteration<user_parameters.xpbd_iterations; ++iteration)
+    {
+        // Distance and bending constraints
+        for(size_t s=0; s<N_spring; ++s)
+        {
+            const int i = springs.i[s];
+            const int j = springs.j[s];
+            const float w_sum = w[i]+w[j];
+            if(w_sum==0)
+                continue;
+
+            const vec3 pij = position[j] - position[i];
+            const float L = norm(pij);
+            if(L<1e-6f)
+                continue;
+            const vec3 u = pij/L;
+
+            const float C = L - springs.L0[s];
+            float& lambda = xpbd_solver.lambda[s];
+            const float d_lambda = (-C - alpha*lambda) / (w_sum + alpha);
+            lambda += d_lambda;
+
+            position[i] -= w[i]*d_lambda*u;
+            position[j] += w[j]*d_lambda*u;
+        }
+
+        // Non-penetration with the ground and the obstacle
+        run_parallel(N, [&](size_t k_begin, size_t k_end)
+        {
+            for(size_t k=k_begin; k<k_end; ++k)
+            {
+                vec3& p = position[k];
+                if(p.y < collision_shapes.ground_height)
+                    p.y = collision_shapes.ground_height;
+
+                if(collision_shapes.collider==MESH_COLLIDER) {
+                    vec3 gradient;
+                    const float d = collision_shapes.obstacle.distance(p, gradient);
+                    if(d<0.01f)
+                        p += (0.01f-d)*normalize(gradient);
+                    continue;
+                }
+
+                const vec3 u = p - collision_shapes.sphere_p;
+                const float d = norm(u);
+                if(d<r && d>1e-6f)
+                    p = collision_shapes.sphere_p + r*u/d;
+            }
+        });
+    }
+
+    // Speed update
+    run_parallel(N, [&](size_t k_begin, size_t k_end)
+    {
+        for(size_t k=k_begin; k<k_end; ++k)
+            speed[k] = (position[k]-xpbd_solver.position_previous[k])/h;
+    });
+}
+
+void cloth_simulation::initialize_projective_dynamics()
+{
+    const int N = int(position.size());
+    projective_dynamics.h = -1.0f;
+    projective_dynamics.pinned.clear();
+    projective_dynamics.pinned_count = 0;
+    projective_dynamics.factorizations = 0;
+    projective_dynamics.y.resize(N, 3);
+    projective_dynamics.x.resize(N, 3);
+    projective_dynamics.x_previous.resize(N, 3);
+    projective_dynamics.b.resize(N, 3);
+    projective_dynamics.x_global.resize(N, 3);
+    projective_dynamics.d.resize(int(springs.size()), 3);
+}
+
+// Assemble and factorize M + h^2 K L (rows of the pinned particles replaced by the identity)
+void cloth_simulation::factorize_projective_dynamics(float h)
+{
+    const int N = int(position.size());
+    const float K = user_parameters.K;
+    const float m = simulation_parameters.m;
+    const float h2K = h*h*K;
+    const std::vector<bool>& pinned = projective_dynamics.pinned;
+
+    std::vector<Eigen::Triplet<float> > triplets;
+    triplets.reserve(N+2*springs.size());
+    for(int k=0; k<N; ++k) {
+        const int degree = springs.incident_offset[k+1]-springs.incident_offset[k];
+        triplets.push_back(Eigen::Triplet<float>(k, k, pinned[k]? 1.0f : m+h2K*float(degree)));
+    }
+    const size_t N_spring = springs.size();
+    for(size_t s=0; s<N_spring; ++s) {
+        const int i = springs.i[s];
+        const int j = springs.j[s];
+        if(pinned[i] || pinned[j])
+            continue;
+        triplets.push_back(Eigen::Triplet<float>(i, j, -h2K));
+        triplets.push_back(Eigen::Triplet<float>(j, i, -h2K));
+    }
+
+    Eigen::SparseMatrix<float>& A = projective_dynamics.A;
+    A.resize(N, N);
+    A.setFromTriplets(triplets.begin(), triplets.end());
+    projective_dynamics.solver.compute(A);
+    assert_vcl(projective_dynamics.solver.info()==Eigen::Success, "Factorization of the projective dynamics system failed");
+
+    projective_dynamics.K = K;
+    projective_dynamics.m = m;
+    projective_dynamics.h = h;
+    projective_dynamics.factorizations++;
+}
+
+// Projective dynamics step (local/global iterations), expects the external forces (gravity, drag, wind) to be already computed
+void cloth_simulation::numerical_integration_projective_dynamics(float h)
+{
+    const int N = int(position.size());
+    const int N_spring = int(springs.size());
+    const float K = user_parameters.K;
+    const float m = simulation_parameters.m;
+    const float h2K = h*h*K;
+    projective_dynamics_structure& pd = projective_dynamics;
+
+    // The pinned particles are only rebuilt when the positional constraints changed (each constraint is a pinned particle)
+    bool pinned_changed = pd.pinned.size()!=size_t(N) || pd.pinned_count!=positional_constraints.size();
+    for(auto it=positional_constraints.begin(); !pinned_changed && it!=positional_constraints.end(); ++it)
+        pinned_changed = !pd.pinned[it->first];
+    if(pinned_changed) {
+        pd.pinned.assign(N, false);
+        for(const auto& constraints : positional_constraints)
+            pd.pinned[constraints.first] = true;
+        pd.pinned_count = positional_constraints.size();
+    }
+    const std::vector<bool>& pinned = pd.pinned;
+    if(pinned_changed || pd.h!=h || pd.K!=K || pd.m!=m)
+        factorize_projective_dynamics(h);
+
+    // Inertial prediction, also used as initial guess
+    run_parallel(size_t(N), [&](size_t k_begin, size_t k_end)
+    {
+        for(size_t k=k_begin; k<k_end; ++k) {
+            const vec3 y = pinned[k]? positional_constraints.at(int(k)) : position[k] + h*speed[k] + (h*h/m)*force[k];
+            for(int c=0; c<3; ++c)
+                pd.y(k,c) = y[c];
+        }
+    });
+    pd.x = pd.y;
+    pd.x_previous = pd.y;
+
+    float omega = 1.0f;
+    const float rho2 = user_parameters.chebyshev_rho*user_parameters.chebyshev_rho;
+    for(int iteration=0; iteration<user_parameters.pd_iterations; ++iteration)
+    {
+        // Local step: projection of each spring on its rest length
+        run_parallel(size_t(N_spring), [&](size_t s_begin, size_t s_end)
+        {
+            for(size_t s=s_begin; s<s_end; ++s) {
+                const Eigen::RowVector3f pij = pd.x.row(springs.j[s]) - pd.x.row(springs.i[s]);
+                const float L = pij.norm();
+                pd.d.row(s) = L>1e-6f? Eigen::RowVector3f(springs.L0[s]/L*pij) : Eigen::RowVector3f::Zero();
+            }
+        });
+
+        // Right hand side, gathered from the adjacent springs of each particle
+        //  The pinned particles are fixed to their constrained position, their coupling is moved to the right hand side of their neighbors
+        run_parallel(size_t(N), [&](size_t k_begin, size_t k_end)
+        {
+            for(size_t k=k_begin; k<k_end; ++k) {
+                if(pinned[k]) {
+                    const vec3& p = positional_constraints.at(int(k));
+                    pd.b.row(k) << p.x, p.y, p.z;
+                    continue;
+                }
+                Eigen::RowVector3f b = m*pd.y.row(k);
+                for(int e=springs.incident_offset[k]; e<springs.incident_offset[k+1]; ++e) {
+                    const int s = springs.incident[e];
+                    b -= (h2K*springs.incident_sign[e])*pd.d.row(s);
+                    const int neighbor = springs.incident_sign[e]>0? springs.j[s] : springs.i[s];
+                    if(pinned[neighbor]) {
+                        const vec3& p = positional_constraints.at(neighbor);
+                        b += h2K*Eigen::RowVector3f(p.x, p.y, p.z);
+                    }
+                }
+                pd.b.row(k) = b;
+            }
+        });
+
+        // Global step: the 3 coordinates are independent back-substitutions
+        Eigen::Matrix<float,Eigen::Dynamic,3>& x_global = pd.x_global;
+        run_parallel(3, [&](size_t c_begin, size_t c_end)
+        {
+            for(size_t c=c_begin; c<c_end; ++c)
+                x_global.col(c) = pd.solver.solve(pd.b.col(c));
+        });
+
+        // Chebyshev semi-iterative update: x_{k+1} = omega (x_global - x_{k-1}) + x_{k-1}
+        if(user_parameters.chebyshev) {
+            omega = iteration==0? 1.0f : (iteration==1? 2.0f/(2.0f-rho2) : 4.0f/(4.0f-rho2*omega));
+            x_global = omega*(x_global-pd.x_previous) + pd.x_previous;
+        }
+        pd.x_previous.swap(pd.x);
+        pd.x.swap(x_global);
+    }
+
+    // Speed from the displacement of the particles
+    run_parallel(size_t(N), [&](size_t k_begin, size_t k_end)
+    {
+        for(size_t k=k_begin; k<k_end; ++k) {
+            const vec3 p = {pd.x(k,0), pd.x(k,1), pd.x(k,2)};
+            speed[k] = (p-position[k])/h;
+            position[k] = p;
+        }
+    });
+}
+
+// Remove the springs s such that remove[s] is true, the order of the other springs is kept
+//  origin (index of each spring before the tear) is compacted the same way. The adjacency is compacted in place: the entries of the
+//  removed springs are dropped, as well as the entries of the particles which are no longer an extremity of their spring.
+static void remove_springs(springs_structure& springs, const std::vector<char>& remove, std::vector<int>& origin)
+{
+    std::vector<int> index(springs.size(), -1); // Index of each remaining spring after the compaction
+    size_t n = 0;
+    for(size_t s=0; s<springs.size(); ++s) {
+        if(remove[s])
+            continue;
+        index[s] = int(n);
+        springs.i[n] = springs.i[s];
+        springs.j[n] = springs.j[s];
+        springs.L0[n] = springs.L0[s];
+        springs.type[n] = springs.type[s];
+        origin[n] = origin[s];
+        ++n;
+    }
+    springs.i.resize(n);
+    springs.j.resize(n);
+    springs.L0.resize(n);
+    springs.type.resize(n);
+    springs.force_x.resize(n);
+    springs.force_y.resize(n);
+    springs.force_z.resize(n);
+    origin.resize(n);
+
+    const size_t N = springs.incident_offset.size()-1;
+    int e_kept = 0;
+    for(size_t k=0; k<N; ++k) {
+        const int e_begin = springs.incident_offset[k];
+        const int e_end = springs.incident_offset[k+1];
+        springs.incident_offset[k] = e_kept;
+        for(int e=e_begin; e<e_end; ++e) {
+            const int s = index[springs.incident[e]];
+            if(s==-1 || (springs.incident_sign[e]>0? springs.i[s] : springs.j[s])!=int(k))
+                continue;
+            springs.incident[e_kept] = s;
+            springs.incident_sign[e_kept] = springs.incident_sign[e];
+            ++e_kept;
+        }
+    }
+    springs.incident_offset[N] = e_kept;
+    springs.incident.resize(size_t(e_kept));
+    springs.incident_sign.resize(size_t(e_kept));
+}
+
+static std::pair<int,int> edge_key(int a, int b)
+{
+    return a<b? std::make_pair(a,b) : std::make_pair(b,a);
+}
+
+// Break the springs stretched beyond the tearing ratio, and split the mesh at the vertices whose fan of triangles is disconnected by the torn edges
+void cloth_simulation::tear_springs()
+{
+    const size_t N_spring = springs.size();
+    const float ratio2 = user_parameters.tearing_ratio*user_parameters.tearing_ratio;
+
+    std::vector<char> broken(N_spring, 0);
+    run_parallel(N_spring, [&](size_t s_begin, size_t s_end)
+    {
+        for(size_t s=s_begin; s<s_end; ++s) {
+            const vec3& pi = position[springs.i[s]];
+            const vec3& pj = position[springs.j[s]];
+            const float dx = pj.x-pi.x, dy = pj.y-pi.y, dz = pj.z-pi.z;
+            broken[s] = dx*dx+dy*dy+dz*dz > ratio2*springs.L0[s]*springs.L0[s];
+        }
+    });
+
+    std::vector<int> candidates; // Extremities of the broken springs
+    for(size_t s=0; s<N_spring; ++s) {
+        if(broken[s]) {
+            candidates.push_back(springs.i[s]);
+            candidates.push_back(springs.j[s]);
+        }
+    }
+    if(candidates.empty())
+        return;
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    const size_t N_previous = position.size();
+    std::vector<int> spring_origin(N_spring);
+    for(size_t s=0; s<N_spring; ++s)
+        spring_origin[s] = int(s);
+
+    remove_springs(springs, broken, spring_origin);
+    tearing.springs_broken += N_spring-springs.size();
+
+    std::set<std::pair<int,int> > intact; // Extremities of the remaining springs
+    for(size_t s=0; s<springs.size(); ++s)
+        intact.insert(edge_key(springs.i[s], springs.j[s]));
+
+    std::vector<char> removed(springs.size(), 0);
+    for(const int v : candidates)
+        split_vertex(v, intact, removed);
+
+    remove_springs(springs, removed, spring_origin);
+    tearing.springs_broken += std::count(removed.begin(), removed.end(), 1);
+    update_torn_topology(N_previous, spring_origin, candidates);
+}
+
+// Duplicate the vertex v for each part of its fan of triangles disconnected from the others by torn edges
+//  intact contains the extremities of the springs, updated when a spring is attached to a duplicated vertex
+//  The springs which can't be attached to a single part of the fan are marked in removed
+void cloth_simulation::split_vertex(int v, std::set<std::pair<int,int> >& intact, std::vector<char>& removed)
+{
+    // Triangles around v, connected when their common edge (v,w) is intact
+    std::vector<int> triangles(vertex_triangles.begin()+vertex_triangles_offset[v], vertex_triangles.begin()+vertex_triangles_offset[v+1]);
+    const size_t N_tri = triangles.size();
+    std::vector<int> part(N_tri);
+    for(size_t a=0; a<N_tri; ++a)
+        part[a] = int(a);
+    auto find = [&](int a) { while(part[a]!=a) a = part[a]; return a; };
+
+    for(size_t a=0; a<N_tri; ++a) {
+        for(size_t b=a+1; b<N_tri; ++b) {
+            const uint3& fa = connectivity[triangles[a]];
+            const uint3& fb = connectivity[triangles[b]];
+            for(int ka=0; ka<3; ++ka) {
+                const int w = int(fa[ka]);
+                const bool shared = w!=v && (int(fb[0])==w || int(fb[1])==w || int(fb[2])==w);
+                if(shared && intact.count(edge_key(v,w)))
+                    part[find(int(a))] = find(int(b));
+            }
+        }
+    }
+
+    // Particle of each part: the first part keeps v
+    const int N_previous = int(position.size());
+    std::vector<int> particle(N_tri, -1);
+    int N_part = 0;
+    for(size_t a=0; a<N_tri; ++a) {
+        const int root = find(int(a));
+        if(particle[root]==-1) {
+            if(N_part>0) {
+                particle[root] = int(position.size());
+                position.push_back(position[v]);
+                speed.push_back(speed[v]);
+                force.push_back(force[v]);
+                texture_uv.push_back(texture_uv[v]);
+                grid_index.push_back(grid_index[v]);
+                normals.push_back(normals[v]);
+                sleeping.speed_previous.push_back(sleeping.speed_previous[v]);
+            }
+            else
+                particle[root] = v;
+            ++N_part;
+        }
+        particle[a] = particle[root];
+    }
+    if(N_part==1)
+        return;
+
+    // The springs of v are attached to the part containing their direction in the rest configuration
+    //  A direction along an edge belongs to the two triangles of the edge: the spring is removed if they are in different parts
+    const vec2 uv = texture_uv[v];
+    const int e_begin = springs.incident_offset[v];
+    const int e_end = springs.incident_offset[v+1];
+    std::vector<int> moved(size_t(e_end-e_begin), -1); // Duplicated particle receiving each spring of v
+    for(int e=e_begin; e<e_end; ++e)
+    {
+        const int s = springs.incident[e];
+        if(removed[s])
+            continue;
+        int& extremity = springs.incident_sign[e]>0? springs.i[s] : springs.j[s];
+        const int other = springs.incident_sign[e]>0? springs.j[s] : springs.i[s];
+        const vec2 d = texture_uv[other]-uv;
+
+        int target = -1;
+        bool ambiguous = false;
+        for(size_t a=0; a<N_tri; ++a)
+        {
+            const uint3& f = connectivity[triangles[a]];
+            const int k = int(f[0])==v? 0 : (int(f[1])==v? 1 : 2);
+            const vec2 e1 = texture_uv[f[(k+1)%3]]-uv;
+            const vec2 e2 = texture_uv[f[(k+2)%3]]-uv;
+            const float orientation = e1.x*e2.y-e1.y*e2.x;
+            const float c1 = (e1.x*d.y-e1.y*d.x)*orientation;
+            const float c2 = (d.x*e2.y-d.y*e2.x)*orientation;
+            const float epsilon = -1e-6f*orientation*orientation;
+            if(c1<epsilon || c2<epsilon)
+                continue;
+            if(target!=-1 && target!=particle[a])
+                ambiguous = true;
+            target = particle[a];
+        }
+
+        if(target==-1 || ambiguous) {
+            removed[s] = 1;
+            intact.erase(edge_key(v,other));
+        }
+        else if(target!=v) {
+            intact.erase(edge_key(v,other));
+            intact.insert(edge_key(target,other));
+            extremity = target;
+            moved[e-e_begin] = target;
+        }
+    }
+
+    // Adjacency of the duplicated particles, appended after the existing particles
+    //  The entries they replace in the lists of v are dropped by remove_springs and update_torn_topology
+    for(int p=N_previous; p<int(position.size()); ++p) {
+        for(int e=e_begin; e<e_end; ++e) {
+            if(moved[e-e_begin]!=p)
+                continue;
+            const int s = springs.incident[e];
+            const float sign = springs.incident_sign[e];
+            springs.incident.push_back(s);
+            springs.incident_sign.push_back(sign);
+        }
+        springs.incident_offset.push_back(int(springs.incident.size()));
+
+        for(size_t a=0; a<N_tri; ++a)
+            if(particle[a]==p)
+                vertex_triangles.push_back(triangles[a]);
+        vertex_triangles_offset.push_back(int(vertex_triangles.size()));
+    }
+
+    // Triangles of the other parts use the duplicated particles
+    for(size_t a=0; a<N_tri; ++a) {
+        if(particle[a]==v)
+            continue;
+        uint3& f = connectivity[triangles[a]];
+        for(int k=0; k<3; ++k)
+            if(int(f[k])==v)
+                f[k] = unsigned(particle[a]);
+        tearing.first_modified_triangle = std::min(tearing.first_modified_triangle, size_t(triangles[a]));
+    }
+}
+
+// First spring of each band
+//  Springs are listed in increasing order of their first extremity (in the grid), the particles duplicated by the tears being in the band
+//  of their original particle
+static std::vector<int> band_spring_offset(const springs_structure& springs, const std::vector<int>& grid_index, size_t band_size, size_t N_band)
+{
+    const size_t N_spring = springs.size();
+    std::vector<int> spring_offset(N_band+1, int(N_spring));
+    for(size_t s=N_spring; s>0; --s)
+        spring_offset[size_t(grid_index[springs.i[s-1]])/band_size] = int(s-1);
+    for(size_t b=N_band; b>0; --b)
+        spring_offset[b-1] = std::min(spring_offset[b-1], spring_offset[b]);
+    return spring_offset;
+}
+
+// Rebuild from scratch the data depending on the particles and the springs (used when a state is loaded)
+void cloth_simulation::update_topology()
+{
+    initialize_springs_adjacency();
+    initialize_normals();
+
+    const size_t N = position.size();
+    particles_soa.x.resize(N);
+    particles_soa.y.resize(N);
+    particles_soa.z.resize(N);
+
+    initialize_implicit_solver();
+    initialize_xpbd_solver();
+    initialize_projective_dynamics();
+    initialize_self_collision();
+    initialize_sleeping();
+    tearing.version++;
+}
+
+// Update the data depending on the particles and the springs after a tear, without rebuilding them
+//  The particles [N_previous, N[ were added by split_vertex (which appended their adjacency), spring_origin is the index of each spring
+//  before the tear, torn contains the extremities of the broken springs.
+void cloth_simulation::update_torn_topology(size_t N_previous, const std::vector<int>& spring_origin, const std::vector<int>& torn)
+{
+    const size_t N = position.size();
+
+    // Triangles moved to a duplicated particle are dropped from the list of their previous vertex
+    int e_kept = 0;
+    for(size_t k=0; k<N; ++k) {
+        const int e_begin = vertex_triangles_offset[k];
+        const int e_end = vertex_triangles_offset[k+1];
+        vertex_triangles_offset[k] = e_kept;
+        for(int e=e_begin; e<e_end; ++e) {
+            const uint3& f = connectivity[vertex_triangles[e]];
+            if(f[0]==k || f[1]==k || f[2]==k)
+                vertex_triangles[e_kept++] = vertex_triangles[e];
+        }
+    }
+    vertex_triangles_offset[N] = e_kept;
+    vertex_triangles.resize(size_t(e_kept));
+    assert_vcl(vertex_triangles.size()==3*connectivity.size(), "Inconsistent adjacency of the triangles after a tear");
+
+    particles_soa.x.resize(N);
+    particles_soa.y.resize(N);
+    particles_soa.z.resize(N);
+
+    update_implicit_solver(N_previous, spring_origin);
+    initialize_xpbd_solver();
+
+    // The Laplacian of the springs changed: the factorization of projective dynamics is outdated (it is redone at the next step of
+    //  this integrator only)
+    projective_dynamics.h = -1.0f;
+    projective_dynamics.y.resize(int(N), 3);
+    projective_dynamics.x.resize(int(N), 3);
+    projective_dynamics.x_previous.resize(int(N), 3);
+    projective_dynamics.b.resize(int(N), 3);
+    projective_dynamics.x_global.resize(int(N), 3);
+    projective_dynamics.d.resize(int(springs.size()), 3);
+
+    // The duplicated particles are inserted in the self collision grid at its next update
+
+    // Only the bands around the torn springs are woken up
+    sleeping.spring_offset = band_spring_offset(springs, grid_index, sleeping.band_size, sleeping.asleep.size());
+    const size_t N_band = sleeping.asleep.size();
+    for(const int v : torn) {
+        const size_t b = size_t(grid_index[v])/sleeping.band_size;
+        for(size_t c=(b>0? b-1 : 0); c<std::min(b+2, N_band); ++c) {
+            if(sleeping.asleep[c])
+                sleeping.bands_asleep--;
+            sleeping.asleep[c] = 0;
+            sleeping.rest_time[c] = 0.0f;
+        }
+    }
+
+    tearing.version++;
+}
+
+void cloth_simulation::hard_constraints()
+{
+    // Fixed positions of the cloth (their speed is kept null as it is used by the time step estimation)
+    for(const auto& constraints : positional_constraints) {
+        position[constraints.first] = constraints.second;
+        speed[constraints.first] = {0,0,0};
+    }
+}
+
+void cloth_simulation::initialize_sleeping()
+{
+    assert_vcl(sleeping.rows>=2, "A band of the sleeping regions needs at least 2 rows");
+    const size_t N_band = (Nu+sleeping.rows-1)/sleeping.rows;
+    sleeping.band_size = size_t(sleeping.rows)*Nv;
+
+    sleeping.spring_offset = band_spring_offset(springs, grid_index, sleeping.band_size, N_band);
+    sleeping.speed_previous = speed;
+    sleeping.asleep.assign(N_band, 0);
+    sleeping.rest_time.assign(N_band, 0.0f);
+    sleeping.bands_asleep = 0;
+    prepare_sleeping();
+}
+
+bool cloth_simulation::sleeping_active() const
+{
+    return user_parameters.sleeping && user_parameters.integrator==EXPLICIT_EULER;
+}
+
+// Called at the beginning of a step: wake up all the bands if the obstacle, the parameters or the constraints changed since
+//  the previous step (or if sleeping is disabled), and store the speed used to measure the acceleration of the particles
+void cloth_simulation::prepare_sleeping()
+{
+    auto same = [](const vec3& a, const vec3& b) { return a.x==b.x && a.y==b.y && a.z==b.z; };
+
+    const user_parameters_structure& p0 = sleeping.user_parameters;
+    const user_parameters_structure& p1 = user_parameters;
+    bool changed = !sleeping_active();
+    changed |= !same(sleeping.sphere_p, collision_shapes.sphere_p) || sleeping.sphere_r!=collision_shapes.sphere_r;
+    changed |= sleeping.ground_height!=collision_shapes.ground_height || sleeping.collider!=collision_shapes.collider;
+    changed |= p0.K!=p1.K || p0.m!=p1.m || p0.mu!=p1.mu || p0.wind!=p1.wind || p0.integrator!=p1.integrator;
+    changed |= sleeping.positional_constraints.size()!=positional_constraints.size();
+    for(auto it0=sleeping.positional_constraints.begin(), it1=positional_constraints.begin(); !changed && it1!=positional_constraints.end(); ++it0, ++it1)
+        changed = it0->first!=it1->first || !same(it0->second, it1->second);
+
+    if(changed && sleeping.bands_asleep>0) {
+        std::fill(sleeping.asleep.begin(), sleeping.asleep.end(), 0);
+        std::fill(sleeping.rest_time.begin(), sleeping.rest_time.end(), 0.0f);
+        sleeping.bands_asleep = 0;
+    }
+
+    sleeping.sphere_p = collision_shapes.sphere_p;
+    sleeping.sphere_r = collision_shapes.sphere_r;
+    sleeping.ground_height = collision_shapes.ground_height;
+    sleeping.collider = collision_shapes.collider;
+    sleeping.user_parameters = user_parameters;
+    if(changed)
+        sleeping.positional_constraints = positional_constraints;
+
+    if(sleeping_active())
+        sleeping.speed_previous = speed;
+}
+
+void cloth_simulation::update_sleeping(float h)
+{
+    if(!sleeping_active())
+        return;
+
+    const size_t N = position.size();
+    const size_t N_band = sleeping.asleep.size();
+    const size_t N_grid = Nu*Nv;
+    const float v2 = sleeping.speed_threshold*sleeping.speed_threshold;
+    const float dv2 = h*h*sleeping.acceleration_threshold*sleeping.acceleration_threshold;
+
+    // Speed and acceleration of the particles of the awake bands
+    //  The acceleration is measured on the speed change over the whole step: the forces of a particle lying on an obstacle are not
+    //  balanced, but the collisions keep it at rest
+    std::vector<char> at_rest(N_band, 1);
+    std::vector<char> moving(N_band, 0);
+    auto check_particle = [&](size_t k, size_t b) {
+        const float speed2 = dot(speed[k],speed[k]);
+        const vec3 dv = speed[k]-sleeping.speed_previous[k];
+        moving[b] |= speed2>v2;
+        at_rest[b] &= speed2<=v2 && dot(dv,dv)<=dv2;
+    };
+    run_parallel(N_band, [&](size_t b_begin, size_t b_end)
+    {
+        for(size_t b=b_begin; b<b_end; ++b)
+        {
+            if(sleeping.asleep[b])
+                continue;
+            const size_t k_end = std::min(N_grid, (b+1)*sleeping.band_size);
+            for(size_t k=b*sleeping.band_size; k<k_end; ++k)
+                check_particle(k, b);
+        }
+    });
+    // Particles duplicated by the tears belong to the band of their original particle
+    for(size_t k=N_grid; k<N; ++k) {
+        const size_t b = size_t(grid_index[k])/sleeping.band_size;
+        if(!sleeping.asleep[b])
+            check_particle(k, b);
+    }
+
+    const std::vector<char> asleep_previous = sleeping.asleep;
+    for(size_t b=0; b<N_band; ++b)
+    {
+        if(asleep_previous[b]) {
+            const bool moving_neighbor = (b>0 && moving[b-1]) || (b+1<N_band && moving[b+1]);
+            if(moving_neighbor) {
+                sleeping.asleep[b] = 0;
+                sleeping.rest_time[b] = 0.0f;
+                sleeping.bands_asleep--;
+            }
+            continue;
+        }
+
+        sleeping.rest_time[b] = at_rest[b]? sleeping.rest_time[b]+h : 0.0f;
+        if(sleeping.rest_time[b]>=sleeping.time_window) {
+            sleeping.asleep[b] = 1;
+            sleeping.bands_asleep++;
+            const size_t k_end = std::min(N_grid, (b+1)*sleeping.band_size);
+            for(size_t k=b*sleeping.band_size; k<k_end; ++k)
+                speed[k] = {0,0,0};
+        }
+    }
+    for(size_t k=N_grid; k<N; ++k)
+        if(asleep(k))
+            speed[k] = {0,0,0};
+}
+
+// Automatic detection of divergence: stop the simulation if detected
+void cloth_simulation::detect_simulation_divergence()
+{
+    const size_t NN = position.size();
+    for(size_t k=0; simulation_diverged==false && k<NN; ++k)
+    {
+        if(asleep(k))
+            continue;
+        const float f = norm(force[k]);
+        const vec3& p = position[k];
+
+        if( std::isnan(f) ) // detect NaN in force
+        {
+            std::cout<<"NaN detected in forces"<<std::endl;
+            simulation_diverged = true;
+        }
+
+        if( f>1000.0f ) // detect strong force magnitude
+        {
+            std::cout<<" **** Warning : Strong force magnitude detected "<<f<<" at vertex "<<k<<" ****"<<std::endl;
+            simulation_diverged = true;
+        }
+
+        if( std::isnan(p.x) || std::isnan(p.y) || std::isnan(p.z) ) // detect NaN in position
+        {
+            std::cout<<"NaN detected in positions"<<std::endl;
+            simulation_diverged = true;
+        }
+
+        if(simulation_diverged==true)
+        {
+            std::cerr<<" **** Simulation has diverged **** "<<std::endl;
+            std::cerr<<" > Stop simulation iterations"<<std::endl;
+        }
+    }
+
+}
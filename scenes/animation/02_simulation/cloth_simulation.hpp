@@ -0,0 +1,338 @@
+#pragma once
+
+// Simulation of the cloth, independent of the rendering (no OpenGL or GUI dependency)
+//  Used by the cloth scene, and by the headless benchmark (headless/main_headless.cpp)
+
+#include "vcl/base/base.hpp"
+#include "vcl/math/math.hpp"
+#include "vcl/containers/containers.hpp"
+#include "vcl/shape/mesh/mesh_structure/mesh.hpp"
+#include "vcl/shape/spatial_hash/spatial_hash.hpp"
+#include "vcl/shape/sdf_grid/sdf_grid.hpp"
+
+#include "cloth_multigrid/cloth_multigrid.hpp"
+
+#include <Eigen/Sparse>
+#include <map>
+#include <set>
+#include <functional>
+
+// Time integration scheme used to advance the cloth
+enum integrator_type { EXPLICIT_EULER = 0, IMPLICIT_EULER = 1, XPBD = 2, PROJECTIVE_DYNAMICS = 3 };
+
+struct user_parameters_structure
+{
+    float m;    // Global mass (to be divided by the number of particles)
+    float K;    // Global stiffness (to be divided by the number of particles)
+    float mu;   // Damping
+    float wind; // Wind magnitude;
+    integrator_type integrator; // Explicit (small substeps) or implicit (one large step per frame) integration
+    int xpbd_iterations;        // Number of constraint projection iterations per step of the XPBD solver
+    bool self_collision;        // Prevent the cloth from passing through itself
+    bool adaptive_time_step;    // Choose the substeps from the stability limit instead of a fixed number of steps
+    float frame_budget;         // Maximal time spent in the simulation per frame when adaptive (ms)
+    bool multigrid;             // Solve the implicit system with the multigrid preconditioned conjugate gradient
+    int pd_iterations;          // Number of local/global iterations per step of the projective dynamics solver
+    bool chebyshev;             // Chebyshev acceleration of the projective dynamics iterations
+    float chebyshev_rho;        // Estimated spectral radius of the projective dynamics iterations (used by the acceleration)
+    bool sleeping;              // Skip the regions of the cloth at rest (explicit integrator)
+    bool tearing;               // Break the springs stretched beyond tearing_ratio times their rest length
+    float tearing_ratio;
+};
+
+// Substepping performed during the last frame (displayed in the GUI)
+struct time_stepping_structure
+{
+    int substeps;          // Number of substeps performed
+    int substeps_required; // Number of substeps needed to cover the elapsed time (larger than substeps if the budget is exceeded)
+    float h;               // Substep size
+    float compute_time;    // Time spent in the simulation (ms)
+};
+
+struct simulation_parameters_structure
+{
+    float m;  // mass
+    float L0; // spring rest length
+};
+
+// Obstacle colliding with the cloth (in addition to the ground)
+enum collider_type { SPHERE_COLLIDER = 0, MESH_COLLIDER = 1 };
+
+// Sphere and ground used for collision
+struct collision_shapes_structure
+{
+    vcl::vec3 sphere_p;  // position of the colliding sphere
+    float sphere_r;      // radius of the colliding sphere
+    float ground_height; // height of the ground (in y-coordinate)
+
+    collider_type collider; // Analytic sphere, or mesh obstacle described by its distance field
+    vcl::sdf_grid obstacle; // Distance field of the mesh obstacle
+};
+
+// Springs of the cloth stored as flat arrays (one entry per spring), built once at initialization
+enum spring_type { STRUCTURAL = 0, SHEARING = 1, BENDING = 2 };
+struct springs_structure
+{
+    std::vector<int> i;            // Index of the first extremity
+    std::vector<int> j;            // Index of the second extremity
+    std::vector<float> L0;         // Rest length
+    std::vector<spring_type> type; // Stiffness class
+
+    // Force applied by the spring on its first extremity (opposite on the second one)
+    std::vector<float> force_x;
+    std::vector<float> force_y;
+    std::vector<float> force_z;
+
+    // Springs adjacent to each particle (compressed storage: springs of particle k are stored in [incident_offset[k], incident_offset[k+1][)
+    std::vector<int> incident_offset;
+    std::vector<int> incident;          // Index of the spring
+    std::vector<float> incident_sign;   // +1 if the particle is the first extremity of the spring, -1 otherwise
+
+    size_t size() const { return i.size(); }
+};
+
+// Structure of arrays copy of the particles used by the vectorized (SIMD) force kernels
+struct particles_soa_structure
+{
+    std::vector<float> x;      // Positions
+    std::vector<float> y;
+    std::vector<float> z;
+};
+
+// Data of the implicit (backward Euler) integrator
+//  The system (M - h dF/dv - h^2 dF/dx) dv = h (F + h dF/dx v) is assembled in a sparse matrix whose
+//  sparsity pattern is built once: each step only overwrites its values through the stored offsets. The tears only append the blocks
+//  of the duplicated particles to the pattern.
+struct implicit_solver_structure
+{
+    Eigen::SparseMatrix<float> A; // System matrix (3N x 3N)
+    Eigen::VectorXf b;            // Right hand side
+    Eigen::VectorXf dv;           // Velocity increment - kept between steps as initial guess of the next solve
+    Eigen::ConjugateGradient<Eigen::SparseMatrix<float>, Eigen::Lower|Eigen::Upper> cg; // Jacobi preconditioned CG
+    cloth_multigrid multigrid;                                                            // Multigrid preconditioned CG (high resolutions)
+    bool multigrid_available;                                                             // The cloth is still a regular grid
+
+    std::vector<int> offset_diagonal; // Offset in A.valuePtr() of the 3 columns of the diagonal block of each particle
+    std::vector<int> offset_spring;   // Offset of the 3 columns of blocks (i,j) then (j,i) for each spring
+    std::vector<bool> pinned;         // Particles with a positional constraint (velocity increment forced to 0)
+
+    int iterations; // Number of CG iterations of the last solve
+    float error;    // Residual error of the last solve
+};
+
+// Data of the extended position based dynamics (XPBD) solver
+//  Each spring of the cloth is used as a constraint |pi-pj| = L0: the structural and shearing springs are the distance constraints,
+//  the bending springs (between second neighbors) are the bending constraints. The compliance of the constraints is 1/K.
+struct xpbd_solver_structure
+{
+    vcl::buffer<vcl::vec3> position_previous; // Position at the beginning of the step (used to recover the speed)
+    std::vector<float> inverse_mass;          // Inverse mass of each particle (0 for the particles with a positional constraint)
+    std::vector<float> lambda;                // Lagrange multiplier of each constraint, accumulated over the iterations of one step
+};
+
+// Data of the projective dynamics solver
+//  Each step minimizes the sum of the inertia |x-y|_M^2/(2h^2) (y: position predicted from the speed and the external forces)
+//  and of the spring energies K/2 |(xj-xi) - d_s|^2, where d_s is a vector of length L0, by alternating
+//  - a local step: d_s is the projection of xj-xi on the vectors of length L0 (independent for each spring)
+//  - a global step: (M + h^2 K L) x = M y + h^2 K J d, where L is the Laplacian of the springs graph. The matrix is the same
+//    for the 3 coordinates and doesn't depend on the positions: it is factorized once, and refactorized only when K, m, h or
+//    the pinned particles change. The pinned particles are eliminated (identity rows).
+//  The iterates can be accelerated with the Chebyshev semi-iterative method (Wang, A Chebyshev semi-iterative approach for
+//  accelerating projective and position-based dynamics, 2015).
+struct projective_dynamics_structure
+{
+    Eigen::SparseMatrix<float> A;                              // System matrix of the global step (N x N)
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<float> > solver; // Prefactorized A
+    float K, m, h;                                             // Parameters of the current factorization (h<=0 if not factorized)
+    std::vector<bool> pinned;                                  // Pinned particles of the current factorization
+    size_t pinned_count;                                       // Number of pinned particles (size of the constraints they were built from)
+    int factorizations;                                        // Number of factorizations since the initialization
+
+    Eigen::Matrix<float,Eigen::Dynamic,3> y;              // Inertial prediction of the positions
+    Eigen::Matrix<float,Eigen::Dynamic,3> x;              // Current iterate
+    Eigen::Matrix<float,Eigen::Dynamic,3> x_previous;     // Previous iterate (Chebyshev acceleration)
+    Eigen::Matrix<float,Eigen::Dynamic,3> b;              // Right hand side of the global step
+    Eigen::Matrix<float,Eigen::Dynamic,3> x_global;       // Solution of the global step
+    Eigen::Matrix<float,Eigen::Dynamic,3> d;              // Projected springs (local step)
+};
+
+// Self-collision of the cloth: each particle is kept at a distance 'thickness' from the other particles and from the triangles of the cloth
+//  Candidates are found with a spatial hash grid of the particles updated at each step.
+//  Particles close to each other in the grid of the cloth (topological neighbors) are never considered as colliding.
+struct self_collision_structure
+{
+    vcl::spatial_hash grid;
+    float thickness;
+    vcl::buffer<vcl::vec3> position; // Positions and speeds before the collision pass (read by all the particles)
+    vcl::buffer<vcl::vec3> speed;
+
+    // Candidate triangles of the current particle, one buffer per range of particles processed in parallel
+    std::vector<std::vector<int>> triangles;
+    std::vector<std::vector<char>> triangle_visited; // 1 for the triangles already in the candidates (cleared after each particle)
+};
+
+// Sleeping regions of the cloth at rest (explicit integrator only: the other integrators solve a system coupling all the particles)
+//  The cloth is split in bands of rows of the grid: the particles and the springs (listed from their first extremity) of a band are contiguous.
+//  A band falls asleep when the speed and the acceleration of all its particles remained below the thresholds during a time window:
+//  its speeds are set to 0 and its particles are skipped by the forces, integration and collision passes (they act as fixed particles
+//  for their awake neighbors). A band wakes up when a particle of an adjacent band moves faster than the threshold, and all the bands
+//  wake up when the obstacle, the parameters or the positional constraints change.
+struct sleeping_structure
+{
+    int rows;                     // Number of rows of the grid per band (at least 2: a spring spans at most 2 rows)
+    float speed_threshold;        // (m/s)
+    float acceleration_threshold; // (m/s^2)
+    float time_window;            // Time spent at rest before falling asleep (s)
+
+    size_t band_size;               // Number of particles per band
+    std::vector<int> spring_offset; // Springs whose first extremity is in band b: [spring_offset[b], spring_offset[b+1][
+    std::vector<char> asleep;       // State of each band
+    std::vector<float> rest_time;   // Time spent at rest by each band
+    int bands_asleep;
+    vcl::buffer<vcl::vec3> speed_previous; // Speed at the beginning of the step
+
+    // State at the previous step, any change wakes up all the bands
+    vcl::vec3 sphere_p;
+    float sphere_r;
+    float ground_height;
+    collider_type collider;
+    user_parameters_structure user_parameters;
+    std::map<int,vcl::vec3> positional_constraints;
+};
+
+// Tearing of the cloth: the overstretched springs are removed from the lists in place, and the vertices whose fan of triangles is
+//  disconnected by the torn edges are duplicated (one particle per connected part of the fan). The duplicated particles are added
+//  after the existing ones and the triangles are modified in place: the rendering only updates the changed ranges of its buffers.
+//  The adjacency, the solvers, the self collision grid and the sleeping bands are updated in place (update_torn_topology).
+struct tearing_structure
+{
+    size_t springs_broken = 0;                         // Number of springs removed since the initialization
+    size_t first_modified_triangle = size_t(-1);       // Smallest index of a triangle modified since the last reset by the rendering
+    int version = 0;                                   // Incremented at each change of the topology
+};
+
+// Time spent in each phase of the simulation, accumulated over the substeps since the last reset (s)
+struct cloth_timings_structure
+{
+    double forces;         // compute_forces
+    double integration;    // numerical_integration (including the constraints projection of XPBD and the solver of projective dynamics)
+    double collisions;     // collision_constraints
+    double self_collision; // self_collision_constraints
+    double constraints;    // hard_constraints, sleeping, triangle normals and divergence detection
+    size_t steps;          // Number of substeps
+};
+
+struct cloth_simulation
+{
+    // Particles parameters
+    //  The Nu x Nv particles of the grid of the initial cloth are followed by the particles duplicated by the tears
+    vcl::buffer<vcl::vec3> position;
+    vcl::buffer<vcl::vec3> speed;
+    vcl::buffer<vcl::vec3> force;
+    size_t Nu, Nv;                     // Size of the grid of the initial cloth
+    std::vector<int> grid_index;       // Particle of the grid from which each particle comes (itself for the particles of the grid)
+    vcl::buffer<vcl::vec2> texture_uv; // Texture coordinates of the particles, also used as rest configuration of the cloth
+
+    // Simulation parameters
+    simulation_parameters_structure simulation_parameters; // parameters that user can control directly
+    user_parameters_structure user_parameters;             // parameters adjusted with respect to mesh size (not controled directly by the user)
+    float current_magnitude;                               // Wind magnitude at the current step
+
+    // Cloth mesh elements
+    vcl::buffer<vcl::vec3> normals;        // Vertex normals of the cloth used for rendering (updated once per frame)
+    vcl::buffer<vcl::uint3> connectivity;  // Connectivity of the triangular model
+    vcl::buffer<vcl::vec3> triangle_normals;   // Normal of each triangle (cache updated at each simulation step)
+    std::vector<int> vertex_triangles_offset;  // Triangles adjacent to each vertex (compressed storage similar to springs.incident)
+    std::vector<int> vertex_triangles;
+
+    // Parameters of the shape used for collision
+    collision_shapes_structure collision_shapes;
+
+    // Store index and position of vertices constrained to have a fixed 3D position
+    std::map<int,vcl::vec3> positional_constraints;
+
+    // Spring topology of the cloth
+    springs_structure springs;
+
+    // Sparse system reused by the implicit integrator
+    implicit_solver_structure implicit_solver;
+
+    // Constraints solver used in XPBD mode
+    xpbd_solver_structure xpbd_solver;
+
+    // Local/global solver used in projective dynamics mode
+    projective_dynamics_structure projective_dynamics;
+
+    // Topology changes of the cloth
+    tearing_structure tearing;
+
+    // Regions of the cloth at rest
+    sleeping_structure sleeping;
+
+    // Collision of the cloth with itself
+    self_collision_structure self_collision;
+
+    // Worker threads used by the simulation passes
+    vcl::thread_pool pool;
+    size_t threads = 0;       // Size of the pool set by set_threads (0: number of hardware threads)
+    bool multithreading;
+
+    // Vectorized force computation (the scalar code remains the reference)
+    particles_soa_structure particles_soa;
+    bool simd;                // Use the vectorized kernels when the CPU supports them
+    float simd_check_error;   // Maximal difference between the vectorized and scalar forces at the last check, relative to the largest force (negative if never checked)
+
+    time_stepping_structure time_stepping;
+    cloth_timings_structure timings;
+
+    // Parameters used to control if the simulation runs when a numerical divergence is detected
+    bool simulation_diverged; // Active when divergence is detected
+    bool force_simulation;    // Force to run simulation even if divergence is detected
+
+
+    void set_default_parameters();
+    vcl::mesh initialize(size_t N_cloth);
+    bool save_state(const std::string& filename) const;
+    bool load_state(const std::string& filename);
+    static vcl::mesh obstacle_mesh();
+    void simulate(float dt, float time_scale);
+    void step(float h);
+    void reset_timings();
+    /** Restart the pool with number_of_threads threads (0: number of hardware threads), multithreading is enabled if there are several */
+    void set_threads(size_t number_of_threads);
+
+    void initialize_springs();
+    void initialize_springs_adjacency();
+    void initialize_normals();
+    void compute_triangle_normals();
+    void compute_vertex_normals();
+    void run_parallel(size_t N, const std::function<void(size_t,size_t)>& f);
+    void collision_constraints();
+    void initialize_self_collision();
+    void self_collision_constraints(float h);
+    void compute_forces();
+    vcl::vec3 wind_force(int k, const vcl::vec3& w) const;
+    /** Compare the forces computed by the vectorized kernels and by the scalar code at the current state, return their relative difference */
+    float check_simd_kernels();
+    float stable_time_step() const;
+    void numerical_integration(float h);
+    void initialize_implicit_solver();
+    void update_implicit_solver(size_t N_previous, const std::vector<int>& spring_origin);
+    void numerical_integration_implicit(float h);
+    void initialize_xpbd_solver();
+    void numerical_integration_xpbd(float h);
+    void initialize_projective_dynamics();
+    void factorize_projective_dynamics(float h);
+    void numerical_integration_projective_dynamics(float h);
+    void initialize_sleeping();
+    bool sleeping_active() const;
+    bool asleep(size_t k) const { return sleeping.bands_asleep>0 && sleeping.asleep[grid_index[k]/sleeping.band_size]!=0; }
+    void prepare_sleeping();
+    void update_sleeping(float h);
+    void tear_springs();
+    void split_vertex(int v, std::set<std::pair<int,int> >& intact, std::vector<char>& removed);
+    void update_topology();
+    void update_torn_topology(size_t N_previous, const std::vector<int>& spring_origin, const std::vector<int>& torn);
+    void detect_simulation_divergence();
+    void hard_constraints();
+};
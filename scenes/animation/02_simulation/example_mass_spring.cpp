@@ -7,32 +7,12 @@
 using namespace vcl;
 
 
-static void set_gui(timer_basic& timer);
-
-
-/** Compute spring force applied on particle pi from particle pj */
-vec3 spring_force(const vec3& pi, const vec3& pj, float L0, float K)
-{
-    vec3 const pji = pj - pi;
-    float const L = norm(pji);
-    return K * (L - L0) * pji / L;
-}
+static void set_gui(timer_basic& timer, mass_spring_simulation& simulation);
 
 
 void scene_model::setup_data(std::map<std::string,GLuint>& , scene_structure& , gui_structure& )
 {
-    // Initial position and speed of particles
-    // ******************************************* //
-    pA.p = {0,0,0};     // Initial position of particle A
-    pA.v = {0,0,0};     // Initial speed of particle A
-
-    pB.p = {0.5f,0,0};  // Initial position of particle B
-    pB.v = {0,0,0};     // Initial speed of particle B
-
-    pC.p = {1.0f, 0, 0};
-    pC.v = {0,0,0};
-
-    L0 = 0.4f; // Rest length between A and B
+    simulation.initialize();
 
 
     // Display elements
@@ -59,72 +39,32 @@ void scene_model::setup_data(std::map<std::string,GLuint>& , scene_structure& ,
 void scene_model::frame_draw(std::map<std::string,GLuint>& shaders, scene_structure& scene, gui_structure& )
 {
     timer.update();
-    set_gui(timer);
+    set_gui(timer, simulation);
 
 
     // Simulation time step (dt)
     float dt = timer.scale*0.01f;
+    simulation.compute_time_step(dt);
 
-    // Simulation parameters
-    const float m  = 0.01f;        // particle mass
-    const float K  = 5.0f;         // spring stiffness
-    const float mu = 0.005f;       // damping coefficient
-
-    //float dt = 2.0f / sqrt(K/m);
-    
-    const vec3 g   = {0,-9.81f,0}; // gravity
-
-    // Forces
-    const vec3 f_spring  = spring_force(pB.p, pA.p, L0, K);
-    const vec3 f_weight =  m * g;
-    const vec3 f_damping = pB.v * mu; // TO DO: correct this force value
-    const vec3 F = f_spring+f_weight - f_damping;
-
-    // Numerical Integration (Verlet)
-    {
-        // Only particle B should be updated
-        vec3& p = pB.p; // position of particle
-        vec3& v = pB.v; // speed of particle
-
-        p = p + dt * v;
-        v = v + dt * F / m;
-    
-        //const vec3 f2_spring  = spring_force(pC.p, pB.p, L0, K);
-        //const vec3 f2_damping = pC.v * mu;
-        //const vec3 F2 = f2_spring+f_weight - f2_damping;
-        
-        //pC.v = pC.v + dt * F2 / m;
-        //pC.p = pC.p + dt * pC.v;
-    }
-
-
+    const mass_spring_system& chain = simulation.chain;
+    const size_t N = chain.size();
 
 
     // Display of the result
 
-    // particle pa
-    sphere.uniform.transform.translation = pA.p;
-    sphere.uniform.color = {0,0,0};
-    draw(sphere, scene.camera, shaders["mesh"]);
-
-    // particle pb
-    sphere.uniform.transform.translation = pB.p;
-    sphere.uniform.color = {1,0,0};
-    draw(sphere, scene.camera, shaders["mesh"]);
-
-    // Spring pa-pb
-    segment_drawer.uniform_parameter.p1 = pA.p;
-    segment_drawer.uniform_parameter.p2 = pB.p;
-    segment_drawer.draw(shaders["segment_im"],scene.camera);
-
-
-    /*sphere.uniform.transform.translation = pC.p;
-    sphere.uniform.color = {1,1,0};
-    draw(sphere, scene.camera, shaders["mesh"]);
+    // particles: the pinned one in black
+    for(size_t k=0; k<N; ++k) {
+        sphere.uniform.transform.translation = chain.position(k);
+        sphere.uniform.color = chain.pinned[k]? vec3(0,0,0) : vec3(1,0,0);
+        draw(sphere, scene.camera, shaders["mesh"]);
+    }
 
-    segment_drawer.uniform_parameter.p1 = pB.p;
-    segment_drawer.uniform_parameter.p2 = pC.p;
-    segment_drawer.draw(shaders["segment_im"],scene.camera); */
+    // springs
+    for(size_t s=0; s<chain.spring_i.size(); ++s) {
+        segment_drawer.uniform_parameter.p1 = chain.position(chain.spring_i[s]);
+        segment_drawer.uniform_parameter.p2 = chain.position(chain.spring_j[s]);
+        segment_drawer.draw(shaders["segment_im"],scene.camera);
+    }
 
 
     draw(borders, scene.camera, shaders["curve"]);
@@ -132,7 +72,7 @@ void scene_model::frame_draw(std::map<std::string,GLuint>& shaders, scene_struct
 
 
 /** Part specific GUI drawing */
-static void set_gui(timer_basic& timer)
+static void set_gui(timer_basic& timer, mass_spring_simulation& simulation)
 {
     // Can set the speed of the animation
     float scale_min = 0.05f;
@@ -145,6 +85,15 @@ static void set_gui(timer_basic& timer)
     if (ImGui::Button("Start"))
         timer.start();
 
+    // Integration scheme of the chain
+    int integrator = simulation.integrator;
+    ImGui::RadioButton("Symplectic Euler", &integrator, SYMPLECTIC_EULER); ImGui::SameLine();
+    ImGui::RadioButton("Velocity Verlet", &integrator, VELOCITY_VERLET); ImGui::SameLine();
+    ImGui::RadioButton("RK4", &integrator, RUNGE_KUTTA_4);
+    simulation.integrator = mass_spring_integrator(integrator);
+    if (ImGui::Button("Restart"))
+        simulation.initialize();
+
 }
 
 
@@ -4,11 +4,7 @@
 
 #ifdef SCENE_MASS_SPRING_1D
 
-struct particle_element
-{
-    vcl::vec3 p; // Position
-    vcl::vec3 v; // Speed
-};
+#include "mass_spring_simulation.hpp"
 
 struct scene_model : scene_base
 {
@@ -17,10 +13,8 @@ struct scene_model : scene_base
     void frame_draw(std::map<std::string,GLuint>& shaders, scene_structure& scene, gui_structure& gui);
 
 
-    particle_element pA;
-    particle_element pB;
-    particle_element pC;
-    float L0;
+    // Physics of the particles (independent of the display)
+    mass_spring_simulation simulation;
 
 
     vcl::mesh_drawable sphere;      // Visual display of particles
@@ -0,0 +1,32 @@
+#include "mass_spring_simulation.hpp"
+
+using namespace vcl;
+
+
+void mass_spring_simulation::initialize(size_t N_particle)
+{
+    assert_vcl(N_particle>=2, "The chain needs at least two particles");
+
+    // Particles at rest, spaced by 0.5 along x: the springs start stretched
+    // ******************************************* //
+    L0 = 0.4f; // Rest length between two consecutive particles
+
+    chain.clear();
+    chain.damping = mu;
+    for(size_t k=0; k<N_particle; ++k)
+        chain.add_particle({0.5f*k,0,0}, m, k==0);
+    for(size_t k=0; k+1<N_particle; ++k)
+        chain.add_spring(k, k+1, K, L0);
+    chain.update_adjacency();
+}
+
+
+void mass_spring_simulation::compute_time_step(float dt)
+{
+    switch(integrator)
+    {
+    case SYMPLECTIC_EULER: chain.step<symplectic_euler>(dt); break;
+    case VELOCITY_VERLET:  chain.step<velocity_verlet>(dt);  break;
+    case RUNGE_KUTTA_4:    chain.step<runge_kutta_4>(dt);    break;
+    }
+}
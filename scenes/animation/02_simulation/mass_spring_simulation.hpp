@@ -0,0 +1,26 @@
+#pragma once
+
+// Simulation of the 1D mass spring example, independent of the rendering (no OpenGL or GUI dependency)
+//  Used by the mass spring scene, and by the headless benchmark (headless/main_headless.cpp)
+
+#include "vcl/math/math.hpp"
+#include "vcl/simulation/mass_spring_system/mass_spring_system.hpp"
+
+// Time integration scheme of the chain
+enum mass_spring_integrator { SYMPLECTIC_EULER = 0, VELOCITY_VERLET = 1, RUNGE_KUTTA_4 = 2 };
+
+struct mass_spring_simulation
+{
+    // Chain of particles along x, hanging from the first one (pinned)
+    vcl::mass_spring_system chain;
+    float L0;
+
+    // Simulation parameters (applied at the initialization)
+    float m  = 0.01f;  // particle mass
+    float K  = 5.0f;   // spring stiffness
+    float mu = 0.005f; // damping coefficient
+    mass_spring_integrator integrator = SYMPLECTIC_EULER;
+
+    void initialize(size_t N_particle=3);
+    void compute_time_step(float dt);
+};
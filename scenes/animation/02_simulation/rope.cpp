@@ -0,0 +1,114 @@
+#include "rope.hpp"
+
+
+#ifdef SCENE_ROPE
+
+using namespace vcl;
+
+
+// Initialize the rope and its visual model
+void scene_model::initialize()
+{
+    simulation.N = size_t(gui_particles);
+    simulation.stiffness = gui_stiffness;
+    simulation.initialize();
+
+    // The buffer of the curve is allocated once for the number of particles, then updated in place
+    //  (the buffers of the previous rope are released on restart)
+    const size_t N = simulation.rope.size();
+    rope_positions.resize(N);
+    for(size_t k=0; k<N; ++k)
+        rope_positions[k] = simulation.rope.position(k);
+    rope_curve.clear();
+    rope_curve = curve_drawable(rope_positions);
+    rope_curve.uniform.color = {0,0,0};
+
+    anchor.uniform.transform.translation = simulation.rope.position(0);
+    explicit_substeps = 0;
+    timer.update();
+}
+
+void scene_model::setup_data(std::map<std::string,GLuint>& shaders, scene_structure& , gui_structure& gui)
+{
+    gui.show_frame_camera = false;
+
+    anchor = mesh_primitive_sphere();
+    anchor.shader = shaders["mesh"];
+    anchor.uniform.transform.scaling = 0.02f;
+    anchor.uniform.color = {1,0,0};
+
+    gui_particles = int(simulation.N);
+    gui_stiffness = simulation.stiffness;
+    initialize();
+}
+
+void scene_model::frame_draw(std::map<std::string,GLuint>& shaders, scene_structure& scene, gui_structure& )
+{
+    // Steps of fixed size (the time scale slows down the motion): the implicit integrator only needs one step per frame
+    float dt = timer.update();
+    if(dt>0)
+        dt = timer.scale*0.01f;
+    set_gui();
+
+    if(dt>0)
+    {
+        if(simulation.integrator==ROPE_IMPLICIT)
+            simulation.compute_time_step(dt);
+        else {
+            // Substeps below the stability limit: the cost grows with the number of particles and the stiffness
+            const float h = simulation.explicit_time_step();
+            explicit_substeps = std::min(int(std::ceil(dt/h)), max_explicit_substeps);
+            for(int k=0; k<explicit_substeps; ++k)
+                simulation.compute_time_step(h);
+        }
+    }
+
+    // Single update of the buffer of the curve per frame
+    const size_t N = simulation.rope.size();
+    for(size_t k=0; k<N; ++k)
+        rope_positions[k] = simulation.rope.position(k);
+    rope_curve.data.update_position(rope_positions);
+
+    draw(rope_curve, scene.camera, shaders["curve"]);
+    draw(anchor, scene.camera, shaders["mesh"]);
+}
+
+void scene_model::set_gui()
+{
+    ImGui::SliderFloat("Time scale", &timer.scale, 0.05f, 2.0f, "%.2f s");
+
+    int integrator = simulation.integrator;
+    ImGui::RadioButton("Implicit", &integrator, ROPE_IMPLICIT); ImGui::SameLine();
+    ImGui::RadioButton("Explicit", &integrator, ROPE_SYMPLECTIC_EULER);
+    simulation.integrator = rope_integrator(integrator);
+    if(simulation.integrator==ROPE_IMPLICIT)
+        ImGui::SliderInt("Newton iterations", &simulation.solver.iterations, 1, 50);
+
+    // Statistics of the last step
+    const rope_timings_structure& t = simulation.timings;
+    if(t.steps>0)
+        ImGui::Text("Step: %.3f ms (solve %.3f ms)", 1e3*(t.prediction+t.solve+t.update)/double(t.steps), 1e3*t.solve/double(t.steps));
+    if(simulation.integrator==ROPE_IMPLICIT)
+        ImGui::Text("Newton: %d iterations, %d halvings, residual %.1e", simulation.solver.iterations_done, simulation.solver.line_search, simulation.solver.residual);
+    else if(explicit_substeps==max_explicit_substeps)
+        ImGui::Text("Explicit: %d substeps (limited, the motion is slowed down)", explicit_substeps);
+    else
+        ImGui::Text("Explicit: %d substeps", explicit_substeps);
+    ImGui::Text("Max stretch: %.3f %%", double(100*simulation.max_stretch()));
+    if(ImGui::Button("Reset timings"))
+        simulation.reset_timings();
+
+    bool const stop  = ImGui::Button("Stop anim"); ImGui::SameLine();
+    bool const start = ImGui::Button("Start anim");
+    if(stop)  timer.stop();
+    if(start) timer.start();
+
+    // Applied on restart
+    const int particles_min = 10, particles_max = 1000000;
+    ImGui::SliderScalar("Particles", ImGuiDataType_S32, &gui_particles, &particles_min, &particles_max, "%d", 4.0f);
+    ImGui::SliderFloat("Stiffness", &gui_stiffness, 10.0f, 1e5f, "%.0f", 4.0f);
+    bool const restart = ImGui::Button("Restart");
+    if(restart) initialize();
+}
+
+#endif
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "main/scene_base/base.hpp"
+
+#ifdef SCENE_ROPE
+
+#include "rope_simulation.hpp"
+
+struct scene_model : scene_base
+{
+    // Physics of the rope (independent of the display)
+    rope_simulation simulation;
+
+    // Visual model of the rope: a line strip through the particles, its buffer is updated once per frame
+    vcl::curve_drawable rope_curve;
+    std::vector<vcl::vec3> rope_positions; // Positions sent to the GPU (float copy of the simulation)
+    vcl::mesh_drawable anchor;
+
+    // Gui parameters
+    int gui_particles;     // Number of particles of the rope, applied on restart
+    float gui_stiffness;   // Axial stiffness, applied on restart
+    int explicit_substeps; // Number of explicit steps of the last frame (limited to max_explicit_substeps)
+    const int max_explicit_substeps = 500;
+
+    vcl::timer_event timer;
+
+    void initialize();
+    void set_gui();
+
+    void setup_data(std::map<std::string,GLuint>& shaders, scene_structure& scene, gui_structure& gui);
+    void frame_draw(std::map<std::string,GLuint>& shaders, scene_structure& scene, gui_structure& gui);
+};
+
+#endif
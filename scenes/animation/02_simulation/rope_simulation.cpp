@@ -0,0 +1,293 @@
+#include "rope_simulation.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace vcl;
+
+
+void rope_simulation::initialize()
+{
+    assert_vcl(N>=2, "The rope needs at least two particles");
+
+    // Horizontal rope at rest, hanging from its first particle
+    const double L0 = double(length)/double(N-1);
+    rope.clear();
+    rope.damping = damping/float(N);
+    for(size_t k=0; k<N; ++k)
+        rope.add_particle(L0*double(k) - 0.5*length, 0.5, 0.0, double(mass)/double(N), k==0);
+    for(size_t k=0; k+1<N; ++k)
+        rope.add_spring(k, k+1, stiffness/L0, L0);
+    rope.update_adjacency();
+
+    solver.x_previous.resize(N);  solver.y_previous.resize(N);  solver.z_previous.resize(N);
+    solver.x_target.resize(N);    solver.y_target.resize(N);    solver.z_target.resize(N);
+    solver.upper.resize(9*N);
+    solver.rhs.resize(3*N);
+    solver.residual = 0;
+    reset_timings();
+}
+
+void rope_simulation::reset_timings()
+{
+    timings = rope_timings_structure();
+}
+
+void rope_simulation::compute_time_step(float dt)
+{
+    if(integrator==ROPE_IMPLICIT) {
+        step_implicit(dt);
+        return;
+    }
+
+    const auto t0 = std::chrono::steady_clock::now();
+    rope.step<symplectic_euler>(dt);
+    timings.update += std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+    timings.steps++;
+}
+
+// 3x3 blocks of the Newton system, stored by rows
+namespace
+{
+struct block3
+{
+    double a[9];
+};
+
+block3 spring_hessian(double K, double nx, double ny, double nz, double c)
+{
+    // K (n n^T + c (I - n n^T)), c being the clamped transverse stiffness ratio 1-L0/L
+    const double n[3] = {nx, ny, nz};
+    block3 H;
+    for(int i=0; i<3; ++i)
+        for(int j=0; j<3; ++j)
+            H.a[3*i+j] = K*((1-c)*n[i]*n[j] + (i==j? c : 0.0));
+    return H;
+}
+
+block3 inverse(const block3& M)
+{
+    const double* m = M.a;
+    block3 R;
+    R.a[0] = m[4]*m[8]-m[5]*m[7];  R.a[1] = m[2]*m[7]-m[1]*m[8];  R.a[2] = m[1]*m[5]-m[2]*m[4];
+    R.a[3] = m[5]*m[6]-m[3]*m[8];  R.a[4] = m[0]*m[8]-m[2]*m[6];  R.a[5] = m[2]*m[3]-m[0]*m[5];
+    R.a[6] = m[3]*m[7]-m[4]*m[6];  R.a[7] = m[1]*m[6]-m[0]*m[7];  R.a[8] = m[0]*m[4]-m[1]*m[3];
+    const double det = m[0]*R.a[0] + m[1]*R.a[3] + m[2]*R.a[6];
+    for(double& r : R.a)
+        r /= det;
+    return R;
+}
+
+block3 product(const block3& A, const block3& B)
+{
+    block3 R;
+    for(int i=0; i<3; ++i)
+        for(int j=0; j<3; ++j)
+            R.a[3*i+j] = A.a[3*i]*B.a[j] + A.a[3*i+1]*B.a[3+j] + A.a[3*i+2]*B.a[6+j];
+    return R;
+}
+}
+
+void rope_simulation::step_implicit(float dt)
+{
+    typedef std::chrono::steady_clock clock;
+    auto seconds = [](clock::time_point a, clock::time_point b) { return std::chrono::duration<double>(b-a).count(); };
+    const clock::time_point t0 = clock::now();
+
+    assert_vcl(chain_topology(), "The implicit solver of the rope expects the springs (k,k+1) in order");
+    const size_t N_particle = rope.size();
+    const size_t N_spring = N_particle-1;
+    const double h = dt;
+    double* px = rope.px.data(); double* py = rope.py.data(); double* pz = rope.pz.data();
+    double* vx = rope.vx.data(); double* vy = rope.vy.data(); double* vz = rope.vz.data();
+    const double gx = rope.gravity.x, gy = rope.gravity.y, gz = rope.gravity.z;
+    const double mu = rope.damping;
+
+    // Prediction with the external forces (gravity and drag), used as the initial guess of the Newton iterations
+    for(size_t k=0; k<N_particle; ++k)
+    {
+        solver.x_previous[k] = px[k];  solver.y_previous[k] = py[k];  solver.z_previous[k] = pz[k];
+        if(!rope.pinned[k]) {
+            const double c = h/rope.mass[k];
+            vx[k] += h*gx - c*mu*vx[k];  vy[k] += h*gy - c*mu*vy[k];  vz[k] += h*gz - c*mu*vz[k];
+            px[k] += h*vx[k];            py[k] += h*vy[k];            pz[k] += h*vz[k];
+        }
+        solver.x_target[k] = px[k];  solver.y_target[k] = py[k];  solver.z_target[k] = pz[k];
+    }
+    const clock::time_point t1 = clock::now();
+
+    double* upper = solver.upper.data();
+    double* rhs = solver.rhs.data();
+    solver.line_search = 0;
+    solver.iterations_done = 0;
+    for(int iteration=0; iteration<solver.iterations; ++iteration)
+    {
+        // Forward elimination, row k: D_k = m_k/h^2 I + H_{k-1} + H_k, B_{k-1} = -H_{k-1}, B_k = -H_k, right hand side -grad E
+        //  The rows of the pinned particles are replaced by dx_k = 0
+        block3 H_previous = block3();
+        double f_previous[3] = {0, 0, 0};   // Force of the spring k-1 on the particle k-1
+        for(size_t k=0; k<N_particle; ++k)
+        {
+            block3 H = block3();
+            double f[3] = {0, 0, 0};
+            if(k<N_spring) {
+                const double dx = px[k+1]-px[k], dy = py[k+1]-py[k], dz = pz[k+1]-pz[k];
+                const double L = std::sqrt(dx*dx+dy*dy+dz*dz);
+                if(L>0) {
+                    const double K = rope.spring_K[k], L0 = rope.spring_L0[k];
+                    const double a = K*(L-L0)/L;
+                    f[0] = a*dx;  f[1] = a*dy;  f[2] = a*dz;
+                    H = spring_hessian(K, dx/L, dy/L, dz/L, std::max(0.0, 1-L0/L));
+                }
+            }
+
+            const bool fixed = rope.pinned[k];
+            const bool coupled_previous = k>0 && !fixed && !rope.pinned[k-1];
+            const bool coupled_next = k<N_spring && !fixed && !rope.pinned[k+1];
+            double* r = rhs + 3*k;
+            block3 D = block3();
+            if(fixed) {
+                D.a[0] = D.a[4] = D.a[8] = 1;
+                r[0] = r[1] = r[2] = 0;
+            }
+            else {
+                const double m = rope.mass[k]/(h*h);
+                for(int i=0; i<9; ++i)
+                    D.a[i] = H_previous.a[i] + H.a[i];
+                D.a[0] += m;  D.a[4] += m;  D.a[8] += m;
+                r[0] = -m*(px[k]-solver.x_target[k]) - f_previous[0] + f[0];
+                r[1] = -m*(py[k]-solver.y_target[k]) - f_previous[1] + f[1];
+                r[2] = -m*(pz[k]-solver.z_target[k]) - f_previous[2] + f[2];
+            }
+
+            // Elimination of the coupling with the previous row: D_k -= B_{k-1} C_{k-1}, r_k -= B_{k-1} d_{k-1}
+            if(coupled_previous) {
+                const double* C = upper + 9*(k-1);
+                const double* d = rhs + 3*(k-1);
+                for(int i=0; i<3; ++i) {
+                    for(int j=0; j<3; ++j)
+                        D.a[3*i+j] += H_previous.a[3*i]*C[j] + H_previous.a[3*i+1]*C[3+j] + H_previous.a[3*i+2]*C[6+j];
+                    r[i] += H_previous.a[3*i]*d[0] + H_previous.a[3*i+1]*d[1] + H_previous.a[3*i+2]*d[2];
+                }
+            }
+
+            // d_k = D_k^-1 r_k and C_k = D_k^-1 B_k
+            const block3 D_inverse = inverse(D);
+            const double r0 = r[0], r1 = r[1], r2 = r[2];
+            for(int i=0; i<3; ++i)
+                r[i] = D_inverse.a[3*i]*r0 + D_inverse.a[3*i+1]*r1 + D_inverse.a[3*i+2]*r2;
+            double* C = upper + 9*k;
+            if(coupled_next) {
+                const block3 DH = product(D_inverse, H);
+                for(int i=0; i<9; ++i)
+                    C[i] = -DH.a[i];
+            }
+            else {
+                for(int i=0; i<9; ++i)
+                    C[i] = 0;
+            }
+
+            H_previous = H;
+            f_previous[0] = f[0];  f_previous[1] = f[1];  f_previous[2] = f[2];
+        }
+
+        // Back substitution: dx_k = d_k - C_k dx_{k+1}
+        double largest = 0;
+        for(size_t k=N_particle; k-->0;)
+        {
+            double* d = rhs + 3*k;
+            if(k+1<N_particle) {
+                const double* C = upper + 9*k;
+                const double* next = rhs + 3*(k+1);
+                for(int i=0; i<3; ++i)
+                    d[i] -= C[3*i]*next[0] + C[3*i+1]*next[1] + C[3*i+2]*next[2];
+            }
+            const double L0 = rope.spring_L0[std::min(k, N_spring-1)];
+            largest = std::max(largest, std::sqrt(d[0]*d[0]+d[1]*d[1]+d[2]*d[2])/L0);
+        }
+
+        // Backtracking: the step is halved until the energy decreases
+        const double E = implicit_energy(h, 0);
+        double t = 1;
+        int halving = 0;
+        while(implicit_energy(h, t)>E && halving<30) {
+            t *= 0.5;
+            halving++;
+        }
+        if(halving==30)
+            t = 0;
+        solver.line_search += halving;
+        for(size_t k=0; k<N_particle; ++k) {
+            px[k] += t*rhs[3*k];  py[k] += t*rhs[3*k+1];  pz[k] += t*rhs[3*k+2];
+        }
+        solver.residual = t*largest;
+        solver.iterations_done = iteration+1;
+        if(solver.residual<solver.tolerance)
+            break;
+    }
+    const clock::time_point t2 = clock::now();
+
+    // Speed update
+    for(size_t k=0; k<N_particle; ++k)
+    {
+        vx[k] = (px[k]-solver.x_previous[k])/h;
+        vy[k] = (py[k]-solver.y_previous[k])/h;
+        vz[k] = (pz[k]-solver.z_previous[k])/h;
+    }
+    const clock::time_point t3 = clock::now();
+
+    timings.prediction += seconds(t0,t1);
+    timings.solve      += seconds(t1,t2);
+    timings.update     += seconds(t2,t3);
+    timings.steps++;
+}
+
+double rope_simulation::implicit_energy(double h, double t) const
+{
+    const size_t N_particle = rope.size();
+    const double* dx = solver.rhs.data();
+    double E = 0;
+    double previous[3] = {0, 0, 0};
+    for(size_t k=0; k<N_particle; ++k)
+    {
+        const double p[3] = {rope.px[k] + t*dx[3*k], rope.py[k] + t*dx[3*k+1], rope.pz[k] + t*dx[3*k+2]};
+        const double ux = p[0]-solver.x_target[k], uy = p[1]-solver.y_target[k], uz = p[2]-solver.z_target[k];
+        E += rope.mass[k]/(2*h*h)*(ux*ux+uy*uy+uz*uz);
+        if(k>0) {
+            const double ex = p[0]-previous[0], ey = p[1]-previous[1], ez = p[2]-previous[2];
+            const double C = std::sqrt(ex*ex+ey*ey+ez*ez) - rope.spring_L0[k-1];
+            E += 0.5*rope.spring_K[k-1]*C*C;
+        }
+        previous[0] = p[0];  previous[1] = p[1];  previous[2] = p[2];
+    }
+    return E;
+}
+
+float rope_simulation::explicit_time_step() const
+{
+    return float(0.5*std::sqrt(rope.mass[1]/rope.spring_K[0]));
+}
+
+float rope_simulation::max_stretch() const
+{
+    double stretch = 0;
+    const size_t N_spring = rope.spring_i.size();
+    for(size_t s=0; s<N_spring; ++s) {
+        const int i = rope.spring_i[s], j = rope.spring_j[s];
+        const double dx = rope.px[j]-rope.px[i], dy = rope.py[j]-rope.py[i], dz = rope.pz[j]-rope.pz[i];
+        stretch = std::max(stretch, std::sqrt(dx*dx+dy*dy+dz*dz)/rope.spring_L0[s] - 1);
+    }
+    return float(stretch);
+}
+
+bool rope_simulation::chain_topology() const
+{
+    const size_t N_particle = rope.size();
+    if(N_particle<2 || rope.spring_i.size()!=N_particle-1 || rope.offset.size()!=N_particle+1)
+        return false;
+    for(size_t s=0; s+1<N_particle; ++s)
+        if(rope.spring_i[s]!=int(s) || rope.spring_j[s]!=int(s+1))
+            return false;
+    return true;
+}
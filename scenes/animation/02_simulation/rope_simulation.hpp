@@ -0,0 +1,75 @@
+#pragma once
+
+// Simulation of a long rope, independent of the rendering (no OpenGL or GUI dependency)
+//  Used by the rope scene, and by the headless benchmark (headless/main_headless.cpp)
+
+#include "vcl/math/math.hpp"
+#include "vcl/simulation/mass_spring_system/mass_spring_system.hpp"
+
+#include <vector>
+
+// Time integration scheme of the rope: the explicit scheme needs time steps below sqrt(m/K), the implicit one doesn't
+enum rope_integrator { ROPE_IMPLICIT = 0, ROPE_SYMPLECTIC_EULER = 1 };
+
+// Data of the implicit integrator of the rope
+//  Backward Euler step written as the minimization of E(x) = sum_k m_k/(2h^2) |x_k - y_k|^2 + sum_s K_s/2 (L_s - L0_s)^2, y being
+//  the positions predicted with the external forces. Each Newton iteration solves H dx = -grad E: a particle only shares springs with
+//  the previous and the next one along the rope, H is block tridiagonal (3x3 blocks) and is solved by block Gaussian elimination along
+//  the rope (Thomas algorithm), in O(N) operations and memory whatever the stiffness. The transverse part of the spring Hessians is
+//  clamped to be positive (compressed springs), H stays positive definite: the elimination needs no pivoting and dx decreases E.
+//  The step along dx is halved until E decreases (the linearization is poor where the rope folds): with converged iterations, the
+//  step is stable for large time steps and stiffnesses (backward Euler dissipates energy).
+struct rope_solver_structure
+{
+    std::vector<double> x_previous, y_previous, z_previous; // Positions at the beginning of the step
+    std::vector<double> x_target, y_target, z_target;       // Predicted positions y
+    std::vector<double> upper;      // Off-diagonal blocks after the elimination, D_k^-1 B_k (9 values per particle)
+    std::vector<double> rhs;        // Right hand side after the elimination, then Newton direction (3 values per particle)
+
+    int iterations = 20;            // Maximal number of Newton iterations per step
+    double tolerance = 1e-4;        // The iterations stop when no particle moves more than tolerance*L0
+    int iterations_done = 0;        // Number of Newton iterations of the last time step
+    int line_search = 0;            // Number of halvings of the steps during the last time step
+    double residual = 0;            // Largest displacement of the last Newton iteration, relative to the rest length
+};
+
+struct rope_timings_structure
+{
+    double prediction; // External forces and predicted positions
+    double solve;      // Newton iterations (implicit integrator)
+    double update;     // Update of the speeds (whole step of the explicit integrator)
+    size_t steps;      // Number of steps
+};
+
+struct rope_simulation
+{
+    // Particles from the anchor (index 0, pinned) to the free end, linked by the springs (k,k+1)
+    //  Stored in double precision: the springs of long ropes are too short for the precision of float coordinates
+    vcl::mass_spring_system_double rope;
+    rope_solver_structure solver;
+
+    // Parameters (applied at the initialization)
+    size_t N = 1000;          // Number of particles
+    float length = 2.0f;      // Rest length of the rope, initially horizontal
+    float mass = 0.1f;        // Total mass
+    float stiffness = 1e3f;   // Axial stiffness (force per unit strain): the springs of rest length L0 have a stiffness stiffness/L0
+    float damping = 0.001f;   // Drag of the whole rope (divided by the number of particles)
+    rope_integrator integrator = ROPE_IMPLICIT;
+
+    rope_timings_structure timings = rope_timings_structure();
+
+    void initialize();
+    void compute_time_step(float dt);
+    void step_implicit(float dt);
+    void reset_timings();
+    /** Time step of the explicit integrator: half of its stability limit sqrt(m/K) (highest frequency 2 sqrt(K/m) of the chain) */
+    float explicit_time_step() const;
+    /** Largest relative stretch (L-L0)/L0 of the springs */
+    float max_stretch() const;
+
+private:
+    /** True if the springs are (k,k+1) for k in [0,N-1[ in this order: the structure of the block tridiagonal solver */
+    bool chain_topology() const;
+    /** Energy of the backward Euler step at the positions x + t dx (dx: Newton direction stored in solver.rhs) */
+    double implicit_energy(double h, double t) const;
+};
@@ -1,15 +1,10 @@
 
 #include "sphere_collision.hpp"
 
-#include <random>
-
 #ifdef SCENE_SPHERE_COLLISION
 
 using namespace vcl;
 
-enum intersection_type { BOX = 0, SPHERE = 1};
-
-intersection_type current_inter = BOX;
 vec3 camera_down = {0.f, -1.f, 0.f};
 
 void scene_model::frame_draw(std::map<std::string,GLuint>& shaders , scene_structure& scene, gui_structure& )
@@ -23,16 +18,26 @@ void scene_model::frame_draw(std::map<std::string,GLuint>& shaders , scene_struc
     vec3 temp = {cam[4], cam[5], cam[6]}; //Extract up vector;
     camera_down = normalize(-temp);
 
-    create_new_particle();
-    compute_time_step(dt);
-
-    display_particles(scene);
-    if (current_inter == intersection_type::BOX)
+    if(cache_playback.size()>0)
+        display_playback(scene);
+    else
+    {
+        create_new_particle();
+        simulation.compute_time_step(dt, camera_down);
+        record_frame(dt);
+        display_particles(scene);
+    }
+    if (simulation.current_inter == intersection_type::BOX)
+        draw(borders, scene.camera);
+    else if (simulation.current_inter == intersection_type::MESH)
+    {
         draw(borders, scene.camera);
+        draw(obstacle, scene.camera);
+    }
     else
     {
-        sphere.uniform.transform.translation = sphere_p;
-        sphere.uniform.transform.scaling = sphere_r;
+        sphere.uniform.transform.translation = simulation.sphere_p;
+        sphere.uniform.transform.scaling = simulation.sphere_r;
         sphere.uniform.color = {0.f, 1.f, 1.f};
         sphere.shader = shaders["wireframe"];
         draw(sphere, scene.camera);
@@ -40,164 +45,64 @@ void scene_model::frame_draw(std::map<std::string,GLuint>& shaders , scene_struc
     }
 }
 
-void scene_model::compute_time_step(float dt)
-{
-    // Set forces
-    const size_t N = particles.size();
-    for(size_t k=0; k<N; ++k)
-        particles[k].f = 9.81f * camera_down * 2.f;
-
-
-    // Integrate position and speed of particles through time
-    for(size_t k=0; k<N; ++k) {
-        particle_structure& particle = particles[k];
-        vec3& v = particle.v;
-        vec3& p = particle.p;
-        vec3 const& f = particle.f;
-
-        v = (1-0.9f*dt) * v + dt * f; // gravity + friction force
-        p = p + dt * v;
-    }
-
-    float alpha, beta;
-
-    // Collisions with cube
-    // ... to do
-
-    alpha = 0.5;
-    beta = 0.5;
-    for (size_t i = 0; i < N; i++)
-    {
-        particle_structure& p1 = particles[i];
-
-        for (size_t j = 0; j < N; j++)
-        {
-            if (j == i)
-                continue;
-
-            particle_structure& p2 = particles[j];
-
-            float detection = norm(p1.p - p2.p);
-            
-            if (detection <= p1.r + p2.r)
-            {
-                //std::cout << "normal case";
-                float epsilon = 0.0001;
-                vec3 u = (p1.p - p2.p) / norm(p1.p - p2.p);
-
-                if (abs(norm(p1.v - p2.v)) > epsilon)
-                {
-                    float m1 = 1;
-                    float m2 = 1;
-
-                    float j = 2 * (m1 * m2) / (m1 + m2) * dot(p2.v - p1.v, u);
-                    
-                    p1.v = alpha * p1.v + beta * j/m1;
-                    p2.v = alpha * p2.v - beta * j/m2; 
-                }
-
-                else
-                {
-                    //std::cout << "friction case";
-                    float mu = 0.5;
-                    p1.v = mu * p2.v;
-                    p2.v = mu * p1.v;
-                }
-
-                float d = p1.r + p2.r - norm(p1.p - p2.p);
-                p1.p = p1.p + d/2*u;
-            }
-        }
-    }
-    
-    alpha = 0.7;
-    beta = 0.7;
-    // Collisions between spheres
-    // ... to do
-    for (size_t i = 0; i < N; i++)
-    {
-        if (current_inter == BOX)
-        {
-            for (size_t j = 0; j < plane_points.size(); j++)
-            {
-                vec3 a = plane_points[j];
-                vec3 n = plane_normals[j];
-                particle_structure& p = particles[i];
-
-                float detection = dot(p.p - a, n);
-
-                if (detection <= p.r)
-                {
-                    vec3 v_ortho = dot(p.v, n) * n;
-                    vec3 v_parallel = p.v - dot(p.v, n) * n;
-                    p.v = alpha * v_parallel - beta * v_ortho;
-
-                    float d = p.r - dot(p.p - a, n);
-                    p.p = p.p + d*n; 
-                }
-            }
-        }
-        else
-        {
-            particle_structure& p = particles[i];
-            float detection = norm(p.p - sphere_p);
-            
-            if (detection >= sphere_r - p.r)
-            {
-                vec3 n = normalize(sphere_p - p.p);
-                vec3 a = sphere_p - normalize(n) * sphere_r;
-                vec3 v_ortho = dot(p.v, n) * n;
-                vec3 v_parallel = p.v - dot(p.v, n) * n;
-                p.v = alpha * v_parallel - beta * v_ortho;
-
-                float d = p.r - dot(p.p - a, n);
-                p.p = p.p + d*n; 
-
-            }
-
-        }
-    }
-}
-
-
 void scene_model::create_new_particle()
 {
     // Emission of new particle if needed
     timer.periodic_event_time_step = gui_scene.time_interval_new_sphere;
     const bool is_new_particle = timer.event;
-    static const std::vector<vec3> color_lut = {{1,0,0},{0,1,0},{0,0,1},{1,1,0},{1,0,1},{0,1,1}};
 
     if( is_new_particle && gui_scene.add_sphere)
-    {
-        particle_structure new_particle;
-
-        new_particle.r = 0.08f;
-        new_particle.c = color_lut[int(rand_interval()*color_lut.size())];
-
-        // Initial position
-        new_particle.p = vec3(0,0,0);
-
-        // Initial speed
-        const float theta = rand_interval(0, 2*3.14f);
-        new_particle.v = vec3( 2*std::cos(theta), 5.0f, 2*std::sin(theta));
+        simulation.emit_particle();
+}
 
-        particles.push_back(new_particle);
+// Positions of the particles streamed to the cache file (compressed and written by the thread of the cache)
+void scene_model::record_frame(float dt)
+{
+    if(!cache_record.is_open())
+        return;
+    const size_t N = simulation.particles.size();
+    cache_positions.resize(N);
+    for(size_t k=0; k<N; ++k)
+        cache_positions[k] = simulation.particles.position(k);
+    cache_time += dt;
+    cache_record.push(cache_time, N>0? &cache_positions[0].x : nullptr, 3*N);
+}
 
+// Display the recorded frame at the time of the playback timer
+//  The radius and color of the particles are taken from the current simulation when they exist
+void scene_model::display_playback(scene_structure& scene)
+{
+    playback_timer.update();
+    const std::vector<float>& frame = cache_playback.frame(cache_playback.frame_at(playback_timer.t));
+    const size_t N = frame.size()/3;
+    particles_instances.resize(N);
+    for(size_t k=0; k<N; ++k)
+    {
+        const bool simulated = k<simulation.particles.size();
+        mesh_instance& instance = particles_instances[k];
+        instance.translation = {frame[3*k], frame[3*k+1], frame[3*k+2]};
+        instance.scaling = simulated? simulation.particles.r[k] : 0.08f;
+        instance.color = simulated? simulation.particles.color(k) : vec3(0.7f,0.7f,0.7f);
     }
+    particles_drawable.update_instances(particles_instances);
+    draw(particles_drawable, scene.camera);
 }
 
 void scene_model::display_particles(scene_structure& scene)
 {
+    // The instances are read from the arrays of the particles and sent in one upload
+    const sphere_particles_structure& particles = simulation.particles;
     const size_t N = particles.size();
+    particles_instances.resize(N);
     for(size_t k=0; k<N; ++k)
     {
-        const particle_structure& part = particles[k];
-
-        sphere.uniform.transform.translation = part.p;
-        sphere.uniform.transform.scaling = part.r;
-        sphere.uniform.color = part.c;
-        draw(sphere, scene.camera);
+        mesh_instance& instance = particles_instances[k];
+        instance.translation = particles.position(k);
+        instance.scaling = particles.r[k];
+        instance.color = particles.color(k);
     }
+    particles_drawable.update_instances(particles_instances);
+    draw(particles_drawable, scene.camera);
 }
 
 
@@ -207,6 +112,8 @@ void scene_model::setup_data(std::map<std::string,GLuint>& shaders, scene_struct
 {
     sphere = mesh_drawable( mesh_primitive_sphere(1.0f));
     sphere.shader = shaders["mesh"];
+    particles_drawable = mesh_drawable_instanced( mesh_primitive_sphere(1.0f));
+    particles_drawable.shader = shaders["mesh_instanced"];
 
     std::vector<vec3> borders_segments = {{-1,-1,-1},{1,-1,-1}, {1,-1,-1},{1,1,-1}, {1,1,-1},{-1,1,-1}, {-1,1,-1},{-1,-1,-1},
                                           {-1,-1,1} ,{1,-1,1},  {1,-1,1}, {1,1,1},  {1,1,1}, {-1,1,1},  {-1,1,1}, {-1,-1,1},
@@ -215,8 +122,11 @@ void scene_model::setup_data(std::map<std::string,GLuint>& shaders, scene_struct
     borders.uniform.color = {0,0,0};
     borders.shader = shaders["curve"];
 
-   plane_points = {{0,-1,0}, {1,0,0}, {-1,0,0}, {0,0,-1}, {0,0,1}, {0,1,0}}; 
-   plane_normals = {{0,1,0}, {-1,0,0}, {1,0,0}, {0,0,1}, {0,0,-1}, {0, -1, 0}};
+    simulation.initialize();
+
+    obstacle = mesh_drawable(sphere_collision_simulation::obstacle_mesh());
+    obstacle.shader = shaders["mesh"];
+    obstacle.uniform.color = {0.8f, 0.8f, 0.8f};
 }
 
 
@@ -228,11 +138,82 @@ void scene_model::set_gui()
     ImGui::SliderFloat("Interval create sphere", &gui_scene.time_interval_new_sphere, 0.05f, 2.0f, "%.2f s");
     ImGui::Checkbox("Add sphere", &gui_scene.add_sphere);
 
+    // Pool of particles: the emission stops when it is full, the particles older than the lifetime (if positive) are removed
+    int max_particles = int(simulation.max_particles);
+    if(ImGui::SliderInt("Max particles", &max_particles, 1, 20000))
+        simulation.max_particles = size_t(max_particles);
+    ImGui::SliderFloat("Lifetime", &simulation.lifetime, 0.0f, 60.0f, simulation.lifetime>0? "%.1f s" : "infinite");
+    ImGui::Checkbox("Cull escaped", &simulation.cull_escaped); ImGui::SameLine();
+    ImGui::Text("(%d/%d particles, %d culled)", int(simulation.particles.size()), int(simulation.max_particles), int(simulation.particles_culled));
+    ImGui::Checkbox("Sleeping", &simulation.sleeping);
+    if(simulation.sleeping) {
+        ImGui::SameLine();
+        ImGui::Text("(%d/%d particles asleep)", int(simulation.particles_asleep), int(simulation.particles.size()));
+    }
+
+    ImGui::Checkbox("CCD", &simulation.ccd);
+    if(simulation.ccd) {
+        ImGui::SameLine();
+        ImGui::Text("(%d impacts)", int(simulation.ccd_events));
+    }
+
+    ImGui::Checkbox("SIMD", &simulation.simd); ImGui::SameLine();
+    ImGui::Text("(%s)", simd_instruction_set_name(simd_support()).c_str());
+
+    int inter = simulation.current_inter;
+    ImGui::RadioButton("Box", &inter, BOX); ImGui::SameLine();
+    ImGui::RadioButton("Sphere", &inter, SPHERE); ImGui::SameLine();
+    ImGui::RadioButton("Mesh obstacle", &inter, MESH);
+    simulation.current_inter = intersection_type(inter);
+
+    // Broadphase of the collisions between particles, and spread of the radii of the emitted particles
+    int broadphase = simulation.broadphase;
+    ImGui::RadioButton("Grid", &broadphase, GRID_BROADPHASE); ImGui::SameLine();
+    ImGui::RadioButton("Sweep and prune", &broadphase, SWEEP_AND_PRUNE_BROADPHASE);
+    simulation.broadphase = broadphase_type(broadphase);
+    ImGui::SliderFloat("Radius spread", &simulation.particle_radius_spread, 1.0f, 10.0f, "%.1f");
+
     bool stop_anim  = ImGui::Button("Stop"); ImGui::SameLine();
     bool start_anim = ImGui::Button("Start");
 
     if(stop_anim)  timer.stop();
     if(start_anim) timer.start();
+
+    // The state is restored with the random generator of the emission: the same steps can be replayed
+    if(ImGui::Button("Save state")) simulation.save_state(state_filename);
+    ImGui::SameLine();
+    if(ImGui::Button("Load state")) simulation.load_state(state_filename);
+
+    // Frames streamed to the cache file, replayed without simulation
+    bool record = cache_record.is_open();
+    if(ImGui::Checkbox("Record", &record)) {
+        if(record && cache_playback.size()==0) {
+            cache_time = 0.0f;
+            cache_record.open(cache_filename, 32, 4, FRAME_CACHE_DROP); // The display is not slowed down by a late writer
+        }
+        else
+            cache_record.close();
+    }
+    if(cache_record.is_open()) {
+        ImGui::SameLine();
+        ImGui::Text("(%d frames, %d dropped, %.1f MB)", int(cache_record.frames()), int(cache_record.frames_dropped()), double(cache_record.bytes_written())/1e6);
+    }
+    bool playback = cache_playback.size()>0;
+    if(ImGui::Checkbox("Playback", &playback)) {
+        cache_record.close();
+        if(!playback)
+            cache_playback.close();
+        else if(cache_playback.open(cache_filename) && cache_playback.size()>=2) {
+            playback_timer.t_min = cache_playback.time(0);
+            playback_timer.t_max = cache_playback.time(cache_playback.size()-1);
+            playback_timer.t = playback_timer.t_min;
+            playback_timer.start();
+        }
+        else
+            cache_playback.close();
+    }
+    if(cache_playback.size()>0)
+        ImGui::SliderFloat("Cache time", &playback_timer.t, playback_timer.t_min, playback_timer.t_max, "%.2f s");
 }
 
 
@@ -4,16 +4,7 @@
 
 #ifdef SCENE_SPHERE_COLLISION
 
-// Structure of a particle
-struct particle_structure
-{
-    vcl::vec3 p; // Position
-    vcl::vec3 v; // Speed
-    vcl::vec3 f; // Forces
-
-    vcl::vec3 c; // Color
-    float r;     // Radius
-};
+#include "sphere_collision_simulation.hpp"
 
 struct gui_scene_structure
 {
@@ -29,24 +20,34 @@ struct scene_model : scene_base
 
     void set_gui();
 
-    void compute_time_step(float dt);
     void create_new_particle();
     void display_particles(scene_structure& scene);
+    void record_frame(float dt);
+    void display_playback(scene_structure& scene);
 
 
-    std::vector<particle_structure> particles;
+    // Physics of the particles (independent of the display)
+    sphere_collision_simulation simulation;
 
-    vcl::mesh_drawable sphere;      // Visual display of particles
+    vcl::mesh_drawable sphere;      // Visual display of the spherical container
+    vcl::mesh_drawable_instanced particles_drawable;     // Visual display of particles: one instance per particle, a single draw call
+    vcl::buffer<vcl::mesh_instance> particles_instances;
     vcl::segments_drawable borders; // Visual display of borders
 
     vcl::timer_event timer;
     gui_scene_structure gui_scene;
- 
-   std::vector<vcl::vec3> plane_points; 
-   std::vector<vcl::vec3> plane_normals;
 
-   vcl::vec3 sphere_p = {0.f, 0.f, 0.f};
-   float sphere_r = 1.f;
+    const std::string state_filename = "spheres_state.bin"; // Snapshot used by the Save/Load buttons
+
+    // Record and playback of the positions of the particles
+    const std::string cache_filename = "spheres_cache.bin";
+    vcl::frame_cache_writer cache_record;
+    vcl::frame_cache_reader cache_playback; // Frames played back (empty when the simulation runs)
+    float cache_time = 0.0f;                // Simulated time of the recorded frames
+    std::vector<vcl::vec3> cache_positions;
+    vcl::timer_interval playback_timer;
+
+   vcl::mesh_drawable obstacle;  // Visual display of the mesh obstacle
 };
 
 
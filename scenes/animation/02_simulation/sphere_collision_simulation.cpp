@@ -0,0 +1,1133 @@
+#include "sphere_collision_simulation.hpp"
+#include "sphere_kernels/sphere_kernels.hpp"
+#include "vcl/shape/mesh/mesh_primitive/mesh_primitive.hpp"
+
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+
+using namespace vcl;
+
+// The time of impact functions are called for every pair of neighboring fast particles: they are written on the float components
+
+bool ccd_plane_time_of_impact(const vec3& p, const vec3& d, float r, const vec3& a, const vec3& n, float& t)
+{
+    // Signed distances of the sphere to the plane at the beginning and at the end of the motion
+    const float s0 = (p.x-a.x)*n.x + (p.y-a.y)*n.y + (p.z-a.z)*n.z - r;
+    const float s1 = s0 + d.x*n.x + d.y*n.y + d.z*n.z;
+    if(!(s0>=0 && s1<0))
+        return false;
+    t = s0/(s0-s1);
+    return t<1;
+}
+
+bool ccd_container_time_of_impact(const vec3& p, const vec3& d, float r, const vec3& c, float R, float& t)
+{
+    // |p-c + t d| = R-r, the center of the sphere leaving the ball of radius R-r through the largest root
+    const float qx = p.x-c.x, qy = p.y-c.y, qz = p.z-c.z;
+    const float a = d.x*d.x + d.y*d.y + d.z*d.z;
+    const float b = qx*d.x + qy*d.y + qz*d.z;
+    const float e = qx*qx + qy*qy + qz*qz - (R-r)*(R-r);
+    if(!(e<=0) || a==0.0f)
+        return false;
+    t = (-b + std::sqrt(std::max(b*b - a*e, 0.0f)))/a;
+    return t<1;
+}
+
+bool ccd_spheres_time_of_impact(const vec3& p1, const vec3& d1, const vec3& p2, const vec3& d2, float r12, float& t)
+{
+    // |q + t w| = r12 in the frame of the second sphere, smallest root, if the spheres get closer
+    const float qx = p1.x-p2.x, qy = p1.y-p2.y, qz = p1.z-p2.z;
+    const float wx = d1.x-d2.x, wy = d1.y-d2.y, wz = d1.z-d2.z;
+    const float a = wx*wx + wy*wy + wz*wz;
+    const float b = qx*wx + qy*wy + qz*wz;
+    const float e = qx*qx + qy*qy + qz*qz - r12*r12;
+    if(!(e>0) || !(b<0))
+        return false;
+    const float discriminant = b*b - a*e;
+    if(discriminant<0)
+        return false;
+    t = (-b - std::sqrt(discriminant))/a;
+    return t<=1;
+}
+
+
+void sphere_particles_structure::reserve(size_t capacity)
+{
+    for(std::vector<float>* component : {&px,&py,&pz, &vx,&vy,&vz, &r, &cr,&cg,&cb, &rest_time, &age})
+        component->reserve(capacity);
+    asleep.reserve(capacity);
+}
+
+void sphere_particles_structure::clear()
+{
+    for(std::vector<float>* component : {&px,&py,&pz, &vx,&vy,&vz, &r, &cr,&cg,&cb, &rest_time, &age})
+        component->clear();
+    asleep.clear();
+}
+
+void sphere_particles_structure::push_back(const particle_structure& particle)
+{
+    px.push_back(particle.p.x); py.push_back(particle.p.y); pz.push_back(particle.p.z);
+    vx.push_back(particle.v.x); vy.push_back(particle.v.y); vz.push_back(particle.v.z);
+    r.push_back(particle.r);
+    cr.push_back(particle.c.x); cg.push_back(particle.c.y); cb.push_back(particle.c.z);
+    asleep.push_back(particle.asleep? 1 : 0);
+    rest_time.push_back(particle.rest_time);
+    age.push_back(particle.age);
+}
+
+void sphere_particles_structure::remove(size_t k)
+{
+    for(std::vector<float>* component : {&px,&py,&pz, &vx,&vy,&vz, &r, &cr,&cg,&cb, &rest_time, &age}) {
+        (*component)[k] = component->back();
+        component->pop_back();
+    }
+    asleep[k] = asleep.back();
+    asleep.pop_back();
+}
+
+particle_structure sphere_particles_structure::operator[](size_t k) const
+{
+    particle_structure particle;
+    particle.p = position(k);
+    particle.v = speed(k);
+    particle.c = color(k);
+    particle.r = r[k];
+    particle.asleep = asleep[k]!=0;
+    particle.rest_time = rest_time[k];
+    particle.age = age[k];
+    return particle;
+}
+
+
+// Borders of the box and mesh obstacle
+void sphere_collision_simulation::initialize()
+{
+    particles.clear();
+    particles.reserve(max_particles);
+    particles_culled = 0;
+    ccd_events = 0;
+
+    plane_points = {{0,-1,0}, {1,0,0}, {-1,0,0}, {0,0,-1}, {0,0,1}, {0,1,0}};
+    plane_normals = {{0,1,0}, {-1,0,0}, {1,0,0}, {0,0,1}, {0,0,-1}, {0, -1, 0}};
+
+    // Obstacle inside the box, collisions use its distance field
+    obstacle_sdf = sdf_grid_from_mesh(obstacle_mesh(), 64, 0.2f);
+
+    timings = sphere_collision_timings_structure();
+    particles_asleep = 0;
+
+    // The emitted particles follow the same sequence after each initialization
+    rand_seed(seed);
+}
+
+// Version of the content of the spheres snapshots, to be incremented when the saved data change
+static const uint32_t spheres_snapshot_version = 4;
+
+// Save the particles, the obstacle, the parameters deciding the replay and the state of the random generator used by the emission
+bool sphere_collision_simulation::save_state(const std::string& filename) const
+{
+    snapshot_writer snapshot("spheres", spheres_snapshot_version);
+    snapshot.write("px", particles.px); snapshot.write("py", particles.py); snapshot.write("pz", particles.pz);
+    snapshot.write("vx", particles.vx); snapshot.write("vy", particles.vy); snapshot.write("vz", particles.vz);
+    snapshot.write("r", particles.r);
+    snapshot.write("cr", particles.cr); snapshot.write("cg", particles.cg); snapshot.write("cb", particles.cb);
+    snapshot.write("asleep", particles.asleep);
+    snapshot.write("rest_time", particles.rest_time);
+    snapshot.write("age", particles.age);
+    snapshot.write("inter", current_inter);
+    snapshot.write("sphere_p", sphere_p);
+    snapshot.write("sphere_r", sphere_r);
+    snapshot.write("gravity_previous", gravity_previous);
+    snapshot.write("inter_previous", inter_previous);
+    snapshot.write("rand_state", rand_state());
+
+    snapshot.write("radius", particle_radius);
+    snapshot.write("radius_spread", particle_radius_spread);
+    snapshot.write("max_particles", uint64_t(max_particles));
+    snapshot.write("lifetime", lifetime);
+    snapshot.write("cull_escaped", cull_escaped);
+    snapshot.write("cull_distance", cull_distance);
+    snapshot.write("broadphase", broadphase);
+    snapshot.write("sap_axis", sap.axis); // The axis of the sweep and prune depends on the previous steps
+    snapshot.write("contact_iter", contact_iterations);
+    snapshot.write("sleeping", sleeping);
+    const float sleep_thresholds[3] = {sleep_speed_threshold, sleep_acceleration_threshold, sleep_time_window};
+    snapshot.write("sleep_threshold", sleep_thresholds);
+    snapshot.write("ccd", ccd);
+    snapshot.write("ccd_threshold", ccd_threshold);
+    snapshot.write("ccd_max_events", ccd_max_events);
+
+    const bool saved = snapshot.save(filename);
+    if(!saved)
+        std::cerr<<"Cannot write the spheres state in "<<filename<<std::endl;
+    return saved;
+}
+
+// Restore a state saved by save_state, the simulation is unchanged if the file cannot be read
+bool sphere_collision_simulation::load_state(const std::string& filename)
+{
+    snapshot_reader snapshot;
+    if(!snapshot.open(filename, "spheres", spheres_snapshot_version)) {
+        std::cerr<<"Cannot load the spheres state: "<<snapshot.error<<std::endl;
+        return false;
+    }
+
+    sphere_particles_structure loaded;
+    intersection_type loaded_inter = BOX, loaded_inter_previous = BOX;
+    vec3 loaded_sphere_p, loaded_gravity_previous;
+    float loaded_sphere_r = 0;
+    std::string generator_state;
+    float loaded_radius = 0, loaded_radius_spread = 0, loaded_lifetime = 0, loaded_cull_distance = 0, loaded_ccd_threshold = 0;
+    float loaded_sleep_thresholds[3] = {0, 0, 0};
+    uint64_t loaded_max_particles = 0;
+    bool loaded_cull_escaped = false, loaded_sleeping = false, loaded_ccd = false;
+    broadphase_type loaded_broadphase = GRID_BROADPHASE;
+    int loaded_contact_iterations = 0, loaded_ccd_max_events = 0, loaded_sap_axis = 0;
+    const bool valid = snapshot.read("px", loaded.px) && snapshot.read("py", loaded.py) && snapshot.read("pz", loaded.pz)
+            && snapshot.read("vx", loaded.vx) && snapshot.read("vy", loaded.vy) && snapshot.read("vz", loaded.vz)
+            && snapshot.read("r", loaded.r) && snapshot.read("cr", loaded.cr) && snapshot.read("cg", loaded.cg) && snapshot.read("cb", loaded.cb)
+            && snapshot.read("asleep", loaded.asleep) && snapshot.read("rest_time", loaded.rest_time) && snapshot.read("age", loaded.age)
+            && snapshot.read("inter", loaded_inter)
+            && snapshot.read("sphere_p", loaded_sphere_p) && snapshot.read("sphere_r", loaded_sphere_r)
+            && snapshot.read("gravity_previous", loaded_gravity_previous) && snapshot.read("inter_previous", loaded_inter_previous)
+            && snapshot.read("rand_state", generator_state)
+            && snapshot.read("radius", loaded_radius) && snapshot.read("radius_spread", loaded_radius_spread)
+            && snapshot.read("max_particles", loaded_max_particles) && snapshot.read("lifetime", loaded_lifetime)
+            && snapshot.read("cull_escaped", loaded_cull_escaped) && snapshot.read("cull_distance", loaded_cull_distance)
+            && snapshot.read("broadphase", loaded_broadphase) && snapshot.read("sap_axis", loaded_sap_axis)
+            && snapshot.read("contact_iter", loaded_contact_iterations)
+            && snapshot.read("sleeping", loaded_sleeping) && snapshot.read("sleep_threshold", loaded_sleep_thresholds)
+            && snapshot.read("ccd", loaded_ccd) && snapshot.read("ccd_threshold", loaded_ccd_threshold)
+            && snapshot.read("ccd_max_events", loaded_ccd_max_events);
+    if(!valid) {
+        std::cerr<<"Cannot load the spheres state: "<<filename<<" is corrupted ("<<snapshot.error<<")"<<std::endl;
+        return false;
+    }
+    const size_t N = loaded.size();
+    bool consistent = loaded.asleep.size()==N && loaded_sap_axis>=0 && loaded_sap_axis<3;
+    for(const std::vector<float>* component : {&loaded.py,&loaded.pz, &loaded.vx,&loaded.vy,&loaded.vz, &loaded.r, &loaded.cr,&loaded.cg,&loaded.cb, &loaded.rest_time, &loaded.age})
+        consistent = consistent && component->size()==N;
+    if(!consistent) {
+        std::cerr<<"Cannot load the spheres state: "<<filename<<" is corrupted (arrays of the particles of different sizes or invalid parameters)"<<std::endl;
+        return false;
+    }
+
+    std::swap(particles, loaded);
+    particle_radius = loaded_radius;
+    particle_radius_spread = loaded_radius_spread;
+    max_particles = size_t(loaded_max_particles);
+    lifetime = loaded_lifetime;
+    cull_escaped = loaded_cull_escaped;
+    cull_distance = loaded_cull_distance;
+    broadphase = loaded_broadphase;
+    sap = sweep_and_prune();
+    sap.axis = loaded_sap_axis;
+    contact_iterations = loaded_contact_iterations;
+    sleeping = loaded_sleeping;
+    sleep_speed_threshold = loaded_sleep_thresholds[0];
+    sleep_acceleration_threshold = loaded_sleep_thresholds[1];
+    sleep_time_window = loaded_sleep_thresholds[2];
+    ccd = loaded_ccd;
+    ccd_threshold = loaded_ccd_threshold;
+    ccd_max_events = loaded_ccd_max_events;
+    particles.reserve(std::max(max_particles, particles.size()));
+    current_inter = loaded_inter;
+    sphere_p = loaded_sphere_p;
+    sphere_r = loaded_sphere_r;
+    gravity_previous = loaded_gravity_previous;
+    inter_previous = loaded_inter_previous;
+    rand_set_state(generator_state);
+
+    particles_asleep = 0;
+    for(int asleep : particles.asleep)
+        particles_asleep += asleep!=0? 1 : 0;
+    timings = sphere_collision_timings_structure();
+    return true;
+}
+
+// Mesh used as obstacle in MESH mode
+mesh sphere_collision_simulation::obstacle_mesh()
+{
+    return mesh_primitive_torus(0.5f, 0.15f, {0,-0.3f,0}, {0,1,0}, 40, 80);
+}
+
+// Add a new particle at the center of the box with a random speed, return false if the pool is full
+bool sphere_collision_simulation::emit_particle()
+{
+    if(particles.size()>=max_particles)
+        return false;
+    if(particles.capacity()<max_particles) // Capacity of the pool increased
+        particles.reserve(max_particles);
+
+    static const std::vector<vec3> color_lut = {{1,0,0},{0,1,0},{0,0,1},{1,1,0},{1,0,1},{0,1,1}};
+
+    particle_structure new_particle;
+
+    new_particle.r = particle_radius;
+    if(particle_radius_spread>1)
+        new_particle.r = particle_radius*std::pow(particle_radius_spread, rand_interval());
+    new_particle.asleep = false;
+    new_particle.rest_time = 0.0f;
+    new_particle.age = 0.0f;
+    new_particle.c = color_lut[int(rand_interval()*color_lut.size())];
+
+    // Initial position
+    new_particle.p = vec3(0,0,0);
+
+    // Initial speed
+    const float theta = rand_interval(0, 2*3.14f);
+    new_particle.v = vec3( 2*std::cos(theta), 5.0f, 2*std::sin(theta));
+
+    particles.push_back(new_particle);
+    return true;
+}
+
+void sphere_collision_simulation::compute_time_step(float dt, const vec3& gravity_direction)
+{
+    typedef std::chrono::steady_clock clock;
+    auto seconds = [](clock::time_point a, clock::time_point b) { return std::chrono::duration<double>(b-a).count(); };
+    const clock::time_point t0 = clock::now();
+
+    const size_t N = particles.size();
+    const bool gravity_changed = gravity_direction.x!=gravity_previous.x || gravity_direction.y!=gravity_previous.y || gravity_direction.z!=gravity_previous.z;
+    if(!sleeping || gravity_changed || current_inter!=inter_previous)
+        wake_up_all();
+    gravity_previous = gravity_direction;
+    inter_previous = current_inter;
+
+    vx_previous = particles.vx;
+    vy_previous = particles.vy;
+    vz_previous = particles.vz;
+    if(ccd) {
+        px_previous = particles.px;
+        py_previous = particles.py;
+        pz_previous = particles.pz;
+    }
+
+    // Set forces
+    const vec3 f = 9.81f * gravity_direction * 2.f;
+
+    // Integrate position and speed of particles through time (on each range, the vectorized kernels process the first particles, the scalar code the remaining ones)
+    const float damping = 1-0.9f*dt;
+    const simd_instruction_set instruction_set = simd? simd_support() : simd_instruction_set::none;
+    sphere_particles_structure& P = particles;
+    run_parallel(N, [&](size_t k_begin, size_t k_end)
+    {
+        const size_t b = k_begin, n = k_end-k_begin;
+        size_t k = k_begin;
+        if(instruction_set==simd_instruction_set::avx2)
+            k += integrate_particles_avx(&P.px[b], &P.py[b], &P.pz[b], &P.vx[b], &P.vy[b], &P.vz[b], &P.asleep[b], damping, dt, f.x, f.y, f.z, n);
+        else if(instruction_set==simd_instruction_set::sse2)
+            k += integrate_particles_sse(&P.px[b], &P.py[b], &P.pz[b], &P.vx[b], &P.vy[b], &P.vz[b], &P.asleep[b], damping, dt, f.x, f.y, f.z, n);
+
+        for(; k<k_end; ++k) {
+            if(particles.asleep[k])
+                continue;
+            vec3 v = particles.speed(k);
+            vec3 p = particles.position(k);
+
+            v = damping * v + dt * f; // gravity + friction force
+            p = p + dt * v;
+
+            particles.set_speed(k, v);
+            particles.set_position(k, p);
+        }
+    });
+
+    const clock::time_point t1 = clock::now();
+
+    float alpha, beta;
+
+    // Collisions with cube
+    // ... to do
+
+    // Broadphase
+    float r_max = 0.0f;
+    broadphase_position.resize(N);
+    for(size_t k=0; k<N; ++k) {
+        broadphase_position[k] = particles.position(k);
+        r_max = std::max(r_max, particles.r[k]);
+    }
+    update_broadphase(r_max);
+
+    alpha = 0.5;
+    beta = 0.5;
+
+    // Impacts of the fast particles within the step: the broadphase is updated if some particles were moved
+    if(ccd && sweep_particles(dt, alpha, beta)) {
+        for(size_t k=0; k<N; ++k)
+            broadphase_position[k] = particles.position(k);
+        update_broadphase(r_max);
+    }
+
+    // Contacts: the overlapping pairs are gathered, colored, then the colors are resolved one after the other (the pairs of a color in parallel)
+    //  The lists and the colors only depend on the positions: the result doesn't depend on the number of threads
+    gather_contacts();
+    color_contacts();
+
+    const std::vector<size_t>& color_offset = contacts.color_offset;
+    for(int iteration=0; iteration<contact_iterations; ++iteration)
+    {
+        for(size_t c=0; c<contacts.colors; ++c)
+        {
+            const size_t first = color_offset[c];
+            run_parallel(color_offset[c+1]-first, [&](size_t k_begin, size_t k_end)
+            {
+                for(size_t k=first+k_begin; k<first+k_end; ++k)
+                    resolve_contact(contacts.sorted_i[k], contacts.sorted_j[k], alpha, beta);
+            });
+        }
+        for(size_t k=color_offset[sphere_contacts_structure::max_colors]; k<color_offset.back(); ++k)
+            resolve_contact(contacts.sorted_i[k], contacts.sorted_j[k], alpha, beta);
+    }
+    
+    const clock::time_point t2 = clock::now();
+
+    alpha = 0.7;
+    beta = 0.7;
+    // Collisions between spheres
+    // ... to do
+
+    // Impacts of the fast particles with the borders within the step, the other particles are detected at the end of the step
+    if(ccd)
+        sweep_borders(dt, alpha, beta);
+
+    // The planes of the box are tested by the vectorized kernels on the first particles of each range, the scalar code handles the remaining ones
+    //  (each particle is independent, and tests the planes in the same order in both paths)
+    const bool box_planes = current_inter == BOX || current_inter == MESH;
+    const size_t plane_count = plane_points.size();
+    run_parallel(N, [&](size_t k_begin, size_t k_end)
+    {
+        const size_t b = k_begin, count = k_end-k_begin;
+        size_t k_planes = k_begin;
+        if(box_planes && instruction_set==simd_instruction_set::avx2)
+            k_planes += plane_collisions_avx(&P.px[b], &P.py[b], &P.pz[b], &P.vx[b], &P.vy[b], &P.vz[b], &P.r[b], &P.asleep[b],
+                                             &plane_points[0].x, &plane_normals[0].x, plane_count, alpha, beta, count);
+        else if(box_planes && instruction_set==simd_instruction_set::sse2)
+            k_planes += plane_collisions_sse(&P.px[b], &P.py[b], &P.pz[b], &P.vx[b], &P.vy[b], &P.vz[b], &P.r[b], &P.asleep[b],
+                                             &plane_points[0].x, &plane_normals[0].x, plane_count, alpha, beta, count);
+
+        for (size_t i = k_begin; i < k_end; i++)
+        {
+            if (particles.asleep[i])
+                continue;
+
+            vec3 p = particles.position(i);
+            vec3 v = particles.speed(i);
+            const float r = particles.r[i];
+
+            if (box_planes && i >= k_planes)
+            {
+                for (size_t j = 0; j < plane_count; j++)
+                {
+                    vec3 a = plane_points[j];
+                    vec3 n = plane_normals[j];
+
+                    float detection = dot(p - a, n);
+
+                    if (detection <= r)
+                    {
+                        vec3 v_ortho = dot(v, n) * n;
+                        vec3 v_parallel = v - dot(v, n) * n;
+                        v = alpha * v_parallel - beta * v_ortho;
+
+                        float d = r - dot(p - a, n);
+                        p = p + d*n; 
+                    }
+                }
+            }
+
+            if (current_inter == MESH)
+            {
+                vec3 gradient;
+                float detection = obstacle_sdf.distance(p, gradient);
+
+                if (detection <= r)
+                {
+                    vec3 n = normalize(gradient);
+                    vec3 v_ortho = dot(v, n) * n;
+                    vec3 v_parallel = v - dot(v, n) * n;
+                    if (dot(v, n) < 0)
+                        v = alpha * v_parallel - beta * v_ortho;
+
+                    float d = r - detection;
+                    p = p + d*n;
+                }
+            }
+            else if (current_inter == SPHERE)
+            {
+                float detection = norm(p - sphere_p);
+            
+                if (detection >= sphere_r - r)
+                {
+                    vec3 n = normalize(sphere_p - p);
+                    vec3 a = sphere_p - normalize(n) * sphere_r;
+                    vec3 v_ortho = dot(v, n) * n;
+                    vec3 v_parallel = v - dot(v, n) * n;
+                    v = alpha * v_parallel - beta * v_ortho;
+
+                    float d = r - dot(p - a, n);
+                    p = p + d*n; 
+
+                }
+
+            }
+
+            particles.set_position(i, p);
+            particles.set_speed(i, v);
+        }
+    });
+
+    update_sleeping(dt);
+    cull_particles(dt);
+
+    const clock::time_point t3 = clock::now();
+
+    timings.integration         += seconds(t0,t1);
+    timings.particle_collisions += seconds(t1,t2);
+    timings.border_collisions   += seconds(t2,t3);
+    timings.steps++;
+}
+
+// Pairs found by the grid: the particles are visited in the order of the grid by blocks of fixed size
+void sphere_collision_simulation::gather_pairs_grid()
+{
+    const size_t N = particles.size();
+    const size_t block_size = 1024;
+    const size_t N_block = (N+block_size-1)/block_size;
+    std::vector<std::vector<int>>& block_pairs = contacts.block_pairs;
+    block_pairs.resize(N_block);
+
+    // Copy of the positions in the order of the grid: the particles of neighboring cells are read contiguously
+    contacts.grid_x.resize(N); contacts.grid_y.resize(N); contacts.grid_z.resize(N); contacts.grid_r.resize(N);
+    run_parallel(N, [&](size_t k_begin, size_t k_end)
+    {
+        for(size_t k=k_begin; k<k_end; ++k) {
+            const vec3& p = broadphase_position[grid.sorted[k]];
+            contacts.grid_x[k] = p.x; contacts.grid_y[k] = p.y; contacts.grid_z[k] = p.z;
+            contacts.grid_r[k] = particles.r[grid.sorted[k]];
+        }
+    });
+    const float* x = contacts.grid_x.data();
+    const float* y = contacts.grid_y.data();
+    const float* z = contacts.grid_z.data();
+    const float* r = contacts.grid_r.data();
+
+    run_parallel(N_block, [&](size_t b_begin, size_t b_end)
+    {
+        for(size_t b=b_begin; b<b_end; ++b)
+        {
+            std::vector<int>& pairs = block_pairs[b];
+            pairs.clear();
+            for(size_t k=b*block_size; k<std::min((b+1)*block_size,N); ++k)
+            {
+                const int i = grid.sorted[k];
+                if(particles.asleep[i])
+                    continue;
+                const float x1 = x[k], y1 = y[k], z1 = z[k], r1 = r[k];
+                grid.query_ranges(broadphase_position[i], [&](int begin, int end)
+                {
+                    for(int k2=begin; k2<end; ++k2)
+                    {
+                        // Most of the candidates are rejected: test the squared distance first
+                        const float dx = x1-x[k2], dy = y1-y[k2], dz = z1-z[k2];
+                        const float r12 = r1 + r[k2];
+                        const float d2 = dx*dx+dy*dy+dz*dz;
+                        if(d2 > r12*r12 || d2 == 0.0f) // Coincident particles have no contact normal (the particle itself is skipped here)
+                            continue;
+                        const int j = grid.sorted[k2];
+                        if(j<i && !particles.asleep[j])
+                            continue;
+                        pairs.push_back(i);
+                        pairs.push_back(j);
+                    }
+                });
+            }
+        }
+    });
+}
+
+// Pairs found by the sweep and prune: the overlapping boxes are swept by blocks of fixed size of the sorted order
+void sphere_collision_simulation::gather_pairs_sweep_and_prune()
+{
+    const size_t N = particles.size();
+    const size_t block_size = 1024;
+    const size_t N_block = (N+block_size-1)/block_size;
+    std::vector<std::vector<int>>& block_pairs = contacts.block_pairs;
+    block_pairs.resize(N_block);
+
+    const std::vector<int>& asleep = particles.asleep;
+    const std::vector<float>& r = particles.r;
+    run_parallel(N_block, [&](size_t b_begin, size_t b_end)
+    {
+        for(size_t b=b_begin; b<b_end; ++b)
+        {
+            std::vector<int>& pairs = block_pairs[b];
+            pairs.clear();
+            sap.sweep(b*block_size, std::min((b+1)*block_size,N), [&](int i, int j)
+            {
+                if(asleep[i] && asleep[j])
+                    return;
+                const vec3& p1 = broadphase_position[i];
+                const vec3& p2 = broadphase_position[j];
+                const float dx = p1.x-p2.x, dy = p1.y-p2.y, dz = p1.z-p2.z;
+                const float r12 = r[i] + r[j];
+                const float d2 = dx*dx+dy*dy+dz*dz;
+                if(d2 > r12*r12 || d2 == 0.0f)
+                    return;
+                // Same pairs as the grid: i awake, and j asleep or of larger index
+                if(asleep[i] || (!asleep[j] && j<i))
+                    std::swap(i, j);
+                pairs.push_back(i);
+                pairs.push_back(j);
+            });
+        }
+    });
+}
+
+// Overlapping pairs (i,j) of particles at the beginning of the collisions, i being awake. A pair of awake particles is listed once (i<j).
+//  The pairs found from the blocks of particles of the broadphase are gathered in parallel, then concatenated.
+//  The sleeping particles touched by a fast particle are woken up.
+void sphere_collision_simulation::gather_contacts()
+{
+    if(broadphase==SWEEP_AND_PRUNE_BROADPHASE)
+        gather_pairs_sweep_and_prune();
+    else
+        gather_pairs_grid();
+
+    contacts.i.clear();
+    contacts.j.clear();
+    for(const std::vector<int>& pairs : contacts.block_pairs) {
+        for(size_t k=0; k<pairs.size(); k+=2) {
+            contacts.i.push_back(pairs[k]);
+            contacts.j.push_back(pairs[k+1]);
+        }
+    }
+
+    // A sleeping particle is woken up by a fast particle (speed at the beginning of the step, before the gravity), otherwise it remains fixed
+    for(size_t k=0; k<contacts.i.size(); ++k) {
+        const int i = contacts.i[k], j = contacts.j[k];
+        const vec3 v_previous = {vx_previous[i], vy_previous[i], vz_previous[i]};
+        if(particles.asleep[j] && norm(v_previous) > sleep_speed_threshold) {
+            particles.asleep[j] = 0;
+            particles.rest_time[j] = 0.0f;
+            particles_asleep--;
+        }
+    }
+}
+
+// Greedy coloring of the pairs in the order of the list: each pair takes the first color unused by its moving particles
+//  The pairs are then sorted by color (stable counting sort)
+void sphere_collision_simulation::color_contacts()
+{
+    const size_t max_colors = sphere_contacts_structure::max_colors;
+    const size_t N_pair = contacts.i.size();
+    std::vector<uint64_t>& used = contacts.used_colors;
+    used.assign(particles.size(), 0);
+    contacts.color.resize(N_pair);
+    contacts.colors = 0;
+
+    std::vector<size_t>& offset = contacts.color_offset;
+    offset.assign(max_colors+2, 0);
+    for(size_t k=0; k<N_pair; ++k)
+    {
+        const int i = contacts.i[k], j = contacts.j[k];
+        const bool fixed = particles.asleep[j]!=0;
+        const uint64_t taken = used[i] | (fixed? 0 : used[j]);
+
+        size_t c = 0;
+        while(c<max_colors && (taken & (uint64_t(1)<<c))!=0)
+            ++c;
+        if(c<max_colors) {
+            used[i] |= uint64_t(1)<<c;
+            if(!fixed)
+                used[j] |= uint64_t(1)<<c;
+            contacts.colors = std::max(contacts.colors, c+1);
+        }
+        contacts.color[k] = int(c);
+        offset[c+1]++;
+    }
+    for(size_t c=0; c<max_colors+1; ++c)
+        offset[c+1] += offset[c];
+
+    contacts.sorted_i.resize(N_pair);
+    contacts.sorted_j.resize(N_pair);
+    std::vector<size_t> counter(offset.begin(), offset.end()-1);
+    for(size_t k=0; k<N_pair; ++k) {
+        const size_t index = counter[size_t(contacts.color[k])]++;
+        contacts.sorted_i[index] = contacts.i[k];
+        contacts.sorted_j[index] = contacts.j[k];
+    }
+}
+
+// Response of the contact between the particles i (awake) and j (awake, or asleep: fixed obstacle) from their current state
+//  Only modifies i and j: the pairs of a color can be resolved in any order
+//  Written on the float components: this function is called for every contact, several times per step
+void sphere_collision_simulation::resolve_contact(int i, int j, float alpha, float beta)
+{
+    sphere_particles_structure& P = particles;
+    const float dx = P.px[i]-P.px[j], dy = P.py[i]-P.py[j], dz = P.pz[i]-P.pz[j];
+    const float r12 = P.r[i] + P.r[j];
+    const float distance = std::sqrt(dx*dx+dy*dy+dz*dz);
+    if (distance >= r12 || distance == 0.0f)
+        return;
+
+    const bool fixed = P.asleep[j]!=0;
+    const float ux = dx/distance, uy = dy/distance, uz = dz/distance; // Normal, from j to i
+    contact_impulse(i, j, ux, uy, uz, alpha, beta);
+
+    // The overlap is shared between the particles, or entirely removed by i if j is fixed
+    const float d = r12 - distance;
+    const float d1 = fixed? d : d/2;
+    P.px[i] += d1*ux;  P.py[i] += d1*uy;  P.pz[i] += d1*uz;
+    if (!fixed) {
+        const float d2 = d/2;
+        P.px[j] -= d2*ux;  P.py[j] -= d2*uy;  P.pz[j] -= d2*uz;
+    }
+}
+
+// Speeds of the particles i and j (fixed if asleep) in contact along the normal u (from j to i)
+void sphere_collision_simulation::contact_impulse(int i, int j, float ux, float uy, float uz, float alpha, float beta)
+{
+    sphere_particles_structure& P = particles;
+    const bool fixed = P.asleep[j]!=0;
+    const float wx = P.vx[j]-P.vx[i], wy = P.vy[j]-P.vy[i], wz = P.vz[j]-P.vz[i]; // Relative speed
+
+    const float epsilon = 0.0001f;
+    if (std::sqrt(wx*wx+wy*wy+wz*wz) > epsilon)
+    {
+        // Damped speeds, and impulse along the normal if the particles get closer (a fixed particle has an infinite mass)
+        const float m1 = 1;
+        const float m2 = 1;
+        const float m = fixed? m1 : (m1 * m2) / (m1 + m2);
+
+        const float impulse = std::max(2 * m * (wx*ux+wy*uy+wz*uz), 0.0f);
+        const float a1 = beta * impulse/m1;
+        P.vx[i] = alpha*P.vx[i] + a1*ux;  P.vy[i] = alpha*P.vy[i] + a1*uy;  P.vz[i] = alpha*P.vz[i] + a1*uz;
+        if (!fixed) {
+            const float a2 = beta * impulse/m2;
+            P.vx[j] = alpha*P.vx[j] - a2*ux;  P.vy[j] = alpha*P.vy[j] - a2*uy;  P.vz[j] = alpha*P.vz[j] - a2*uz;
+        }
+    }
+    else
+    {
+        // Friction between particles moving together
+        const float mu = 0.5f;
+        P.vx[i] *= mu;  P.vy[i] *= mu;  P.vz[i] *= mu;
+        if (!fixed) {
+            P.vx[j] *= mu;  P.vy[j] *= mu;  P.vz[j] *= mu;
+        }
+    }
+}
+
+// Continuous collisions between particles: the motion of each fast particle over the step (from its previous position to its
+//  position after the integration) is swept against the motion of the other particles (found by the sweep and prune, whose boxes contain
+//  the motions, or with the grid: the slow ones around the motion, the fast ones by sorting the boxes of their motions). The first impacts
+//  are then handled in increasing time, each particle at most once: the two particles are moved back to their positions at the
+//  impact, their speeds are updated as for a contact, and they move with their new speed during the rest of the step.
+//  Returns true if some particles were moved. The result doesn't depend on the number of threads.
+bool sphere_collision_simulation::sweep_particles(float dt, float alpha, float beta)
+{
+    sphere_particles_structure& P = particles;
+    const size_t N = P.size();
+
+    ccd_fast.clear();
+    ccd_fast_slot.assign(N, 0);
+    float r_max = 0.0f;
+    float d_slow = 0.0f; // Largest motion of the particles that are not fast
+    for(size_t k=0; k<N; ++k)
+    {
+        r_max = std::max(r_max, P.r[k]);
+        if(P.asleep[k])
+            continue;
+        const float dx = P.px[k]-px_previous[k], dy = P.py[k]-py_previous[k], dz = P.pz[k]-pz_previous[k];
+        const float d2 = dx*dx+dy*dy+dz*dz;
+        const float threshold = ccd_threshold*P.r[k];
+        if(d2 > threshold*threshold) {
+            ccd_fast.push_back(int(k));
+            ccd_fast_slot[k] = int(ccd_fast.size());
+        }
+        else
+            d_slow = std::max(d_slow, std::sqrt(d2));
+    }
+    const size_t F = ccd_fast.size();
+    ccd_handled.assign(N, 0);
+    if(F==0)
+        return false;
+
+    // Time of impact of the particles i and j, kept in the event of i if it is earlier
+    auto sweep_pair = [&](int i, int j, sphere_ccd_event& event)
+    {
+        const vec3 p1 = {px_previous[i], py_previous[i], pz_previous[i]};
+        const vec3 p2 = {px_previous[j], py_previous[j], pz_previous[j]};
+        const vec3 d1 = {P.px[i]-p1.x, P.py[i]-p1.y, P.pz[i]-p1.z};
+        const vec3 d2 = {P.px[j]-p2.x, P.py[j]-p2.y, P.pz[j]-p2.z};
+        float t;
+        if(ccd_spheres_time_of_impact(p1, d1, p2, d2, P.r[i]+P.r[j], t) && (t<event.t || (t==event.t && j<event.j)))
+            event = {t, i, j};
+    };
+
+    ccd_candidates.resize(F);
+    if(broadphase==SWEEP_AND_PRUNE_BROADPHASE)
+    {
+        // The boxes of the sweep and prune contain the motions of the particles: the pairs of overlapping boxes with a fast particle
+        //  are swept by blocks of the sorted order, the impacts found are then kept in the events of their fast particles
+        for(size_t k=0; k<F; ++k)
+            ccd_candidates[k] = {2.0f, ccd_fast[k], -1};
+        const size_t block_size = 1024;
+        const size_t N_block = (N+block_size-1)/block_size;
+        ccd_block_impacts.resize(N_block);
+        run_parallel(N_block, [&](size_t b_begin, size_t b_end)
+        {
+            for(size_t b=b_begin; b<b_end; ++b)
+            {
+                std::vector<sphere_ccd_event>& impacts = ccd_block_impacts[b];
+                impacts.clear();
+                sap.sweep(b*block_size, std::min((b+1)*block_size,N), [&](int i, int j)
+                {
+                    if(ccd_fast_slot[i]==0 && ccd_fast_slot[j]==0)
+                        return;
+                    sphere_ccd_event event = {2.0f, i, -1};
+                    sweep_pair(i, j, event);
+                    if(event.j>=0)
+                        impacts.push_back(event);
+                });
+            }
+        });
+        for(const std::vector<sphere_ccd_event>& impacts : ccd_block_impacts) {
+            for(const sphere_ccd_event& impact : impacts) {
+                // The time of impact is symmetric: the impact is kept by both particles if they are fast
+                const int slots[2] = {ccd_fast_slot[impact.i], ccd_fast_slot[impact.j]};
+                const int other[2] = {impact.j, impact.i};
+                for(int s=0; s<2; ++s) {
+                    if(slots[s]==0)
+                        continue;
+                    sphere_ccd_event& event = ccd_candidates[slots[s]-1];
+                    if(impact.t<event.t || (impact.t==event.t && other[s]<event.j))
+                        event = {impact.t, event.i, other[s]};
+                }
+            }
+        }
+    }
+    else
+    {
+        // Bounding box of the motion of each fast particle, enlarged by its radius
+        ccd_box_min.resize(F);
+        ccd_box_max.resize(F);
+        for(size_t k=0; k<F; ++k) {
+            const int i = ccd_fast[k];
+            const float r = P.r[i];
+            ccd_box_min[k] = {std::min(px_previous[i],P.px[i])-r, std::min(py_previous[i],P.py[i])-r, std::min(pz_previous[i],P.pz[i])-r};
+            ccd_box_max[k] = {std::max(px_previous[i],P.px[i])+r, std::max(py_previous[i],P.py[i])+r, std::max(pz_previous[i],P.pz[i])+r};
+        }
+
+        // Impacts with the slow particles: their positions at the end of the step, stored in the grid, are close to their motion
+        run_parallel(F, [&](size_t k_begin, size_t k_end)
+        {
+            for(size_t k=k_begin; k<k_end; ++k)
+            {
+                const int i = ccd_fast[k];
+                sphere_ccd_event event = {2.0f, i, -1};
+                const float margin = r_max + d_slow;
+                const vec3 p_min = ccd_box_min[k]-vec3(margin,margin,margin);
+                const vec3 p_max = ccd_box_max[k]+vec3(margin,margin,margin);
+                auto sweep_slow = [&](int j)
+                {
+                    if(ccd_fast_slot[j]==0)
+                        sweep_pair(i, j, event);
+                };
+                grid.query_box(p_min, p_max, sweep_slow);
+                ccd_candidates[k] = event;
+            }
+        });
+
+        // Impacts between fast particles: pairs whose boxes overlap, found by sorting the boxes along x
+        ccd_order.resize(F);
+        for(size_t k=0; k<F; ++k)
+            ccd_order[k] = int(k);
+        std::sort(ccd_order.begin(), ccd_order.end(), [&](int a, int b) {
+            return ccd_box_min[a].x<ccd_box_min[b].x || (ccd_box_min[a].x==ccd_box_min[b].x && a<b);
+        });
+        for(size_t m=0; m<F; ++m)
+        {
+            const int a = ccd_order[m];
+            for(size_t m2=m+1; m2<F && ccd_box_min[ccd_order[m2]].x<=ccd_box_max[a].x; ++m2)
+            {
+                const int b = ccd_order[m2];
+                if(ccd_box_min[b].y>ccd_box_max[a].y || ccd_box_min[a].y>ccd_box_max[b].y || ccd_box_min[b].z>ccd_box_max[a].z || ccd_box_min[a].z>ccd_box_max[b].z)
+                    continue;
+                sweep_pair(ccd_fast[a], ccd_fast[b], ccd_candidates[a]);
+                sweep_pair(ccd_fast[b], ccd_fast[a], ccd_candidates[b]);
+            }
+        }
+    }
+
+    std::vector<sphere_ccd_event> events;
+    for(const sphere_ccd_event& event : ccd_candidates)
+        if(event.j>=0)
+            events.push_back(event);
+    if(events.empty())
+        return false;
+    std::sort(events.begin(), events.end(), [](const sphere_ccd_event& a, const sphere_ccd_event& b) {
+        return a.t<b.t || (a.t==b.t && (a.i<b.i || (a.i==b.i && a.j<b.j)));
+    });
+
+    ccd_impact.resize(N);
+    ccd_impact_t.resize(N);
+    bool moved = false;
+    for(const sphere_ccd_event& event : events)
+    {
+        const int i = event.i, j = event.j;
+        if(ccd_handled[i] || ccd_handled[j])
+            continue;
+        const float t = event.t;
+
+        // Positions at the impact
+        const vec3 p1 = {px_previous[i], py_previous[i], pz_previous[i]};
+        const vec3 p2 = {px_previous[j], py_previous[j], pz_previous[j]};
+        const vec3 c1 = p1 + t*(P.position(i)-p1);
+        const vec3 c2 = p2 + t*(P.position(j)-p2);
+        const float distance = norm(c1-c2);
+        if(distance == 0.0f)
+            continue;
+        ccd_handled[i] = 1;
+        ccd_handled[j] = 1;
+        ccd_impact[i] = c1;
+        ccd_impact[j] = c2;
+        ccd_impact_t[i] = t;
+        ccd_impact_t[j] = t;
+
+        // A sleeping particle is woken up by a fast particle, as for the contacts
+        const vec3 v_previous = {vx_previous[i], vy_previous[i], vz_previous[i]};
+        if(P.asleep[j] && norm(v_previous) > sleep_speed_threshold) {
+            P.asleep[j] = 0;
+            P.rest_time[j] = 0.0f;
+            particles_asleep--;
+        }
+
+        const vec3 u = (c1-c2)/distance;
+        contact_impulse(i, j, u.x, u.y, u.z, alpha, beta);
+
+        // Rest of the step with the new speeds
+        const float remaining = (1-t)*dt;
+        P.set_position(i, c1 + remaining*P.speed(i));
+        if(!P.asleep[j])
+            P.set_position(j, c2 + remaining*P.speed(j));
+        moved = true;
+        ccd_events++;
+    }
+    return moved;
+}
+
+// Continuous collisions of the fast particles with the planes of the box or the container sphere: the motion of the particle over
+//  the step is swept against the borders, at each impact the particle is moved to the impact position, bounces, and continues with its
+//  new speed during the rest of the step (up to ccd_max_events impacts). The mesh obstacle remains detected at the end of the step.
+//  The particles redirected by an impact with another particle are swept from this impact over the rest of the step.
+void sphere_collision_simulation::sweep_borders(float dt, float alpha, float beta)
+{
+    const bool box_planes = current_inter == BOX || current_inter == MESH;
+    if(!box_planes && current_inter != SPHERE)
+        return;
+
+    sphere_particles_structure& P = particles;
+    std::atomic<size_t> events(0);
+    run_parallel(ccd_fast.size(), [&](size_t k_begin, size_t k_end)
+    {
+        size_t local_events = 0;
+        for(size_t k=k_begin; k<k_end; ++k)
+        {
+            const int i = ccd_fast[k];
+            if(P.asleep[i])
+                continue;
+            const float r = P.r[i];
+            vec3 p = {px_previous[i], py_previous[i], pz_previous[i]};
+            float time_left = dt;
+            if(ccd_handled[i]) {
+                p = ccd_impact[i];
+                time_left = (1-ccd_impact_t[i])*dt;
+            }
+            vec3 d = P.position(i)-p;
+            vec3 v = P.speed(i);
+
+            int impacts = 0;
+            while(impacts<ccd_max_events)
+            {
+                // First impact among the borders
+                float t_min = 1.0f;
+                vec3 n;
+                bool impact = false;
+                float t;
+                if(box_planes) {
+                    for(size_t j=0; j<plane_points.size(); ++j) {
+                        if(ccd_plane_time_of_impact(p, d, r, plane_points[j], plane_normals[j], t) && t<t_min) {
+                            t_min = t;
+                            n = plane_normals[j];
+                            impact = true;
+                        }
+                    }
+                }
+                else if(ccd_container_time_of_impact(p, d, r, sphere_p, sphere_r, t)) {
+                    t_min = t;
+                    n = normalize(sphere_p - (p+t*d));
+                    impact = true;
+                }
+                if(!impact)
+                    break;
+
+                p = p + t_min*d;
+                const vec3 v_ortho = dot(v, n) * n;
+                const vec3 v_parallel = v - v_ortho;
+                v = alpha * v_parallel - beta * v_ortho;
+                time_left *= 1-t_min;
+                d = time_left*v;
+                impacts++;
+            }
+
+            if(impacts>0) {
+                P.set_position(i, p+d);
+                P.set_speed(i, v);
+            }
+            local_events += size_t(impacts);
+        }
+        events += local_events;
+    });
+    ccd_events += events;
+}
+
+// Sort the particles in the grid or in the sweep and prune, from broadphase_position
+//  With ccd, the boxes of the sweep and prune also contain the positions at the beginning of the step: the pairs of particles whose
+//  motions may cross are found by the same sweep as the overlapping ones
+void sphere_collision_simulation::update_broadphase(float r_max)
+{
+    const size_t N = particles.size();
+    if(N==0)
+        return;
+    if(broadphase!=SWEEP_AND_PRUNE_BROADPHASE) {
+        grid.build(broadphase_position, 2*r_max);
+        return;
+    }
+
+    broadphase_box_min.resize(N);
+    broadphase_box_max.resize(N);
+    for(size_t k=0; k<N; ++k) {
+        const vec3& p = broadphase_position[k];
+        const float r = particles.r[k];
+        vec3 p_min = p, p_max = p;
+        if(ccd) {
+            p_min = {std::min(p.x,px_previous[k]), std::min(p.y,py_previous[k]), std::min(p.z,pz_previous[k])};
+            p_max = {std::max(p.x,px_previous[k]), std::max(p.y,py_previous[k]), std::max(p.z,pz_previous[k])};
+        }
+        broadphase_box_min[k] = {p_min.x-r, p_min.y-r, p_min.z-r};
+        broadphase_box_max[k] = {p_max.x+r, p_max.y+r, p_max.z+r};
+    }
+    sap.update(broadphase_box_min, broadphase_box_max);
+}
+
+void sphere_collision_simulation::set_threads(size_t number_of_threads)
+{
+    threads = number_of_threads;
+    pool.resize(threads);
+    multithreading = pool.size()>1;
+}
+
+// Apply f on contiguous ranges covering [0,N[, on the thread pool if multithreading is enabled
+void sphere_collision_simulation::run_parallel(size_t N, const std::function<void(size_t,size_t)>& f)
+{
+    if(N==0)
+        return;
+    if(multithreading && pool.size()>1)
+        parallel_for(pool, 0, N, f);
+    else
+        f(0, N);
+}
+
+// Age the particles, and remove the expired and escaped ones (in decreasing index: the particles moved at the place of the removed ones are already checked)
+void sphere_collision_simulation::cull_particles(float dt)
+{
+    culled_position.clear();
+    culled_r.clear();
+    for(size_t k=particles.size(); k>0; --k)
+    {
+        const size_t i = k-1;
+        particles.age[i] += dt;
+
+        const bool expired = lifetime>0 && particles.age[i]>lifetime;
+        // The comparisons are false for the NaN coordinates: they are culled as escaped particles
+        const bool inside = std::abs(particles.px[i])<=cull_distance && std::abs(particles.py[i])<=cull_distance && std::abs(particles.pz[i])<=cull_distance;
+        if(expired || (cull_escaped && !inside)) {
+            if(particles.asleep[i])
+                particles_asleep--;
+            if(std::isfinite(particles.px[i]+particles.py[i]+particles.pz[i])) {
+                culled_position.push_back({particles.px[i], particles.py[i], particles.pz[i]});
+                culled_r.push_back(particles.r[i]);
+            }
+            particles.remove(i);
+            particles_culled++;
+        }
+    }
+    wake_up_culled_neighbors();
+}
+
+// Wake up the sleeping particles in contact with the particles culled at the current step: they may rest on them
+void sphere_collision_simulation::wake_up_culled_neighbors()
+{
+    if(culled_position.size()==0 || particles_asleep==0)
+        return;
+
+    float r_max = 0.0f;
+    for(float r : culled_r)
+        r_max = std::max(r_max, r);
+    for(float r : particles.r)
+        r_max = std::max(r_max, r);
+    // Contacts are detected with a small margin: the particles at rest may be slightly apart from their support
+    const float margin = 1.05f;
+    culled_grid.build(culled_position, 2*margin*r_max);
+    const size_t N = particles.size();
+    for(size_t k=0; k<N; ++k)
+    {
+        if(!particles.asleep[k])
+            continue;
+        const vec3 p = {particles.px[k], particles.py[k], particles.pz[k]};
+        bool contact = false;
+        culled_grid.query(p, [&](int c) { contact = contact || norm(culled_position[c]-p) < margin*(culled_r[c]+particles.r[k]); });
+        if(contact) {
+            particles.asleep[k] = 0;
+            particles.rest_time[k] = 0.0f;
+            particles_asleep--;
+        }
+    }
+}
+
+void sphere_collision_simulation::wake_up_all()
+{
+    std::fill(particles.asleep.begin(), particles.asleep.end(), 0);
+    std::fill(particles.rest_time.begin(), particles.rest_time.end(), 0.0f);
+    particles_asleep = 0;
+}
+
+void sphere_collision_simulation::update_sleeping(float dt)
+{
+    if(!sleeping)
+        return;
+
+    const size_t N = particles.size();
+    for(size_t k=0; k<N; ++k)
+    {
+        if(particles.asleep[k])
+            continue;
+
+        const vec3 v = particles.speed(k);
+        const vec3 v_previous = {vx_previous[k], vy_previous[k], vz_previous[k]};
+        const bool rest = norm(v) <= sleep_speed_threshold && norm(v-v_previous) <= dt*sleep_acceleration_threshold;
+        particles.rest_time[k] = rest? particles.rest_time[k]+dt : 0.0f;
+        if(particles.rest_time[k] >= sleep_time_window) {
+            particles.asleep[k] = 1;
+            particles.set_speed(k, {0,0,0});
+            particles_asleep++;
+        }
+    }
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+// Simulation of the colliding spheres, independent of the rendering (no OpenGL or GUI dependency)
+//  Used by the sphere collision scene, and by the headless benchmark (headless/main_headless.cpp)
+
+#include "vcl/base/base.hpp"
+#include "vcl/math/math.hpp"
+#include "vcl/containers/containers.hpp"
+#include "vcl/shape/mesh/mesh_structure/mesh.hpp"
+#include "vcl/shape/sdf_grid/sdf_grid.hpp"
+#include "vcl/shape/uniform_grid/uniform_grid.hpp"
+#include "vcl/shape/sweep_and_prune/sweep_and_prune.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+// Structure of a particle (copy of one particle of sphere_particles_structure)
+struct particle_structure
+{
+    vcl::vec3 p; // Position
+    vcl::vec3 v; // Speed
+
+    vcl::vec3 c; // Color
+    float r;     // Radius
+
+    bool asleep;     // Particle at rest: skipped by the integration and the collisions, acts as a fixed obstacle
+    float rest_time; // Time spent at rest
+    float age;       // Time since the emission
+};
+
+// Particles stored as a structure of arrays: each component is contiguous in memory so that the integration and the collisions
+//  with the box run on vector registers (sphere_kernels/). The gravity being the only force, it isn't stored per particle.
+// The arrays are reserved once for the capacity of the pool: adding a particle never reallocates them, and a particle is removed
+//  in O(1) by moving the last one at its place (the order of the particles isn't preserved).
+struct sphere_particles_structure
+{
+    std::vector<float> px, py, pz; // Position
+    std::vector<float> vx, vy, vz; // Speed
+    std::vector<float> r;          // Radius
+    std::vector<float> cr, cg, cb; // Color
+    std::vector<int> asleep;       // 1 for the particles at rest (int to be read as a mask by the kernels)
+    std::vector<float> rest_time;
+    std::vector<float> age;        // Time since the emission
+
+    size_t size() const { return px.size(); }
+    size_t capacity() const { return px.capacity(); }
+    void reserve(size_t capacity);
+    void clear();
+    void push_back(const particle_structure& particle);
+    void remove(size_t k);
+
+    vcl::vec3 position(size_t k) const { return {px[k], py[k], pz[k]}; }
+    vcl::vec3 speed(size_t k) const { return {vx[k], vy[k], vz[k]}; }
+    vcl::vec3 color(size_t k) const { return {cr[k], cg[k], cb[k]}; }
+    void set_position(size_t k, const vcl::vec3& p) { px[k] = p.x; py[k] = p.y; pz[k] = p.z; }
+    void set_speed(size_t k, const vcl::vec3& v) { vx[k] = v.x; vy[k] = v.y; vz[k] = v.z; }
+
+    /** Copy of the particle k (used by the display) */
+    particle_structure operator[](size_t k) const;
+};
+
+// Contacts between particles gathered at each step, grouped by color: the pairs of a color don't share any moving particle
+//  (a sleeping particle is a fixed obstacle: it can be shared) and are resolved in parallel.
+struct sphere_contacts_structure
+{
+    static const size_t max_colors = 64;    // Pairs that cannot be colored are resolved sequentially after the colors
+
+    std::vector<float> grid_x, grid_y, grid_z, grid_r; // Positions and radii of the particles in the order of the grid (grid.sorted)
+    std::vector<std::vector<int>> block_pairs; // Pairs (i,j interleaved) found from each block of particles, in the order of the broadphase
+    std::vector<int> i, j;                     // Pairs gathered at the current step
+    std::vector<int> color;                    // Color of each pair
+    std::vector<uint64_t> used_colors;         // Colors used by the pairs of each particle
+    std::vector<int> sorted_i, sorted_j;       // Pairs sorted by color
+    std::vector<size_t> color_offset;          // Pairs of the color c: [color_offset[c], color_offset[c+1][, the last color (max_colors) holds the uncolored pairs
+    size_t colors = 0;                         // Number of colors used at the last step
+};
+
+// Collision found by the continuous collision detection: particles i and j touch at the fraction t of the step
+struct sphere_ccd_event
+{
+    float t;
+    int i, j;
+};
+
+// Shape containing the particles
+enum intersection_type { BOX = 0, SPHERE = 1, MESH = 2};
+
+// Broadphase of the collisions between particles
+enum broadphase_type { GRID_BROADPHASE = 0, SWEEP_AND_PRUNE_BROADPHASE = 1 };
+
+// Time spent in each phase of the simulation, accumulated over the steps since the last reset (s)
+struct sphere_collision_timings_structure
+{
+    double integration;         // Forces and integration
+    double particle_collisions; // Collisions between particles
+    double border_collisions;   // Collisions with the box, the sphere or the mesh obstacle (and update of the sleeping particles)
+    size_t steps;               // Number of steps
+};
+
+// Continuous collision detection: time of impact t in [0,1[ (fraction of the motion d) of a sphere of radius r moving from p to p+d,
+//  against the positive side of the plane (a,n), or against the inner side of the sphere (c,R). False if there is no impact during the motion.
+bool ccd_plane_time_of_impact(const vcl::vec3& p, const vcl::vec3& d, float r, const vcl::vec3& a, const vcl::vec3& n, float& t);
+bool ccd_container_time_of_impact(const vcl::vec3& p, const vcl::vec3& d, float r, const vcl::vec3& c, float R, float& t);
+// Time of impact t in [0,1] of two spheres moving from p1 to p1+d1 and from p2 to p2+d2 (r12: sum of their radii), false if they don't
+//  get in contact or already overlap at the beginning
+bool ccd_spheres_time_of_impact(const vcl::vec3& p1, const vcl::vec3& d1, const vcl::vec3& p2, const vcl::vec3& d2, float r12, float& t);
+
+struct sphere_collision_simulation
+{
+    sphere_particles_structure particles;
+    float particle_radius = 0.08f; // Radius of the emitted particles
+    float particle_radius_spread = 1.0f; // Radii of the emitted particles drawn in [particle_radius, spread x particle_radius] (log-uniform)
+
+    // Bounds of the pool of particles: the emission stops when the pool is full, the particles older than the lifetime (if positive)
+    //  and those escaped from the box (farther than cull_distance along an axis, or with non finite coordinates) are removed
+    size_t max_particles = 2000;
+    float lifetime = 0.0f;
+    bool cull_escaped = true;
+    float cull_distance = 2.0f;
+    size_t particles_culled = 0;   // Number of particles removed since the initialization
+
+    // Broadphase of the collisions between particles, updated at each step from the positions at the beginning of the collisions:
+    //  grid rebuilt from scratch (cells of the size of the largest particle), or sweep and prune of the boxes of the particles sorted from
+    //  the order of the previous step (independent of the largest radius: suited to particles of very different sizes)
+    broadphase_type broadphase = GRID_BROADPHASE;
+    vcl::uniform_grid grid;
+    vcl::sweep_and_prune sap;
+    vcl::buffer<vcl::vec3> broadphase_position;
+    vcl::buffer<vcl::vec3> broadphase_box_min, broadphase_box_max; // Boxes of the particles in the sweep and prune (containing their motion over the step with ccd)
+
+    sphere_contacts_structure contacts;
+    int contact_iterations = 2;   // Number of passes over the colors at each step
+
+    // Worker threads used by the integration and the collisions. The results don't depend on the number of threads.
+    vcl::thread_pool pool;
+    size_t threads = 0;         // Size of the pool set by set_threads (0: number of hardware threads)
+    bool multithreading = true;
+
+    intersection_type current_inter = BOX;
+
+    std::vector<vcl::vec3> plane_points;
+    std::vector<vcl::vec3> plane_normals;
+
+    vcl::vec3 sphere_p = {0.f, 0.f, 0.f};
+    float sphere_r = 1.f;
+
+    vcl::sdf_grid obstacle_sdf;   // Distance field of the mesh obstacle
+
+    sphere_collision_timings_structure timings = sphere_collision_timings_structure();
+
+    bool simd = true;             // Use the vectorized kernels when the CPU supports them
+
+    unsigned int seed = 0;        // Seed of the random generator used by the emission, reset at each initialization
+
+    // Sleeping of the particles at rest
+    //  A particle falls asleep when its speed and its acceleration (speed change over a step, collisions included) remained below
+    //  the thresholds during a time window. It wakes up when a particle faster than the threshold hits it, or when a particle in
+    //  contact with it is culled. All the particles wake up when the gravity direction or the obstacle change.
+    bool sleeping = false;
+    float sleep_speed_threshold = 0.1f;
+    float sleep_acceleration_threshold = 2.0f;
+    float sleep_time_window = 0.5f;
+    size_t particles_asleep = 0;
+    std::vector<float> vx_previous, vy_previous, vz_previous; // Speed at the beginning of the step
+    vcl::buffer<vcl::vec3> culled_position;  // Particles culled at the current step (finite positions), and their radii
+    std::vector<float> culled_r;
+    vcl::uniform_grid culled_grid;           // Grid of the culled particles, queried from the sleeping ones
+    vcl::vec3 gravity_previous = {0,0,0};   // Gravity direction and obstacle at the previous step
+    intersection_type inter_previous = BOX;
+
+    // Continuous collision detection of the fast particles (moving more than ccd_threshold times their radius over a step)
+    //  Their motion over the step is swept against the other particles and the box planes (or the container sphere): the first impact
+    //  of each particle with another one, and up to ccd_max_events impacts with the borders, are handled at their time within the step.
+    //  The other collisions are detected at the end of the step, by the overlaps.
+    bool ccd = false;
+    float ccd_threshold = 1.0f;
+    int ccd_max_events = 4;
+    size_t ccd_events = 0;         // Number of impacts handled since the initialization
+    std::vector<float> px_previous, py_previous, pz_previous; // Position at the beginning of the step
+    std::vector<int> ccd_fast;                     // Fast particles of the current step
+    std::vector<int> ccd_fast_slot;                // Position of each particle in ccd_fast plus one, 0 for the slow particles
+    std::vector<vcl::vec3> ccd_box_min, ccd_box_max; // Bounding box of the motion of each fast particle (grid broadphase)
+    std::vector<int> ccd_order;                    // Fast particles sorted by ccd_box_min.x (grid broadphase)
+    std::vector<std::vector<sphere_ccd_event>> ccd_block_impacts; // Impacts found from each block of the sweep and prune
+    std::vector<sphere_ccd_event> ccd_candidates;  // First impact of each fast particle with another particle (t>1 if none)
+    std::vector<int> ccd_handled;                  // 1 for the particles whose impact was handled at the current step
+    std::vector<vcl::vec3> ccd_impact;             // Position of the handled particles at their impact: their sweep against the borders
+    std::vector<float> ccd_impact_t;               //  continues from there over the rest of the step (time of the impact, fraction of the step)
+
+
+    void initialize();
+    bool save_state(const std::string& filename) const;
+    bool load_state(const std::string& filename);
+    static vcl::mesh obstacle_mesh();
+    bool emit_particle();
+    void cull_particles(float dt);
+    void compute_time_step(float dt, const vcl::vec3& gravity_direction);
+    void wake_up_all();
+    void wake_up_culled_neighbors();
+    /** Restart the pool with number_of_threads threads (0: number of hardware threads), multithreading is enabled if there are several */
+    void set_threads(size_t number_of_threads);
+    void update_sleeping(float dt);
+
+    void update_broadphase(float r_max);
+    void gather_contacts();
+    void gather_pairs_grid();
+    void gather_pairs_sweep_and_prune();
+    void color_contacts();
+    void resolve_contact(int i, int j, float alpha, float beta);
+    void contact_impulse(int i, int j, float ux, float uy, float uz, float alpha, float beta);
+    bool sweep_particles(float dt, float alpha, float beta);
+    void sweep_borders(float dt, float alpha, float beta);
+    void run_parallel(size_t N, const std::function<void(size_t,size_t)>& f);
+};
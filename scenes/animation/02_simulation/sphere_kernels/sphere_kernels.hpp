@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+
+// Vectorized kernels of the sphere collision scene, working on the structure of arrays of the particles (sphere_particles_structure).
+//  The scalar code of the scene remains the reference: the kernels reproduce its sequence of floating point operations
+//  so that both paths give the same values.
+//  Each kernel only processes full vector registers and returns the number of elements processed: the remaining
+//  elements are left to the scalar code.
+//
+// Kernels are provided for SSE2 (4 floats) and AVX2 (8 floats). The caller is responsible to select a version supported by the CPU (vcl::simd_support()).
+
+// Integration of the particles [0,N[ under a constant force f with friction: v = damping v + dt f, p = p + dt v
+//  The particles whose asleep flag is set are left unchanged.
+size_t integrate_particles_sse(float* px, float* py, float* pz, float* vx, float* vy, float* vz, const int* asleep,
+                               float damping, float dt, float fx, float fy, float fz, size_t N);
+size_t integrate_particles_avx(float* px, float* py, float* pz, float* vx, float* vy, float* vz, const int* asleep,
+                               float damping, float dt, float fx, float fy, float fz, size_t N);
+
+// Collisions of the particles [0,N[ (radius r) with the planes [0,plane_count[ given by a point and a normal (x,y,z interleaved),
+//  tested in order. A particle below a plane is projected on it, the normal and tangential components of its speed are scaled
+//  by -beta and alpha. The particles whose asleep flag is set are left unchanged.
+size_t plane_collisions_sse(float* px, float* py, float* pz, float* vx, float* vy, float* vz, const float* r, const int* asleep,
+                            const float* plane_point, const float* plane_normal, size_t plane_count, float alpha, float beta, size_t N);
+size_t plane_collisions_avx(float* px, float* py, float* pz, float* vx, float* vy, float* vz, const float* r, const int* asleep,
+                            const float* plane_point, const float* plane_normal, size_t plane_count, float alpha, float beta, size_t N);
@@ -0,0 +1,48 @@
+#include "sphere_kernels.hpp"
+
+// This file is compiled with AVX2 enabled (see CMakeLists.txt and Makefile): its functions must only be called after checking the CPU support.
+// It must not use non-inlined code shared with other translation units (such as the STL) that could be compiled with AVX2 instructions.
+#if defined(__AVX2__) || (defined(_MSC_VER) && defined(_M_X64))
+
+#include <immintrin.h>
+#include "sphere_kernels_impl.hpp"
+
+namespace
+{
+struct pack_avx
+{
+    typedef __m256 type;
+    static const size_t size = 8;
+
+    static type load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, type a) { _mm256_storeu_ps(p, a); }
+    static type set1(float a) { return _mm256_set1_ps(a); }
+    static type add(type a, type b) { return _mm256_add_ps(a, b); }
+    static type sub(type a, type b) { return _mm256_sub_ps(a, b); }
+    static type mul(type a, type b) { return _mm256_mul_ps(a, b); }
+    static type less_equal(type a, type b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static type logical_and(type a, type b) { return _mm256_and_ps(a, b); }
+    static type select(type mask, type a, type b) { return _mm256_blendv_ps(b, a, mask); }
+    static type awake(const int* asleep) { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(asleep)), _mm256_setzero_si256())); }
+};
+}
+
+size_t integrate_particles_avx(float* px, float* py, float* pz, float* vx, float* vy, float* vz, const int* asleep,
+                               float damping, float dt, float fx, float fy, float fz, size_t N)
+{
+    return sphere_kernels::integrate_particles<pack_avx>(px, py, pz, vx, vy, vz, asleep, damping, dt, fx, fy, fz, N);
+}
+
+size_t plane_collisions_avx(float* px, float* py, float* pz, float* vx, float* vy, float* vz, const float* r, const int* asleep,
+                            const float* plane_point, const float* plane_normal, size_t plane_count, float alpha, float beta, size_t N)
+{
+    return sphere_kernels::plane_collisions<pack_avx>(px, py, pz, vx, vy, vz, r, asleep, plane_point, plane_normal, plane_count, alpha, beta, N);
+}
+
+#else
+
+// AVX2 is not available for this compiler/architecture: everything is left to the scalar code
+size_t integrate_particles_avx(float*, float*, float*, float*, float*, float*, const int*, float, float, float, float, float, size_t) { return 0; }
+size_t plane_collisions_avx(float*, float*, float*, float*, float*, float*, const float*, const int*, const float*, const float*, size_t, float, float, size_t) { return 0; }
+
+#endif
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+
+// Generic implementation of the sphere kernels, instantiated for each instruction set with a "pack" type P providing:
+//  P::type, P::size, load, store, set1, add, sub, mul, less_equal, logical_and, select, awake
+// Only included by the translation units of the kernels.
+
+namespace sphere_kernels
+{
+
+template <typename P>
+size_t integrate_particles(float* px, float* py, float* pz, float* vx, float* vy, float* vz, const int* asleep,
+                           float damping, float dt, float fx, float fy, float fz, size_t N)
+{
+    typedef typename P::type T;
+    const T vdamping = P::set1(damping);
+    const T vdt = P::set1(dt);
+    const T dt_fx = P::set1(dt*fx), dt_fy = P::set1(dt*fy), dt_fz = P::set1(dt*fz);
+
+    size_t k = 0;
+    for(; k+P::size<=N; k+=P::size)
+    {
+        const T awake = P::awake(asleep+k);
+        const T vx0 = P::load(vx+k), vy0 = P::load(vy+k), vz0 = P::load(vz+k);
+        const T vx1 = P::add(P::mul(vdamping,vx0), dt_fx);
+        const T vy1 = P::add(P::mul(vdamping,vy0), dt_fy);
+        const T vz1 = P::add(P::mul(vdamping,vz0), dt_fz);
+        P::store(vx+k, P::select(awake, vx1, vx0));
+        P::store(vy+k, P::select(awake, vy1, vy0));
+        P::store(vz+k, P::select(awake, vz1, vz0));
+
+        const T px0 = P::load(px+k), py0 = P::load(py+k), pz0 = P::load(pz+k);
+        P::store(px+k, P::select(awake, P::add(px0, P::mul(vdt,vx1)), px0));
+        P::store(py+k, P::select(awake, P::add(py0, P::mul(vdt,vy1)), py0));
+        P::store(pz+k, P::select(awake, P::add(pz0, P::mul(vdt,vz1)), pz0));
+    }
+    return k;
+}
+
+template <typename P>
+size_t plane_collisions(float* px, float* py, float* pz, float* vx, float* vy, float* vz, const float* r, const int* asleep,
+                        const float* plane_point, const float* plane_normal, size_t plane_count, float alpha, float beta, size_t N)
+{
+    typedef typename P::type T;
+    const T valpha = P::set1(alpha);
+    const T vbeta = P::set1(beta);
+    const T zero = P::set1(0.0f);
+
+    size_t k = 0;
+    for(; k+P::size<=N; k+=P::size)
+    {
+        const T awake = P::awake(asleep+k);
+        const T vr = P::load(r+k);
+        T x = P::load(px+k), y = P::load(py+k), z = P::load(pz+k);
+        T u = P::load(vx+k), v = P::load(vy+k), w = P::load(vz+k);
+
+        for(size_t j=0; j<plane_count; ++j)
+        {
+            const T ax = P::set1(plane_point[3*j]), ay = P::set1(plane_point[3*j+1]), az = P::set1(plane_point[3*j+2]);
+            const T nx = P::set1(plane_normal[3*j]), ny = P::set1(plane_normal[3*j+1]), nz = P::set1(plane_normal[3*j+2]);
+
+            // The dot products are accumulated from 0 as vcl::dot (same sign of the zero results)
+            const T detection = P::add(P::add(P::add(zero, P::mul(P::sub(x,ax),nx)), P::mul(P::sub(y,ay),ny)), P::mul(P::sub(z,az),nz));
+            const T contact = P::logical_and(awake, P::less_equal(detection, vr));
+
+            const T vn = P::add(P::add(P::add(zero, P::mul(u,nx)), P::mul(v,ny)), P::mul(w,nz));
+            const T ux = P::mul(vn,nx), uy = P::mul(vn,ny), uz = P::mul(vn,nz);
+            u = P::select(contact, P::sub(P::mul(valpha,P::sub(u,ux)), P::mul(vbeta,ux)), u);
+            v = P::select(contact, P::sub(P::mul(valpha,P::sub(v,uy)), P::mul(vbeta,uy)), v);
+            w = P::select(contact, P::sub(P::mul(valpha,P::sub(w,uz)), P::mul(vbeta,uz)), w);
+
+            const T d = P::sub(vr, detection);
+            x = P::select(contact, P::add(x, P::mul(d,nx)), x);
+            y = P::select(contact, P::add(y, P::mul(d,ny)), y);
+            z = P::select(contact, P::add(z, P::mul(d,nz)), z);
+        }
+
+        P::store(px+k, x); P::store(py+k, y); P::store(pz+k, z);
+        P::store(vx+k, u); P::store(vy+k, v); P::store(vz+k, w);
+    }
+    return k;
+}
+
+}
@@ -0,0 +1,46 @@
+#include "sphere_kernels.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+
+#include <emmintrin.h>
+#include "sphere_kernels_impl.hpp"
+
+namespace
+{
+struct pack_sse
+{
+    typedef __m128 type;
+    static const size_t size = 4;
+
+    static type load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, type a) { _mm_storeu_ps(p, a); }
+    static type set1(float a) { return _mm_set1_ps(a); }
+    static type add(type a, type b) { return _mm_add_ps(a, b); }
+    static type sub(type a, type b) { return _mm_sub_ps(a, b); }
+    static type mul(type a, type b) { return _mm_mul_ps(a, b); }
+    static type less_equal(type a, type b) { return _mm_cmple_ps(a, b); }
+    static type logical_and(type a, type b) { return _mm_and_ps(a, b); }
+    static type select(type mask, type a, type b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    static type awake(const int* asleep) { return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(asleep)), _mm_setzero_si128())); }
+};
+}
+
+size_t integrate_particles_sse(float* px, float* py, float* pz, float* vx, float* vy, float* vz, const int* asleep,
+                               float damping, float dt, float fx, float fy, float fz, size_t N)
+{
+    return sphere_kernels::integrate_particles<pack_sse>(px, py, pz, vx, vy, vz, asleep, damping, dt, fx, fy, fz, N);
+}
+
+size_t plane_collisions_sse(float* px, float* py, float* pz, float* vx, float* vy, float* vz, const float* r, const int* asleep,
+                            const float* plane_point, const float* plane_normal, size_t plane_count, float alpha, float beta, size_t N)
+{
+    return sphere_kernels::plane_collisions<pack_sse>(px, py, pz, vx, vy, vz, r, asleep, plane_point, plane_normal, plane_count, alpha, beta, N);
+}
+
+#else
+
+// No SSE2 on this architecture: everything is left to the scalar code
+size_t integrate_particles_sse(float*, float*, float*, float*, float*, float*, const int*, float, float, float, float, float, size_t) { return 0; }
+size_t plane_collisions_sse(float*, float*, float*, float*, float*, float*, const float*, const int*, const float*, const float*, size_t, float, float, size_t) { return 0; }
+
+#endif
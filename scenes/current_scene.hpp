@@ -7,4 +7,5 @@
 //
 //#define SCENE_SPHERE_COLLISION
 // #define SCENE_MASS_SPRING_1D
+// #define SCENE_ROPE
  #define SCENE_CLOTH
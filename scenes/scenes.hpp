@@ -7,4 +7,5 @@
 
 #include "scenes/animation/02_simulation/cloth.hpp"
 #include "scenes/animation/02_simulation/example_mass_spring.hpp"
+#include "scenes/animation/02_simulation/rope.hpp"
 #include "scenes/animation/02_simulation/sphere_collision.hpp"
@@ -7,5 +7,9 @@
 #include "file/file.hpp"
 #include "rand/rand.hpp"
 #include "error/error.hpp"
+#include "thread_pool/thread_pool.hpp"
+#include "simd/simd.hpp"
+#include "snapshot/snapshot.hpp"
+#include "frame_cache/frame_cache.hpp"
 
 
@@ -0,0 +1,423 @@
+#include "frame_cache.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace vcl
+{
+
+static const char frame_cache_magic[8] = "VCLCACH";
+static const uint32_t frame_cache_version = 1;
+
+struct frame_cache_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+// A chunk is followed by the number of values of each frame (uint32), the time of each frame (float) and the compressed values
+struct frame_cache_chunk_header
+{
+    char magic[4];
+    uint32_t frames;
+    uint64_t words;
+    uint64_t payload_size;
+};
+
+
+// Prediction of the values of a frame from the previous frames of the chunk with the same number of values
+//  The bit patterns of the floats are extrapolated as integers (exactly reversible, and monotonic for the floats of same sign):
+//  order 0: no prediction, order 1: previous value, order 2: linear extrapolation of the two previous values
+static int prediction_order(const uint32_t* counts, size_t f)
+{
+    if(f>=2 && counts[f-1]==counts[f] && counts[f-2]==counts[f])
+        return 2;
+    if(f>=1 && counts[f-1]==counts[f])
+        return 1;
+    return 0;
+}
+
+static uint32_t predict(const uint32_t* words, size_t k, size_t count, int order)
+{
+    if(order==2)
+        return 2*words[k-count]-words[k-2*count];
+    if(order==1)
+        return words[k-count];
+    return 0;
+}
+
+// Small positive and negative residuals are mapped to small unsigned integers
+static uint32_t zigzag(uint32_t r)
+{
+    return (r<<1) ^ (0u-(r>>31));
+}
+
+static uint32_t unzigzag(uint32_t z)
+{
+    return (z>>1) ^ (0u-(z&1));
+}
+
+// Run-length encoding of the zero bytes
+//  Control byte c < 128: c+1 literal bytes follow. Control byte c >= 128: c-127 zero bytes.
+static void encode_zero_runs(const std::vector<unsigned char>& bytes, std::vector<unsigned char>& out)
+{
+    const size_t N = bytes.size();
+    size_t k = 0;
+    while(k<N)
+    {
+        if(bytes[k]==0) {
+            size_t run = 1;
+            while(k+run<N && run<128 && bytes[k+run]==0)
+                ++run;
+            out.push_back(static_cast<unsigned char>(127+run));
+            k += run;
+        }
+        else {
+            // Literal run: ends before a run of at least 2 zeros (a single zero is cheaper inside the literal)
+            size_t run = 1;
+            while(k+run<N && run<128 && !(bytes[k+run]==0 && (k+run+1==N || bytes[k+run+1]==0)))
+                ++run;
+            out.push_back(static_cast<unsigned char>(run-1));
+            out.insert(out.end(), bytes.begin()+long(k), bytes.begin()+long(k+run));
+            k += run;
+        }
+    }
+}
+
+static bool decode_zero_runs(const unsigned char* in, size_t size, std::vector<unsigned char>& bytes)
+{
+    size_t k = 0;
+    size_t n = 0;
+    while(k<size)
+    {
+        const unsigned char c = in[k++];
+        if(c>=128) {
+            const size_t run = size_t(c)-127;
+            if(n+run>bytes.size())
+                return false;
+            std::fill(bytes.begin()+long(n), bytes.begin()+long(n+run), 0);
+            n += run;
+        }
+        else {
+            const size_t run = size_t(c)+1;
+            if(n+run>bytes.size() || k+run>size)
+                return false;
+            std::memcpy(&bytes[n], in+k, run);
+            k += run;
+            n += run;
+        }
+    }
+    return n==bytes.size();
+}
+
+
+frame_cache_writer::frame_cache_writer()
+    :file(nullptr), frames_per_chunk(32), frames_pushed(0), frames_dropped_count(0), wait_seconds(0), max_queued_chunks(4), overflow(FRAME_CACHE_WAIT),
+     stop(false), raw_size(0), written_size(0)
+{}
+
+frame_cache_writer::~frame_cache_writer()
+{
+    close();
+}
+
+bool frame_cache_writer::open(const std::string& filename, size_t frames_per_chunk_arg, size_t max_queued_chunks_arg, frame_cache_overflow overflow_arg)
+{
+    close();
+    file = std::fopen(filename.c_str(), "wb");
+    if(file==nullptr)
+        return false;
+
+    frame_cache_header header;
+    std::memcpy(header.magic, frame_cache_magic, sizeof(header.magic));
+    header.version = frame_cache_version;
+    header.reserved = 0;
+    std::fwrite(&header, sizeof(header), 1, file);
+
+    frames_per_chunk = std::max(frames_per_chunk_arg, size_t(1));
+    frames_pushed = 0;
+    frames_dropped_count = 0;
+    wait_seconds = 0;
+    max_queued_chunks = std::max(max_queued_chunks_arg, size_t(1));
+    overflow = overflow_arg;
+    current = chunk_structure();
+    stop = false;
+    raw_size = 0;
+    written_size = sizeof(header);
+    writer = std::thread(&frame_cache_writer::writer_loop, this);
+    return true;
+}
+
+void frame_cache_writer::push(float t, const float* values, size_t count)
+{
+    if(file==nullptr)
+        return;
+
+    current.times.push_back(t);
+    current.counts.push_back(uint32_t(count));
+    current.values.insert(current.values.end(), values, values+count);
+    ++frames_pushed;
+
+    if(current.times.size()>=frames_per_chunk) {
+        bool queued = true;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if(queue.size()>=max_queued_chunks) {
+                if(overflow==FRAME_CACHE_DROP)
+                    queued = false;
+                else {
+                    const auto t0 = std::chrono::steady_clock::now();
+                    space_available.wait(lock, [this]{ return queue.size()<max_queued_chunks; });
+                    wait_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+                }
+            }
+            if(queued)
+                queue.push_back(std::move(current));
+        }
+        if(queued)
+            condition.notify_one();
+        else
+            frames_dropped_count += current.times.size();
+        current = chunk_structure();
+    }
+}
+
+void frame_cache_writer::close()
+{
+    if(file==nullptr)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!current.times.empty())
+            queue.push_back(std::move(current));
+        stop = true;
+    }
+    condition.notify_one();
+    writer.join();
+    current = chunk_structure();
+
+    std::fclose(file);
+    file = nullptr;
+}
+
+bool frame_cache_writer::is_open() const
+{
+    return file!=nullptr;
+}
+
+size_t frame_cache_writer::frames() const
+{
+    return frames_pushed;
+}
+
+size_t frame_cache_writer::frames_dropped() const
+{
+    return frames_dropped_count;
+}
+
+double frame_cache_writer::wait_time() const
+{
+    return wait_seconds;
+}
+
+size_t frame_cache_writer::bytes_raw() const
+{
+    return raw_size;
+}
+
+size_t frame_cache_writer::bytes_written() const
+{
+    return written_size;
+}
+
+void frame_cache_writer::writer_loop()
+{
+    for(;;)
+    {
+        chunk_structure chunk;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]{ return stop || !queue.empty(); });
+            if(queue.empty())
+                return; // stop requested and all the chunks are written
+            chunk = std::move(queue.front());
+            queue.pop_front();
+        }
+        space_available.notify_one();
+        write_chunk(chunk);
+    }
+}
+
+void frame_cache_writer::write_chunk(const chunk_structure& chunk)
+{
+    const size_t N_frame = chunk.times.size();
+    const size_t N_word = chunk.values.size();
+
+    // Residual of the prediction of each value from the previous frames
+    std::vector<uint32_t> values(N_word);
+    std::memcpy(values.data(), chunk.values.data(), N_word*sizeof(uint32_t));
+    std::vector<uint32_t> words(N_word);
+    size_t offset = 0;
+    for(size_t f=0; f<N_frame; ++f) {
+        const size_t count = chunk.counts[f];
+        const int order = prediction_order(chunk.counts.data(), f);
+        for(size_t k=0; k<count; ++k)
+            words[offset+k] = zigzag(values[offset+k]-predict(values.data(), offset+k, count, order));
+        offset += count;
+    }
+
+    // Bytes grouped by significance, then zero runs encoding
+    std::vector<unsigned char> planes(4*N_word);
+    for(size_t k=0; k<N_word; ++k)
+        for(size_t b=0; b<4; ++b)
+            planes[b*N_word+k] = static_cast<unsigned char>(words[k]>>(8*b));
+    std::vector<unsigned char> payload;
+    payload.reserve(planes.size()/2);
+    encode_zero_runs(planes, payload);
+
+    frame_cache_chunk_header header;
+    std::memcpy(header.magic, "CHNK", 4);
+    header.frames = uint32_t(N_frame);
+    header.words = N_word;
+    header.payload_size = payload.size();
+
+    std::fwrite(&header, sizeof(header), 1, file);
+    std::fwrite(chunk.counts.data(), sizeof(uint32_t), N_frame, file);
+    std::fwrite(chunk.times.data(), sizeof(float), N_frame, file);
+    if(!payload.empty())
+        std::fwrite(payload.data(), 1, payload.size(), file);
+    std::fflush(file);
+
+    raw_size += N_word*sizeof(float);
+    written_size += sizeof(header)+N_frame*(sizeof(uint32_t)+sizeof(float))+payload.size();
+}
+
+
+bool frame_cache_reader::open(const std::string& filename)
+{
+    close();
+    if(!file.open(filename))
+        return false;
+
+    frame_cache_header header;
+    if(file.size<sizeof(header))
+        return false;
+    std::memcpy(&header, file.data, sizeof(header));
+    if(std::memcmp(header.magic, frame_cache_magic, sizeof(header.magic))!=0 || header.version!=frame_cache_version) {
+        file.close();
+        return false;
+    }
+
+    // Index the complete chunks
+    size_t offset = sizeof(header);
+    while(offset+sizeof(frame_cache_chunk_header)<=file.size)
+    {
+        frame_cache_chunk_header chunk_header;
+        std::memcpy(&chunk_header, file.data+offset, sizeof(chunk_header));
+        if(std::memcmp(chunk_header.magic, "CHNK", 4)!=0)
+            break;
+
+        chunk_entry entry;
+        entry.first_frame = times.size();
+        entry.frames = chunk_header.frames;
+        entry.words = size_t(chunk_header.words);
+        entry.counts_offset = offset+sizeof(chunk_header);
+        entry.payload_offset = entry.counts_offset+entry.frames*(sizeof(uint32_t)+sizeof(float));
+        entry.payload_size = size_t(chunk_header.payload_size);
+        if(entry.payload_offset+entry.payload_size>file.size)
+            break; // Incomplete chunk at the end of an interrupted recording
+
+        size_t N_word = 0;
+        for(size_t f=0; f<entry.frames; ++f) {
+            uint32_t count;
+            std::memcpy(&count, file.data+entry.counts_offset+f*sizeof(uint32_t), sizeof(uint32_t));
+            N_word += count;
+        }
+        if(N_word!=entry.words)
+            break; // Corrupted chunk
+
+        const size_t index = chunks.size();
+        for(size_t f=0; f<entry.frames; ++f) {
+            float t;
+            std::memcpy(&t, file.data+entry.counts_offset+entry.frames*sizeof(uint32_t)+f*sizeof(float), sizeof(float));
+            times.push_back(t);
+            frame_chunk.push_back(index);
+        }
+        chunks.push_back(entry);
+        offset = entry.payload_offset+entry.payload_size;
+    }
+    return true;
+}
+
+void frame_cache_reader::close()
+{
+    file.close();
+    chunks.clear();
+    times.clear();
+    frame_chunk.clear();
+    decoded_chunk = size_t(-1);
+}
+
+size_t frame_cache_reader::size() const
+{
+    return times.size();
+}
+
+float frame_cache_reader::time(size_t frame) const
+{
+    return times[frame];
+}
+
+size_t frame_cache_reader::frame_at(float t) const
+{
+    const auto it = std::upper_bound(times.begin(), times.end(), t);
+    return it==times.begin()? 0 : size_t(it-times.begin())-1;
+}
+
+const std::vector<float>& frame_cache_reader::frame(size_t frame)
+{
+    const size_t chunk = frame_chunk[frame];
+    if(chunk!=decoded_chunk)
+        decode_chunk(chunk);
+
+    const size_t f = frame-chunks[chunk].first_frame;
+    const size_t begin = decoded_offset[f];
+    const size_t end = decoded_offset[f+1];
+    current_frame.resize(end-begin);
+    if(end>begin)
+        std::memcpy(current_frame.data(), &decoded_words[begin], (end-begin)*sizeof(float));
+    return current_frame;
+}
+
+void frame_cache_reader::decode_chunk(size_t chunk)
+{
+    const chunk_entry& entry = chunks[chunk];
+    const size_t N_word = entry.words;
+
+    std::vector<unsigned char> planes(4*N_word);
+    const unsigned char* payload = reinterpret_cast<const unsigned char*>(file.data+entry.payload_offset);
+    if(!decode_zero_runs(payload, entry.payload_size, planes))
+        std::fill(planes.begin(), planes.end(), 0); // Corrupted chunk: its frames are read as 0
+
+    decoded_words.resize(N_word);
+    for(size_t k=0; k<N_word; ++k)
+        decoded_words[k] = uint32_t(planes[k]) | uint32_t(planes[N_word+k])<<8 | uint32_t(planes[2*N_word+k])<<16 | uint32_t(planes[3*N_word+k])<<24;
+
+    // Add the prediction from the previous (already decoded) frames
+    std::vector<uint32_t> counts(entry.frames);
+    std::memcpy(counts.data(), file.data+entry.counts_offset, entry.frames*sizeof(uint32_t));
+    decoded_offset.assign(entry.frames+1, 0);
+    for(size_t f=0; f<entry.frames; ++f) {
+        const size_t count = counts[f];
+        const size_t offset = decoded_offset[f];
+        const int order = prediction_order(counts.data(), f);
+        for(size_t k=0; k<count; ++k)
+            decoded_words[offset+k] = unzigzag(decoded_words[offset+k])+predict(decoded_words.data(), offset+k, count, order);
+        decoded_offset[f+1] = offset+count;
+    }
+    decoded_chunk = chunk;
+}
+
+}
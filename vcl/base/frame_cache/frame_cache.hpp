@@ -0,0 +1,128 @@
+#pragma once
+
+#include "../snapshot/snapshot.hpp"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+
+namespace vcl
+{
+
+/** Behavior of frame_cache_writer::push when the writer thread is late and the queue of complete chunks is full:
+ *  wait for the writer (no frame is lost, the simulation is slowed down) or drop the chunk (the frames are counted as dropped) */
+enum frame_cache_overflow { FRAME_CACHE_WAIT = 0, FRAME_CACHE_DROP = 1 };
+
+/** \brief Append-only cache of animation frames (one array of floats per frame, for instance the positions of the particles)
+ *
+ * The frames are grouped in chunks of frames_per_chunk frames, each chunk is compressed independently:
+ * - each value is replaced by the residual of its linear extrapolation from the two previous frames of the chunk (when they
+ *   have the same size), computed on the bit patterns of the floats: smooth motions and static values give small residuals
+ * - the bytes of the residuals are regrouped by significance (the high bytes are mostly 0)
+ * - the runs of zero bytes are run-length encoded
+ * The compression is lossless: a frame is read back exactly as it was recorded.
+ * The chunks are written after each other: a file whose recording was interrupted remains readable up to its last complete chunk.
+ * At most max_queued_chunks complete chunks wait for the writer thread, the memory used by the recording is bounded.
+ */
+class frame_cache_writer
+{
+public:
+    frame_cache_writer();
+    ~frame_cache_writer();
+    frame_cache_writer(const frame_cache_writer&) = delete;
+    frame_cache_writer& operator=(const frame_cache_writer&) = delete;
+
+    /** Create the file and start the writer thread, return false if the file cannot be created */
+    bool open(const std::string& filename, size_t frames_per_chunk=32, size_t max_queued_chunks=4, frame_cache_overflow overflow=FRAME_CACHE_WAIT);
+    /** Add a frame at time t. The values are copied: the compression and the writing are performed by the writer thread
+     *  When a chunk is complete and the queue is full, push waits for the writer or drops the chunk depending on the overflow policy */
+    void push(float t, const float* values, size_t count);
+    /** Write the last incomplete chunk, and wait for the writer thread to complete */
+    void close();
+
+    bool is_open() const;
+    size_t frames() const;        // Number of frames pushed (including the dropped ones)
+    size_t frames_dropped() const; // Number of frames dropped because the queue was full
+    double wait_time() const;     // Time spent by push waiting for the writer thread (s)
+    size_t bytes_raw() const;     // Size of the values of the frames written so far
+    size_t bytes_written() const; // Size of the file written so far
+
+private:
+    struct chunk_structure
+    {
+        std::vector<float> times;
+        std::vector<uint32_t> counts;
+        std::vector<float> values;
+    };
+
+    void writer_loop();
+    void write_chunk(const chunk_structure& chunk);
+
+    std::FILE* file;
+    size_t frames_per_chunk;
+    size_t frames_pushed;
+    size_t frames_dropped_count;
+    double wait_seconds;
+    size_t max_queued_chunks;
+    frame_cache_overflow overflow;
+    chunk_structure current; // Chunk being filled by push
+
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable condition;       // Signaled when a chunk is queued, or when the writer must stop
+    std::condition_variable space_available; // Signaled when the writer thread takes a chunk from the queue
+    std::deque<chunk_structure> queue; // Complete chunks waiting for the writer thread (at most max_queued_chunks)
+    bool stop;
+
+    std::atomic<size_t> raw_size;
+    std::atomic<size_t> written_size;
+};
+
+/** \brief Random access to the frames of a cache written by frame_cache_writer
+ * The file is memory mapped, a chunk is decompressed when one of its frames is accessed (and kept until another chunk is accessed):
+ * playing the frames in order decompresses each chunk once. */
+class frame_cache_reader
+{
+public:
+    /** Map the file and index its chunks, return false if it isn't a frame cache */
+    bool open(const std::string& filename);
+    void close();
+
+    size_t size() const;                 // Number of frames
+    float time(size_t frame) const;      // Time of a frame
+    size_t frame_at(float t) const;      // Last frame whose time is at most t (0 if t is before the first frame)
+    /** Values of a frame, valid until the next call */
+    const std::vector<float>& frame(size_t frame);
+
+private:
+    struct chunk_entry
+    {
+        size_t first_frame;
+        size_t frames;
+        size_t words;          // Number of values of the chunk
+        size_t counts_offset;  // Offset of the number of values of each frame in the file
+        size_t payload_offset; // Offset of the compressed values
+        size_t payload_size;
+    };
+
+    void decode_chunk(size_t chunk);
+
+    memory_mapped_file file;
+    std::vector<chunk_entry> chunks;
+    std::vector<float> times;
+    std::vector<size_t> frame_chunk; // Chunk containing each frame
+
+    size_t decoded_chunk = size_t(-1);
+    std::vector<uint32_t> decoded_words;
+    std::vector<size_t> decoded_offset; // Offset of each frame of the decoded chunk in decoded_words
+    std::vector<float> current_frame;
+};
+
+}
@@ -1,5 +1,7 @@
 #include "rand.hpp"
 
+#include <sstream>
+
 namespace vcl
 {
 
@@ -12,4 +14,24 @@ float rand_interval(const float value_min, const float value_max)
     return distribution(generator)* (value_max-value_min) + value_min;
 }
 
+void rand_seed(unsigned int seed)
+{
+    generator.seed(seed);
+    distribution.reset();
+}
+
+std::string rand_state()
+{
+    std::ostringstream stream;
+    stream<<generator;
+    return stream.str();
+}
+
+void rand_set_state(const std::string& state)
+{
+    std::istringstream stream(state);
+    stream>>generator;
+    distribution.reset();
+}
+
 }
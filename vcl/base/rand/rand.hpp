@@ -1,6 +1,7 @@
 #pragma once
 
 #include <random>
+#include <string>
 
 namespace vcl
 {
@@ -10,4 +11,11 @@ namespace vcl
 */
 float rand_interval(const float value_min=0.0f, const float value_max=1.0f);
 
+/** Restart the sequence of rand_interval from a given seed (the sequence starts from seed 0 by default) */
+void rand_seed(unsigned int seed);
+
+/** State of the generator of rand_interval, restored with rand_set_state to replay the same sequence */
+std::string rand_state();
+void rand_set_state(const std::string& state);
+
 }
@@ -0,0 +1,54 @@
+#include "simd.hpp"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace vcl
+{
+
+static simd_instruction_set simd_detect()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports("avx2") )
+        return simd_instruction_set::avx2;
+    if( __builtin_cpu_supports("sse2") )
+        return simd_instruction_set::sse2;
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 0);
+    const int max_leaf = info[0];
+
+    __cpuid(info, 1);
+    const bool sse2 = (info[3] & (1<<26)) != 0;
+    const bool os_save_ymm = (info[2] & (1<<27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+    if( max_leaf>=7 && os_save_ymm ) {
+        __cpuidex(info, 7, 0);
+        if( (info[1] & (1<<5)) != 0 )
+            return simd_instruction_set::avx2;
+    }
+    if( sse2 )
+        return simd_instruction_set::sse2;
+#endif
+    return simd_instruction_set::none;
+}
+
+simd_instruction_set simd_support()
+{
+    static const simd_instruction_set instruction_set = simd_detect();
+    return instruction_set;
+}
+
+std::string simd_instruction_set_name(simd_instruction_set instruction_set)
+{
+    switch(instruction_set)
+    {
+    case simd_instruction_set::sse2: return "SSE2";
+    case simd_instruction_set::avx2: return "AVX2";
+    default: return "none";
+    }
+}
+
+}
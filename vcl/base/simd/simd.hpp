@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+namespace vcl
+{
+
+/** Vector instruction sets that optimized code paths can be selected on at runtime */
+enum class simd_instruction_set {none, sse2, avx2};
+
+/** Best vector instruction set supported by the CPU running the program (detected once) */
+simd_instruction_set simd_support();
+
+/** Name of the instruction set ("none", "SSE2", "AVX2") */
+std::string simd_instruction_set_name(simd_instruction_set instruction_set);
+
+}
@@ -0,0 +1,261 @@
+#include "snapshot.hpp"
+
+#include <fstream>
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace vcl
+{
+
+static const char snapshot_magic[8] = "VCLSNAP";
+static const uint32_t snapshot_format_version = 1;
+static const size_t snapshot_name_size = 16;
+
+struct snapshot_header
+{
+    char magic[8];
+    uint32_t format_version;
+    uint32_t version;
+    char kind[snapshot_name_size];
+};
+
+struct snapshot_chunk_header
+{
+    char name[snapshot_name_size];
+    uint64_t size;
+};
+
+static size_t padded_size(size_t size)
+{
+    return (size+7) & ~size_t(7);
+}
+
+// Copy a name in a fixed size field (truncated, padded with 0)
+static void copy_name(char* field, const std::string& name)
+{
+    std::memset(field, 0, snapshot_name_size);
+    std::memcpy(field, name.c_str(), std::min(name.size(), snapshot_name_size));
+}
+
+static std::string read_name(const char* field)
+{
+    size_t n = 0;
+    while(n<snapshot_name_size && field[n]!=0)
+        ++n;
+    return std::string(field, n);
+}
+
+
+memory_mapped_file::memory_mapped_file()
+    :data(nullptr), size(0)
+#ifdef _WIN32
+    , file_handle(nullptr), mapping_handle(nullptr)
+#endif
+{}
+
+memory_mapped_file::~memory_mapped_file()
+{
+    close();
+}
+
+#ifdef _WIN32
+
+bool memory_mapped_file::open(const std::string& filename)
+{
+    close();
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file==INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER file_size;
+    if(!GetFileSizeEx(file, &file_size) || file_size.QuadPart==0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mapping==nullptr) {
+        CloseHandle(file);
+        return false;
+    }
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(view==nullptr) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    file_handle = file;
+    mapping_handle = mapping;
+    data = static_cast<const char*>(view);
+    size = size_t(file_size.QuadPart);
+    return true;
+}
+
+void memory_mapped_file::close()
+{
+    if(data!=nullptr)
+        UnmapViewOfFile(data);
+    if(mapping_handle!=nullptr)
+        CloseHandle(mapping_handle);
+    if(file_handle!=nullptr)
+        CloseHandle(file_handle);
+    data = nullptr;
+    size = 0;
+    file_handle = nullptr;
+    mapping_handle = nullptr;
+}
+
+#else
+
+bool memory_mapped_file::open(const std::string& filename)
+{
+    close();
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd<0)
+        return false;
+    struct stat status;
+    if(fstat(fd, &status)!=0 || status.st_size==0) {
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // The mapping remains valid after closing the descriptor
+    if(view==MAP_FAILED)
+        return false;
+    data = static_cast<const char*>(view);
+    size = size_t(status.st_size);
+    return true;
+}
+
+void memory_mapped_file::close()
+{
+    if(data!=nullptr)
+        munmap(const_cast<char*>(data), size);
+    data = nullptr;
+    size = 0;
+}
+
+#endif
+
+
+bool write_file_binary(const std::string& filename, const char* data, size_t size)
+{
+    std::ofstream stream(filename, std::ios::binary | std::ios::trunc);
+    if(!stream.is_open())
+        return false;
+    stream.write(data, std::streamsize(size));
+    return bool(stream);
+}
+
+
+snapshot_writer::snapshot_writer(const std::string& kind, uint32_t version)
+{
+    snapshot_header header;
+    std::memcpy(header.magic, snapshot_magic, sizeof(header.magic));
+    header.format_version = snapshot_format_version;
+    header.version = version;
+    copy_name(header.kind, kind);
+
+    bytes.resize(sizeof(header));
+    std::memcpy(bytes.data(), &header, sizeof(header));
+}
+
+void snapshot_writer::write_bytes(const std::string& name, const void* data, size_t size)
+{
+    snapshot_chunk_header header;
+    copy_name(header.name, name);
+    header.size = size;
+
+    const size_t offset = bytes.size();
+    bytes.resize(offset+sizeof(header)+padded_size(size), 0);
+    std::memcpy(&bytes[offset], &header, sizeof(header));
+    if(size>0)
+        std::memcpy(&bytes[offset+sizeof(header)], data, size);
+}
+
+void snapshot_writer::write(const std::string& name, const std::string& text)
+{
+    write_bytes(name, text.data(), text.size());
+}
+
+bool snapshot_writer::save(const std::string& filename) const
+{
+    return write_file_binary(filename, bytes.data(), bytes.size());
+}
+
+
+bool snapshot_reader::open(const std::string& filename, const std::string& kind, uint32_t version)
+{
+    chunks.clear();
+    if(!file.open(filename)) {
+        error = "Cannot open "+filename;
+        return false;
+    }
+
+    snapshot_header header;
+    if(file.size<sizeof(header)) {
+        error = filename+" is not a snapshot";
+        return false;
+    }
+    std::memcpy(&header, file.data, sizeof(header));
+    if(std::memcmp(header.magic, snapshot_magic, sizeof(header.magic))!=0 || header.format_version!=snapshot_format_version) {
+        error = filename+" is not a snapshot (or was saved with another format version)";
+        return false;
+    }
+    if(read_name(header.kind)!=kind || header.version!=version) {
+        error = filename+" contains a snapshot of "+read_name(header.kind)+" version "+std::to_string(header.version)
+                +" ("+kind+" version "+std::to_string(version)+" expected)";
+        return false;
+    }
+
+    size_t offset = sizeof(header);
+    while(offset+sizeof(snapshot_chunk_header)<=file.size)
+    {
+        snapshot_chunk_header chunk_header;
+        std::memcpy(&chunk_header, file.data+offset, sizeof(chunk_header));
+        offset += sizeof(chunk_header);
+        if(chunk_header.size>file.size-offset) {
+            error = filename+" is truncated";
+            chunks.clear();
+            return false;
+        }
+        chunks[read_name(chunk_header.name)] = {offset, size_t(chunk_header.size)};
+        offset += padded_size(size_t(chunk_header.size));
+    }
+    return true;
+}
+
+bool snapshot_reader::has(const std::string& name) const
+{
+    return chunks.find(name)!=chunks.end();
+}
+
+const char* snapshot_reader::chunk(const std::string& name, size_t& size) const
+{
+    const auto it = chunks.find(name);
+    if(it==chunks.end())
+        return nullptr;
+    size = it->second.second;
+    return file.data+it->second.first;
+}
+
+bool snapshot_reader::read(const std::string& name, std::string& text)
+{
+    size_t size = 0;
+    const char* data = chunk(name, size);
+    if(data==nullptr) {
+        error = "Invalid chunk "+name;
+        return false;
+    }
+    text.assign(data, size);
+    return true;
+}
+
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+namespace vcl
+{
+
+/** Read-only memory mapping of a whole file.
+ * The content is accessed through data[0 .. size-1] until the file is closed (or the structure destroyed). */
+struct memory_mapped_file
+{
+    const char* data;
+    size_t size;
+
+    memory_mapped_file();
+    ~memory_mapped_file();
+    memory_mapped_file(const memory_mapped_file&) = delete;
+    memory_mapped_file& operator=(const memory_mapped_file&) = delete;
+
+    /** Map the file, return false if it cannot be opened */
+    bool open(const std::string& filename);
+    void close();
+
+private:
+#ifdef _WIN32
+    void* file_handle;
+    void* mapping_handle;
+#endif
+};
+
+/** Write size bytes in a file with a single write, return false in case of failure */
+bool write_file_binary(const std::string& filename, const char* data, size_t size);
+
+
+/** \brief Versioned binary snapshot made of named chunks
+ *
+ * Layout of the file (little endian, as stored in memory):
+ * - header: magic "VCLSNAP", format version, kind (name of the content, 16 characters) and version of the content
+ * - chunks: name (16 characters), size in bytes, data padded to a multiple of 8 bytes
+ *
+ * The chunks only contain trivially copyable data (scalars, vectors of POD structures): a snapshot is read back on the same architecture.
+ * The writer accumulates the chunks in memory and saves them with a single write. The reader maps the file in memory:
+ * each chunk is copied with a single memcpy into its destination storage.
+ */
+struct snapshot_writer
+{
+    std::vector<char> bytes;
+
+    snapshot_writer(const std::string& kind, uint32_t version);
+
+    void write_bytes(const std::string& name, const void* data, size_t size);
+
+    template <typename T> void write(const std::string& name, const T& value);
+    template <typename T> void write(const std::string& name, const std::vector<T>& values);
+    void write(const std::string& name, const std::string& text);
+
+    bool save(const std::string& filename) const;
+};
+
+struct snapshot_reader
+{
+    memory_mapped_file file;
+    std::map<std::string, std::pair<size_t,size_t> > chunks; // Offset and size of each chunk in the file
+    std::string error;                                       // Description of the last failure
+
+    /** Map the file and list its chunks. Fail if the file is not a snapshot of this kind and version */
+    bool open(const std::string& filename, const std::string& kind, uint32_t version);
+
+    bool has(const std::string& name) const;
+    /** Pointer to the data of a chunk (nullptr if it doesn't exist) */
+    const char* chunk(const std::string& name, size_t& size) const;
+
+    /** Read a chunk, return false (and leave the destination unchanged) if it doesn't exist or its size doesn't match */
+    template <typename T> bool read(const std::string& name, T& value);
+    template <typename T> bool read(const std::string& name, std::vector<T>& values);
+    bool read(const std::string& name, std::string& text);
+};
+
+}
+
+
+namespace vcl
+{
+
+template <typename T> void snapshot_writer::write(const std::string& name, const T& value)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable types can be stored in a snapshot");
+    write_bytes(name, &value, sizeof(T));
+}
+
+template <typename T> void snapshot_writer::write(const std::string& name, const std::vector<T>& values)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable types can be stored in a snapshot");
+    write_bytes(name, values.data(), values.size()*sizeof(T));
+}
+
+template <typename T> bool snapshot_reader::read(const std::string& name, T& value)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable types can be stored in a snapshot");
+    size_t size = 0;
+    const char* data = chunk(name, size);
+    if(data==nullptr || size!=sizeof(T)) {
+        error = "Invalid chunk "+name;
+        return false;
+    }
+    std::memcpy(&value, data, sizeof(T));
+    return true;
+}
+
+template <typename T> bool snapshot_reader::read(const std::string& name, std::vector<T>& values)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable types can be stored in a snapshot");
+    size_t size = 0;
+    const char* data = chunk(name, size);
+    if(data==nullptr || size%sizeof(T)!=0) {
+        error = "Invalid chunk "+name;
+        return false;
+    }
+    values.resize(size/sizeof(T));
+    if(size>0)
+        std::memcpy(values.data(), data, size);
+    return true;
+}
+
+}
@@ -0,0 +1,120 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+namespace vcl
+{
+
+thread_pool::thread_pool(size_t number_of_threads)
+    :workers(),mutex(),condition_start(),condition_end(),task(nullptr),N_task(0),next_task(0),generation(0),workers_done(0),stop(false)
+{
+    start(number_of_threads);
+}
+
+thread_pool::~thread_pool()
+{
+    join();
+}
+
+void thread_pool::resize(size_t number_of_threads)
+{
+    join();
+    start(number_of_threads);
+}
+
+void thread_pool::start(size_t number_of_threads)
+{
+    if(number_of_threads==0)
+        number_of_threads = std::max(size_t(std::thread::hardware_concurrency()), size_t(1));
+
+    stop = false;
+    generation = 0;
+    for(size_t k=1; k<number_of_threads; ++k)
+        workers.push_back(std::thread(&thread_pool::worker_loop, this));
+}
+
+// Stop and remove all the workers
+void thread_pool::join()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    condition_start.notify_all();
+    for(std::thread& worker : workers)
+        worker.join();
+    workers.clear();
+}
+
+size_t thread_pool::size() const
+{
+    return workers.size()+1;
+}
+
+void thread_pool::run(size_t N_task_arg, const std::function<void(size_t)>& task_arg)
+{
+    // Direct execution when there is nothing to share
+    if(workers.empty() || N_task_arg<=1) {
+        for(size_t k=0; k<N_task_arg; ++k)
+            task_arg(k);
+        return ;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task = &task_arg;
+        N_task = N_task_arg;
+        next_task = 0;
+        workers_done = 0;
+        ++generation;
+    }
+    condition_start.notify_all();
+
+    execute_tasks();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    condition_end.wait(lock, [this]{ return workers_done==workers.size(); });
+    task = nullptr;
+}
+
+void thread_pool::execute_tasks()
+{
+    for(size_t k=next_task++; k<N_task; k=next_task++)
+        (*task)(k);
+}
+
+void thread_pool::worker_loop()
+{
+    size_t generation_done = 0;
+    for(;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition_start.wait(lock, [&]{ return stop || generation!=generation_done; });
+            if(stop)
+                return ;
+            generation_done = generation;
+        }
+
+        execute_tasks();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++workers_done;
+        }
+        condition_end.notify_one();
+    }
+}
+
+
+void parallel_for(thread_pool& pool, size_t begin, size_t end, const std::function<void(size_t,size_t)>& f)
+{
+    if(end<=begin)
+        return ;
+
+    const size_t N = end-begin;
+    const size_t N_range = std::min(pool.size(), N);
+    pool.run(N_range, [&](size_t k){ f(begin+k*N/N_range, begin+(k+1)*N/N_range); });
+}
+
+}
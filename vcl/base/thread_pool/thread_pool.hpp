@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+namespace vcl
+{
+
+/** Persistent set of worker threads executing indexed tasks.
+ * Threads are created once and sleep between two calls to run(). The calling thread also takes part to the execution.
+ * Calls to run() are not reentrant: a task must not call run() on the same pool. */
+class thread_pool
+{
+public:
+    /** Create a pool executing tasks on number_of_threads threads (including the calling one).
+     * 0 uses the number of hardware threads. */
+    thread_pool(size_t number_of_threads=0);
+    ~thread_pool();
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    /** Number of threads executing tasks (including the calling one) */
+    size_t size() const;
+    /** Stop the workers and restart the pool with number_of_threads threads (0: number of hardware threads).
+     * Must not be called while run() is executing. */
+    void resize(size_t number_of_threads);
+
+    /** Execute task(k) for k in [0,N_task[ and wait for all of them to complete.
+     * Tasks are dispatched dynamically: no assumption should be made on the thread executing a given task. */
+    void run(size_t N_task, const std::function<void(size_t)>& task);
+
+private:
+    void start(size_t number_of_threads);
+    void join();
+    void worker_loop();
+    void execute_tasks();
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable condition_start;
+    std::condition_variable condition_end;
+
+    const std::function<void(size_t)>* task;
+    size_t N_task;
+    std::atomic<size_t> next_task;
+    size_t generation;   // Incremented at each call to run(): wakes up the workers
+    size_t workers_done; // Number of workers having finished the current generation
+    bool stop;
+};
+
+/** Call f(k_begin,k_end) on contiguous sub-ranges covering [begin,end[, using one sub-range per thread of the pool.
+ * The split only depends on the range and on the size of the pool. */
+void parallel_for(thread_pool& pool, size_t begin, size_t end, const std::function<void(size_t,size_t)>& f);
+
+}
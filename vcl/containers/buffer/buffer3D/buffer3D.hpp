@@ -111,7 +111,7 @@ buffer3D<T>::buffer3D(size_t3 const& size)
 
 template <typename T>
 buffer3D<T>::buffer3D(size_t size_1, size_t size_2, size_t size_3)
-    :dimension({size_1,size_2}),data(size_1*size_2*size_3)
+    :dimension({size_1,size_2,size_3}),data(size_1*size_2*size_3)
 {}
 
 template <typename T>
@@ -16,6 +16,11 @@ curve_drawable::curve_drawable(const std::vector<vec3>& data_arg)
     :uniform(),data(curve_gpu(data_arg)),shader(0)
 {}
 
+void curve_drawable::clear()
+{
+    data.clear();
+}
+
 void draw(const curve_drawable& drawable, const camera_scene& camera)
 {
     draw(drawable, camera, drawable.shader);
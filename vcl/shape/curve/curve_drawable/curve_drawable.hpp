@@ -15,6 +15,9 @@ public:
     curve_drawable(const curve_gpu& data);
     curve_drawable(const std::vector<vec3>& data);
 
+    /** Clear buffers (VBO, VAO) */
+    void clear();
+
     curve_drawable_uniform uniform;
     curve_gpu data;
     GLuint shader;
@@ -42,6 +42,15 @@ void curve_gpu::update_position(const std::vector<vec3>& new_position)
     glBufferSubData(GL_ARRAY_BUFFER,0,GLsizeiptr(new_position.size()*sizeof(float)*3),&new_position[0]);
 }
 
+void curve_gpu::clear()
+{
+    glDeleteBuffers(1,&vbo_position);
+    glDeleteVertexArrays(1,&vao);
+    vbo_position = 0;
+    vao = 0;
+    number_elements = 0;
+}
+
 void draw(const curve_gpu& curve)
 {
     glBindVertexArray(curve.vao); opengl_debug();
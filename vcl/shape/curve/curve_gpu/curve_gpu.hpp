@@ -12,6 +12,8 @@ struct curve_gpu
     curve_gpu(const std::vector<vec3>& position);
 
     void update_position(const std::vector<vec3>& new_position);
+    /** Clear buffers (VBO and VAO) */
+    void clear();
 
     GLuint vao;
     GLuint vbo_position;
@@ -4,3 +4,4 @@
 #include "mesh_primitive/mesh_primitive.hpp"
 #include "mesh_loader/mesh_loader.hpp"
 #include "mesh_drawable/mesh_drawable.hpp"
+#include "mesh_drawable_instanced/mesh_drawable_instanced.hpp"
@@ -30,6 +30,21 @@ void mesh_drawable::update_normal(const vcl::buffer<vec3>& new_normal)
     data.update_normal(new_normal);
 }
 
+void mesh_drawable::update_texture_uv(const vcl::buffer<vec2>& new_texture_uv, size_t first)
+{
+    data.update_texture_uv(new_texture_uv, first);
+}
+
+void mesh_drawable::update_color(const vcl::buffer<vec4>& new_color, size_t first)
+{
+    data.update_color(new_color, first);
+}
+
+void mesh_drawable::update_connectivity(const vcl::buffer<uint3>& new_connectivity, size_t first)
+{
+    data.update_connectivity(new_connectivity, first);
+}
+
 
 void draw(const mesh_drawable& drawable, const camera_scene& camera)
 {
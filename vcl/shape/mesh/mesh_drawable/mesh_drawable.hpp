@@ -29,13 +29,18 @@ public:
     void clear();
 
     /** Dynamically update the VBO with the new vector of position
-     * Warning: new_position is expected to have the same size (or less) than the initialized one */
+     * The VBO grows if new_position is larger than the initialized one */
     void update_position(const vcl::buffer<vec3>& new_position);
 
     /** Dynamically update the VBO with the new vector of normal
-     * Warning: new_normal is expected to have the same size (or less) than the initialized one */
+     * The VBO grows if new_normal is larger than the initialized one */
     void update_normal(const vcl::buffer<vec3>& new_normal);
 
+    /** Update the elements [first, size[ of the texture coordinates, colors, or triangles (incremental changes of the mesh) */
+    void update_texture_uv(const vcl::buffer<vec2>& new_texture_uv, size_t first=0);
+    void update_color(const vcl::buffer<vec4>& new_color, size_t first=0);
+    void update_connectivity(const vcl::buffer<uint3>& new_connectivity, size_t first=0);
+
 
     /** Data attributes: VAO and VBO as well as the number of triangle */
     mesh_drawable_gpu_data data;
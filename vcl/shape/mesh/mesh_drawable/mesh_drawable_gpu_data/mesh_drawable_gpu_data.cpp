@@ -2,14 +2,18 @@
 
 #include "vcl/opengl/opengl.hpp"
 
+#include <algorithm>
+
 namespace vcl
 {
 
 mesh_drawable_gpu_data::mesh_drawable_gpu_data()
-    :vao(0), number_triangles(0), vbo_index(0), vbo_position(0), vbo_normal(0), vbo_color(0), vbo_texture_uv(0)
+    :vao(0), number_triangles(0), vbo_index(0), vbo_position(0), vbo_normal(0), vbo_color(0), vbo_texture_uv(0),
+     capacity_position(0), capacity_normal(0), capacity_color(0), capacity_texture_uv(0), capacity_index(0)
 {}
 
 mesh_drawable_gpu_data::mesh_drawable_gpu_data(const mesh &mesh_cpu_arg)
+    :mesh_drawable_gpu_data()
 {
     // Doesn't assign anything if there is no position
     if(mesh_cpu_arg.position.size()==0)
@@ -51,6 +55,12 @@ mesh_drawable_gpu_data::mesh_drawable_gpu_data(const mesh &mesh_cpu_arg)
 
     number_triangles = static_cast<unsigned int>(mesh_cpu.connectivity.size());
 
+    capacity_position   = mesh_cpu.position.size();
+    capacity_normal     = mesh_cpu.normal.size();
+    capacity_color      = mesh_cpu.color.size();
+    capacity_texture_uv = mesh_cpu.texture_uv.size();
+    capacity_index      = mesh_cpu.connectivity.size();
+
     glGenVertexArrays(1,&vao);
     glBindVertexArray(vao);
 
@@ -88,20 +98,48 @@ void mesh_drawable_gpu_data::clear()
     glDeleteBuffers(1,&vbo_index);
 }
 
-void mesh_drawable_gpu_data::update_position(const buffer<vec3>& new_position)
+void update_buffer(GLenum target, GLuint vbo, size_t& capacity, const void* data, size_t element_size, size_t first, size_t size)
 {
-    glBindBuffer(GL_ARRAY_BUFFER,vbo_position);
-    assert(glIsBuffer(vbo_position));
+    if(size==0 || first>=size)
+        return;
+
+    glBindBuffer(target, vbo);
+    assert(glIsBuffer(vbo));
 
-    glBufferSubData(GL_ARRAY_BUFFER,0,GLsizeiptr(new_position.size()*sizeof(float)*3),&new_position[0]);
+    if(size>capacity) {
+        capacity = std::max(size, 2*capacity);
+        glBufferData(target, GLsizeiptr(capacity*element_size), nullptr, GL_DYNAMIC_DRAW);
+        first = 0;
+    }
+    const char* bytes = static_cast<const char*>(data);
+    glBufferSubData(target, GLintptr(first*element_size), GLsizeiptr((size-first)*element_size), bytes+first*element_size);
+    glBindBuffer(target, 0);
+}
+
+void mesh_drawable_gpu_data::update_position(const buffer<vec3>& new_position)
+{
+    update_buffer(GL_ARRAY_BUFFER, vbo_position, capacity_position, new_position.data.data(), sizeof(float)*3, 0, new_position.size());
 }
 
 void mesh_drawable_gpu_data::update_normal(const buffer<vec3>& new_normal)
 {
-    glBindBuffer(GL_ARRAY_BUFFER,vbo_normal);
-    assert(glIsBuffer(vbo_normal));
+    update_buffer(GL_ARRAY_BUFFER, vbo_normal, capacity_normal, new_normal.data.data(), sizeof(float)*3, 0, new_normal.size());
+}
+
+void mesh_drawable_gpu_data::update_texture_uv(const buffer<vec2>& new_texture_uv, size_t first)
+{
+    update_buffer(GL_ARRAY_BUFFER, vbo_texture_uv, capacity_texture_uv, new_texture_uv.data.data(), sizeof(float)*2, first, new_texture_uv.size());
+}
 
-    glBufferSubData(GL_ARRAY_BUFFER,0,GLsizeiptr(new_normal.size()*sizeof(float)*3),&new_normal[0]);
+void mesh_drawable_gpu_data::update_color(const buffer<vec4>& new_color, size_t first)
+{
+    update_buffer(GL_ARRAY_BUFFER, vbo_color, capacity_color, new_color.data.data(), sizeof(float)*4, first, new_color.size());
+}
+
+void mesh_drawable_gpu_data::update_connectivity(const buffer<uint3>& new_connectivity, size_t first)
+{
+    update_buffer(GL_ELEMENT_ARRAY_BUFFER, vbo_index, capacity_index, new_connectivity.data.data(), sizeof(GLuint)*3, first, new_connectivity.size());
+    number_triangles = static_cast<unsigned int>(new_connectivity.size());
 }
 
 void draw(const mesh_drawable_gpu_data& gpu_data )
@@ -17,13 +17,24 @@ struct mesh_drawable_gpu_data {
     void clear();
 
     /** Dynamically update the VBO with the new vector of position
-     * Warning: new_position is expected to have the same size (or less) than the initialized one */
+     * The VBO grows (its capacity is at least doubled) if new_position is larger than its capacity */
     void update_position(const buffer<vec3>& new_position);
 
     /** Dynamically update the VBO with the new vector of normal
-     * Warning: new_normal is expected to have the same size (or less) than the initialized one */
+     * The VBO grows (its capacity is at least doubled) if new_normal is larger than its capacity */
     void update_normal(const buffer<vec3>& new_normal);
 
+    /** Update the elements [first, size[ of the texture coordinates (the previous ones are expected to be unchanged)
+     * Only the updated range is sent to the GPU, unless the VBO has to grow */
+    void update_texture_uv(const buffer<vec2>& new_texture_uv, size_t first=0);
+
+    /** Update the elements [first, size[ of the colors (the previous ones are expected to be unchanged) */
+    void update_color(const buffer<vec4>& new_color, size_t first=0);
+
+    /** Update the triangles [first, size[ of the connectivity (the previous ones are expected to be unchanged)
+     * The number of drawn triangles becomes new_connectivity.size() */
+    void update_connectivity(const buffer<uint3>& new_connectivity, size_t first=0);
+
 
     GLuint vao;
     unsigned int number_triangles;
@@ -34,9 +45,21 @@ struct mesh_drawable_gpu_data {
     GLuint vbo_normal;     // (nx,ny,nz) normals coordinates (unit length)
     GLuint vbo_color;      // (r,g,b) values
     GLuint vbo_texture_uv; // (u,v) texture coordinates
+
+    // Number of elements allocated in each VBO (larger or equal to the number of elements in use)
+    size_t capacity_position;
+    size_t capacity_normal;
+    size_t capacity_color;
+    size_t capacity_texture_uv;
+    size_t capacity_index;
 };
 
 /** Call raw OpenGL draw */
 void draw(const mesh_drawable_gpu_data& gpu_data);
 
+/** Send the elements [first,size[ of data to the buffer vbo
+ * If size exceeds the capacity, the storage of the buffer is reallocated (the name of the buffer, and therefore the VAO, are unchanged)
+ * and all the elements are sent. */
+void update_buffer(GLenum target, GLuint vbo, size_t& capacity, const void* data, size_t element_size, size_t first, size_t size);
+
 }
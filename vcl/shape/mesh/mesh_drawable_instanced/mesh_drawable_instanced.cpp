@@ -0,0 +1,108 @@
+#include "mesh_drawable_instanced.hpp"
+
+#include "vcl/opengl/opengl.hpp"
+
+#include <cstddef>
+
+namespace vcl
+{
+
+static_assert(sizeof(mesh_instance)==7*sizeof(GLfloat), "mesh_instance is sent as 7 packed floats");
+
+mesh_drawable_instanced::mesh_drawable_instanced()
+    :data(), vbo_instance(0), capacity_instance(0), number_instances(0), uniform(), shader(0), texture_id(0)
+{}
+
+mesh_drawable_instanced::mesh_drawable_instanced(const mesh& mesh_arg, GLuint shader_arg, GLuint texture_id_arg)
+    :data(mesh_arg), vbo_instance(0), capacity_instance(0), number_instances(0), uniform(), shader(shader_arg), texture_id(texture_id_arg)
+{
+    if(data.vao==0)
+        return;
+
+    glGenBuffers(1, &vbo_instance);
+
+    glBindVertexArray(data.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_instance);
+
+    // translation at layout 4, scaling at layout 5, color at layout 6: one value per instance
+    const GLsizei stride = GLsizei(sizeof(mesh_instance));
+    glEnableVertexAttribArray( 4 );
+    glVertexAttribPointer( 4, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(offsetof(mesh_instance, translation)) );
+    glVertexAttribDivisor( 4, 1 );
+    glEnableVertexAttribArray( 5 );
+    glVertexAttribPointer( 5, 1, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(offsetof(mesh_instance, scaling)) );
+    glVertexAttribDivisor( 5, 1 );
+    glEnableVertexAttribArray( 6 );
+    glVertexAttribPointer( 6, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(offsetof(mesh_instance, color)) );
+    glVertexAttribDivisor( 6, 1 );
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+void mesh_drawable_instanced::clear()
+{
+    data.clear();
+    glDeleteBuffers(1, &vbo_instance);
+    vbo_instance = 0;
+    capacity_instance = 0;
+    number_instances = 0;
+}
+
+void mesh_drawable_instanced::update_instances(const buffer<mesh_instance>& instances)
+{
+    update_buffer(GL_ARRAY_BUFFER, vbo_instance, capacity_instance, instances.data.data(), sizeof(mesh_instance), 0, instances.size());
+    number_instances = static_cast<unsigned int>(instances.size());
+}
+
+
+void draw(const mesh_drawable_instanced& drawable, const camera_scene& camera)
+{
+    const GLuint shader = drawable.shader;
+    if(shader==0 || drawable.number_instances==0 || drawable.data.number_triangles==0)
+        return ;
+
+    // Check that the shader is a valid one
+    if( glIsProgram(shader)==GL_FALSE ) {
+        std::cout<<"No valid shader set to display instanced mesh: skip display"<<std::endl;
+        return;
+    }
+
+    // Switch shader program only if necessary
+    GLint current_shader = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &current_shader); opengl_debug();
+    if(shader!=GLuint(current_shader)) {
+        glUseProgram(shader); opengl_debug();
+    }
+
+    // Bind texture only if id != 0
+    if(drawable.texture_id!=0) {
+        assert(glIsTexture(drawable.texture_id));
+        glBindTexture(GL_TEXTURE_2D, drawable.texture_id);  opengl_debug();
+    }
+
+    // Uniform values shared by all the instances
+    uniform(shader, "rotation", drawable.uniform.transform.rotation);            opengl_debug();
+    uniform(shader, "translation", drawable.uniform.transform.translation);      opengl_debug();
+    uniform(shader, "color", drawable.uniform.color);                            opengl_debug();
+    uniform(shader, "color_alpha", drawable.uniform.color_alpha);                opengl_debug();
+    uniform(shader, "scaling", drawable.uniform.transform.scaling);              opengl_debug();
+    uniform(shader, "scaling_axis", drawable.uniform.transform.scaling_axis);    opengl_debug();
+
+    uniform(shader,"perspective",camera.perspective.matrix());         opengl_debug();
+    uniform(shader,"view",camera.view_matrix());                       opengl_debug();
+    uniform(shader,"camera_position",camera.camera_position());        opengl_debug();
+
+    uniform(shader, "ambiant", drawable.uniform.shading.ambiant);      opengl_debug();
+    uniform(shader, "diffuse", drawable.uniform.shading.diffuse);      opengl_debug();
+    uniform(shader, "specular", drawable.uniform.shading.specular);    opengl_debug();
+    uniform(shader, "specular_exponent", drawable.uniform.shading.specular_exponent); opengl_debug();
+
+    assert(glIsVertexArray(drawable.data.vao));
+    glBindVertexArray(drawable.data.vao); opengl_debug();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, drawable.data.vbo_index); opengl_debug();
+    glDrawElementsInstanced(GL_TRIANGLES, GLsizei(drawable.data.number_triangles*3), GL_UNSIGNED_INT, nullptr, GLsizei(drawable.number_instances)); opengl_debug();
+    glBindVertexArray(0);
+}
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "vcl/shape/mesh/mesh_structure/mesh.hpp"
+#include "vcl/math/math.hpp"
+#include "vcl/interaction/camera/camera.hpp"
+
+#include "vcl/shape/mesh/mesh_drawable/mesh_drawable_gpu_data/mesh_drawable_gpu_data.hpp"
+#include "vcl/shape/mesh/mesh_drawable/mesh_drawable_uniform/mesh_drawable_uniform.hpp"
+
+
+namespace vcl
+{
+
+/** Per-instance parameters of a mesh_drawable_instanced (layout of the instance VBO) */
+struct mesh_instance
+{
+    vec3 translation;
+    float scaling;
+    vec3 color;       // Multiplied with the color of the uniform
+};
+
+/** Mesh drawn several times in a single draw call (glDrawElementsInstanced).
+ * Each instance is the mesh transformed by the uniform (shared by all the instances), then scaled and translated by its own
+ * parameters. The instances are stored in a VBO bound to the VAO of the mesh with a divisor of 1 (layouts 4, 5, 6): they are
+ * sent with one upload per call to update_instances.
+ * Expects a shader reading the instance attributes, such as the "mesh_instanced" shader. */
+struct mesh_drawable_instanced
+{
+public:
+
+    mesh_drawable_instanced();
+    /** Initialize VAO and VBO from the mesh, without instances */
+    mesh_drawable_instanced(const mesh& mesh_cpu, GLuint shader = 0, GLuint texture_id = 0);
+
+    /** Clear buffers (VBO, VAO, etc) */
+    void clear();
+
+    /** Replace the instances. The instance VBO grows (its capacity is at least doubled) if needed */
+    void update_instances(const buffer<mesh_instance>& instances);
+
+    mesh_drawable_gpu_data data;
+    GLuint vbo_instance;
+    size_t capacity_instance;
+    unsigned int number_instances;
+
+    mesh_drawable_uniform uniform;
+    GLuint shader;
+    GLuint texture_id;
+};
+
+void draw(const mesh_drawable_instanced& drawable, const camera_scene& camera);
+
+}
@@ -0,0 +1,268 @@
+#include "sdf_grid.hpp"
+
+#include <cmath>
+#include <limits>
+
+namespace vcl
+{
+
+sdf_grid::sdf_grid()
+    :value(), p_min({0,0,0}), voxel_size(1.0f)
+{}
+
+float sdf_grid::distance(const vec3& p) const
+{
+    vec3 gradient;
+    return distance(p, gradient);
+}
+
+float sdf_grid::distance(const vec3& p, vec3& gradient) const
+{
+    assert_vcl(value.size()>0, "Empty sdf_grid");
+
+    // Position in grid coordinates, clamped to the grid
+    const size_t3& N = value.dimension;
+    vec3 g = (p-p_min)/voxel_size;
+    vec3 g_clamped;
+    for(size_t c=0; c<3; ++c)
+        g_clamped[c] = std::min(std::max(g[c], 0.0f), float(N[c]-1));
+
+    // Cell containing the point and local coordinates in the cell
+    size_t3 k;
+    vec3 u;
+    for(size_t c=0; c<3; ++c) {
+        k[c] = std::min(size_t(g_clamped[c]), N[c]-2);
+        u[c] = g_clamped[c]-float(k[c]);
+    }
+
+    const float d000 = value(k[0]  , k[1]  , k[2]  );
+    const float d100 = value(k[0]+1, k[1]  , k[2]  );
+    const float d010 = value(k[0]  , k[1]+1, k[2]  );
+    const float d110 = value(k[0]+1, k[1]+1, k[2]  );
+    const float d001 = value(k[0]  , k[1]  , k[2]+1);
+    const float d101 = value(k[0]+1, k[1]  , k[2]+1);
+    const float d011 = value(k[0]  , k[1]+1, k[2]+1);
+    const float d111 = value(k[0]+1, k[1]+1, k[2]+1);
+
+    // Trilinear interpolation and its derivatives
+    const float d00 = (1-u.x)*d000 + u.x*d100;
+    const float d10 = (1-u.x)*d010 + u.x*d110;
+    const float d01 = (1-u.x)*d001 + u.x*d101;
+    const float d11 = (1-u.x)*d011 + u.x*d111;
+    const float d0 = (1-u.y)*d00 + u.y*d10;
+    const float d1 = (1-u.y)*d01 + u.y*d11;
+    float d = (1-u.z)*d0 + u.z*d1;
+
+    gradient.x = ( (1-u.z)*((1-u.y)*(d100-d000) + u.y*(d110-d010)) + u.z*((1-u.y)*(d101-d001) + u.y*(d111-d011)) )/voxel_size;
+    gradient.y = ( (1-u.z)*(d10-d00) + u.z*(d11-d01) )/voxel_size;
+    gradient.z = (d1-d0)/voxel_size;
+
+    // Outside of the grid: add the distance to the grid
+    const vec3 outside = (g-g_clamped)*voxel_size;
+    const float d_outside = norm(outside);
+    if(d_outside>0) {
+        d += d_outside;
+        gradient += outside/d_outside;
+    }
+
+    return d;
+}
+
+
+// Distance from p to the triangle (a,b,c)
+//  Evaluated for each node of the grid several times: written on the coordinates to remain fast in debug builds
+static float distance_point_triangle(const vec3& p, const vec3& a, const vec3& b, const vec3& c)
+{
+    const float abx = b.x-a.x, aby = b.y-a.y, abz = b.z-a.z;
+    const float acx = c.x-a.x, acy = c.y-a.y, acz = c.z-a.z;
+    const float apx = p.x-a.x, apy = p.y-a.y, apz = p.z-a.z;
+
+    // Barycentric coordinates (1-v-w, v, w) of the closest point, found by testing the Voronoi regions of the triangle
+    float v, w;
+    const float d1 = abx*apx + aby*apy + abz*apz;
+    const float d2 = acx*apx + acy*apy + acz*apz;
+    const float d3 = d1 - (abx*abx + aby*aby + abz*abz);  // ab.(p-b)
+    const float d4 = d2 - (abx*acx + aby*acy + abz*acz);  // ac.(p-b)
+    const float d5 = d1 - (abx*acx + aby*acy + abz*acz);  // ab.(p-c)
+    const float d6 = d2 - (acx*acx + acy*acy + acz*acz);  // ac.(p-c)
+    const float vc = d1*d4-d3*d2;
+    const float vb = d5*d2-d1*d6;
+    const float va = d3*d6-d5*d4;
+
+    if(d1<=0 && d2<=0)                          { v = 0; w = 0; }                            // vertex a
+    else if(d3>=0 && d4<=d3)                    { v = 1; w = 0; }                            // vertex b
+    else if(d6>=0 && d5<=d6)                    { v = 0; w = 1; }                            // vertex c
+    else if(vc<=0 && d1>=0 && d3<=0)            { v = d1/(d1-d3); w = 0; }                   // edge ab
+    else if(vb<=0 && d2>=0 && d6<=0)            { v = 0; w = d2/(d2-d6); }                   // edge ac
+    else if(va<=0 && d4-d3>=0 && d5-d6>=0)      { w = (d4-d3)/((d4-d3)+(d5-d6)); v = 1-w; }  // edge bc
+    else                                        { v = vb/(va+vb+vc); w = vc/(va+vb+vc); }    // face
+
+    const float dx = apx - v*abx - w*acx;
+    const float dy = apy - v*aby - w*acy;
+    const float dz = apz - v*abz - w*acz;
+    return std::sqrt(dx*dx + dy*dy + dz*dz);
+}
+
+// Sign of the orientation of (0,0), (x1,y1), (x2,y2) - ties are broken consistently so that a line through an edge or a vertex is counted exactly once
+static int orientation(double x1, double y1, double x2, double y2, double& twice_signed_area)
+{
+    twice_signed_area = y1*x2-x1*y2;
+    if(twice_signed_area>0) return 1;
+    if(twice_signed_area<0) return -1;
+    if(y2>y1) return 1;
+    if(y2<y1) return -1;
+    if(x1>x2) return 1;
+    if(x1<x2) return -1;
+    return 0;
+}
+
+// Is (x0,y0) inside the 2D triangle (x1,y1),(x2,y2),(x3,y3) - if so, return its barycentric coordinates (a,b,c)
+static bool point_in_triangle_2d(double x0, double y0, double x1, double y1, double x2, double y2, double x3, double y3, double& a, double& b, double& c)
+{
+    x1-=x0; x2-=x0; x3-=x0;
+    y1-=y0; y2-=y0; y3-=y0;
+    const int sign_a = orientation(x2, y2, x3, y3, a);
+    if(sign_a==0) return false;
+    const int sign_b = orientation(x3, y3, x1, y1, b);
+    if(sign_b!=sign_a) return false;
+    const int sign_c = orientation(x1, y1, x2, y2, c);
+    if(sign_c!=sign_a) return false;
+
+    const double sum = a+b+c;
+    a/=sum; b/=sum; c/=sum;
+    return true;
+}
+
+sdf_grid sdf_grid_from_mesh(const mesh& shape, size_t resolution, float margin)
+{
+    assert_vcl(shape.position.size()>0 && shape.connectivity.size()>0, "Cannot compute the distance field of an empty mesh");
+    assert_vcl(resolution>=2, "Resolution of the sdf_grid must be at least 2");
+
+    const buffer<vec3>& position = shape.position;
+    const buffer<uint3>& connectivity = shape.connectivity;
+
+    // Grid enclosing the mesh
+    vec3 p_min = position[0];
+    vec3 p_max = position[0];
+    for(const vec3& p : position) {
+        for(size_t c=0; c<3; ++c) {
+            p_min[c] = std::min(p_min[c], p[c]);
+            p_max[c] = std::max(p_max[c], p[c]);
+        }
+    }
+    p_min -= vec3(margin, margin, margin);
+    p_max += vec3(margin, margin, margin);
+
+    sdf_grid sdf;
+    const vec3 size = p_max-p_min;
+    sdf.voxel_size = std::max(std::max(size.x, size.y), size.z)/float(resolution-1);
+    sdf.p_min = p_min;
+    const size_t3 N = { size_t(std::ceil(size.x/sdf.voxel_size))+1, size_t(std::ceil(size.y/sdf.voxel_size))+1, size_t(std::ceil(size.z/sdf.voxel_size))+1 };
+
+    buffer3D<float>& phi = sdf.value;
+    phi.resize(N);
+    phi.fill(std::numeric_limits<float>::max());
+    buffer3D<int> closest_triangle(N);
+    closest_triangle.fill(-1);
+    buffer3D<int> intersection_count(N);
+    intersection_count.fill(0);
+
+    auto node = [&](size_t i, size_t j, size_t k) { return p_min + sdf.voxel_size*vec3(float(i), float(j), float(k)); };
+    auto distance_triangle = [&](const vec3& p, int t) {
+        const uint3& f = connectivity[t];
+        return distance_point_triangle(p, position[f[0]], position[f[1]], position[f[2]]);
+    };
+
+    // Exact distance in a narrow band around each triangle, and intersections of the triangles with the lines of the grid along x
+    for(size_t t=0; t<connectivity.size(); ++t)
+    {
+        const uint3& f = connectivity[t];
+        const vec3 g0 = (position[f[0]]-p_min)/sdf.voxel_size;
+        const vec3 g1 = (position[f[1]]-p_min)/sdf.voxel_size;
+        const vec3 g2 = (position[f[2]]-p_min)/sdf.voxel_size;
+
+        size_t3 k_min, k_max;
+        for(size_t c=0; c<3; ++c) {
+            const float g_min = std::min(std::min(g0[c], g1[c]), g2[c]);
+            const float g_max = std::max(std::max(g0[c], g1[c]), g2[c]);
+            k_min[c] = size_t(std::max(int(std::floor(g_min))-1, 0));
+            k_max[c] = size_t(std::min(int(std::ceil(g_max))+1, int(N[c])-1));
+        }
+
+        for(size_t k=k_min[2]; k<=k_max[2]; ++k) {
+            for(size_t j=k_min[1]; j<=k_max[1]; ++j) {
+                for(size_t i=k_min[0]; i<=k_max[0]; ++i) {
+                    const float d = distance_triangle(node(i,j,k), int(t));
+                    if(d<phi(i,j,k)) {
+                        phi(i,j,k) = d;
+                        closest_triangle(i,j,k) = int(t);
+                    }
+                }
+            }
+        }
+
+        for(size_t k=k_min[2]; k<=k_max[2]; ++k) {
+            for(size_t j=k_min[1]; j<=k_max[1]; ++j) {
+                double a, b, c;
+                if(!point_in_triangle_2d(double(j), double(k), g0.y, g0.z, g1.y, g1.z, g2.y, g2.z, a, b, c))
+                    continue;
+                const double x = a*g0.x + b*g1.x + c*g2.x;
+                const int i_interval = int(std::ceil(x)); // First node after the intersection
+                if(i_interval<0)
+                    intersection_count(0,j,k)++;
+                else if(i_interval<int(N[0]))
+                    intersection_count(size_t(i_interval),j,k)++;
+            }
+        }
+    }
+
+    // Propagate the closest triangles to the rest of the grid by fast sweeping
+    auto check_neighbor = [&](size_t i, size_t j, size_t k, size_t i1, size_t j1, size_t k1) {
+        const int t = closest_triangle(i1,j1,k1);
+        if(t<0 || t==closest_triangle(i,j,k))
+            return;
+        const float d = distance_triangle(node(i,j,k), t);
+        if(d<phi(i,j,k)) {
+            phi(i,j,k) = d;
+            closest_triangle(i,j,k) = t;
+        }
+    };
+    auto sweep = [&](int di, int dj, int dk) {
+        const int i0 = di>0? 1 : int(N[0])-2, i1 = di>0? int(N[0]) : -1;
+        const int j0 = dj>0? 1 : int(N[1])-2, j1 = dj>0? int(N[1]) : -1;
+        const int k0 = dk>0? 1 : int(N[2])-2, k1 = dk>0? int(N[2]) : -1;
+        for(int k=k0; k!=k1; k+=dk) {
+            for(int j=j0; j!=j1; j+=dj) {
+                for(int i=i0; i!=i1; i+=di) {
+                    check_neighbor(i,j,k, i-di,j   ,k   );
+                    check_neighbor(i,j,k, i   ,j-dj,k   );
+                    check_neighbor(i,j,k, i-di,j-dj,k   );
+                    check_neighbor(i,j,k, i   ,j   ,k-dk);
+                    check_neighbor(i,j,k, i-di,j   ,k-dk);
+                    check_neighbor(i,j,k, i   ,j-dj,k-dk);
+                    check_neighbor(i,j,k, i-di,j-dj,k-dk);
+                }
+            }
+        }
+    };
+    sweep(+1,+1,+1); sweep(-1,-1,-1);
+    sweep(+1,+1,-1); sweep(-1,-1,+1);
+    sweep(+1,-1,+1); sweep(-1,+1,-1);
+    sweep(+1,-1,-1); sweep(-1,+1,+1);
+
+    // Nodes after an odd number of intersections along x are inside
+    for(size_t k=0; k<N[2]; ++k) {
+        for(size_t j=0; j<N[1]; ++j) {
+            int total = 0;
+            for(size_t i=0; i<N[0]; ++i) {
+                total += intersection_count(i,j,k);
+                if(total%2==1)
+                    phi(i,j,k) = -phi(i,j,k);
+            }
+        }
+    }
+
+    return sdf;
+}
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "vcl/shape/mesh/mesh_structure/mesh.hpp"
+#include "vcl/containers/containers.hpp"
+#include "vcl/math/math.hpp"
+
+namespace vcl
+{
+
+/** \brief Signed distance field sampled on a regular grid, used as a collider.
+ *
+ * The distance is sampled once at the nodes of the grid (negative inside the shape).
+ * Queries use a trilinear interpolation of the 8 surrounding nodes: their cost doesn't depend on the complexity of the shape.
+ * Outside of the grid, the distance to the grid is added to the value at the closest point of the grid.
+ */
+struct sdf_grid
+{
+    /** Signed distance at the node (i,j,k) of the grid */
+    buffer3D<float> value;
+    /** Position of the node (0,0,0) */
+    vec3 p_min;
+    /** Distance between two neighboring nodes */
+    float voxel_size;
+
+    sdf_grid();
+
+    /** Interpolated signed distance at p */
+    float distance(const vec3& p) const;
+    /** Interpolated signed distance at p, and its gradient (pointing outward, not normalized) */
+    float distance(const vec3& p, vec3& gradient) const;
+};
+
+/** Compute the signed distance field of a closed triangular mesh.
+ * \param resolution: number of nodes along the largest side of the bounding box of the mesh
+ * \param margin: distance added around the bounding box of the mesh
+ * The sign is obtained by counting the intersections with the mesh along lines of the grid: the mesh is expected to be watertight. */
+sdf_grid sdf_grid_from_mesh(const mesh& shape, size_t resolution=64, float margin=0.1f);
+
+}
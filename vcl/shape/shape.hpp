@@ -4,3 +4,7 @@
 #include "segment/segment.hpp"
 #include "curve/curve.hpp"
 #include "hierarchy_mesh/hierarchy_mesh.hpp"
+#include "spatial_hash/spatial_hash.hpp"
+#include "uniform_grid/uniform_grid.hpp"
+#include "sweep_and_prune/sweep_and_prune.hpp"
+#include "sdf_grid/sdf_grid.hpp"
@@ -0,0 +1,92 @@
+#include "spatial_hash.hpp"
+
+#include <cmath>
+
+namespace vcl
+{
+
+spatial_hash::spatial_hash()
+    :cell_size(1.0f)
+{}
+
+void spatial_hash::initialize(const buffer<vec3>& position, float cell_size_arg)
+{
+    assert_vcl(cell_size_arg>0, "Cell size of the spatial hash must be positive");
+    cell_size = cell_size_arg;
+
+    const size_t N = position.size();
+
+    // At least twice more buckets than points keeps a low number of collisions between cells (power of 2 to avoid a modulo)
+    size_t N_bucket = 1;
+    while(N_bucket<2*N)
+        N_bucket *= 2;
+    buckets.clear();
+    buckets.resize(N_bucket);
+    point_cell.resize(N);
+    point_bucket.resize(N);
+    point_slot.resize(N);
+
+    for(size_t k=0; k<N; ++k)
+    {
+        point_cell[k] = cell(position[k]);
+        point_bucket[k] = bucket(point_cell[k]);
+        point_slot[k] = int(buckets[point_bucket[k]].size());
+        buckets[point_bucket[k]].push_back(int(k));
+    }
+}
+
+size_t spatial_hash::update(const buffer<vec3>& position)
+{
+    assert_vcl(position.size()>=point_cell.size(), "Spatial hash must be initialized with at most the same number of points");
+
+    // Points added at the end of the buffer since the previous call are inserted
+    size_t moved = 0;
+    const size_t N_previous = point_cell.size();
+    point_cell.resize(position.size());
+    point_bucket.resize(position.size());
+    point_slot.resize(position.size());
+    for(size_t k=N_previous; k<position.size(); ++k)
+    {
+        point_cell[k] = cell(position[k]);
+        point_bucket[k] = bucket(point_cell[k]);
+        point_slot[k] = int(buckets[point_bucket[k]].size());
+        buckets[point_bucket[k]].push_back(int(k));
+        ++moved;
+    }
+
+    for(size_t k=0; k<N_previous; ++k)
+    {
+        const int3 c = cell(position[k]);
+        if(c==point_cell[k])
+            continue;
+
+        // Remove from the previous bucket (the last point of the bucket takes its slot)
+        std::vector<int>& previous = buckets[point_bucket[k]];
+        const int last = previous.back();
+        previous[point_slot[k]] = last;
+        point_slot[last] = point_slot[k];
+        previous.pop_back();
+
+        // Add to the new one
+        point_cell[k] = c;
+        point_bucket[k] = bucket(c);
+        point_slot[k] = int(buckets[point_bucket[k]].size());
+        buckets[point_bucket[k]].push_back(int(k));
+
+        ++moved;
+    }
+    return moved;
+}
+
+int3 spatial_hash::cell(const vec3& p) const
+{
+    return { int(std::floor(p.x/cell_size)), int(std::floor(p.y/cell_size)), int(std::floor(p.z/cell_size)) };
+}
+
+int spatial_hash::bucket(const int3& c) const
+{
+    const unsigned int h = (unsigned int)(c[0])*73856093u ^ (unsigned int)(c[1])*19349663u ^ (unsigned int)(c[2])*83492791u;
+    return int(h & (buckets.size()-1));
+}
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "vcl/math/math.hpp"
+#include "vcl/containers/containers.hpp"
+
+namespace vcl
+{
+
+/** \brief Spatial hash grid of a set of points, updated incrementally as the points move.
+ *
+ * Points are stored in the cubic cells of size cell_size, the cells being mapped to a fixed number of buckets by a hash function.
+ * update() only moves the points that changed of cell since the previous call.
+ * Neighborhood queries only read the structure: they can be run in parallel.
+ */
+struct spatial_hash
+{
+    /** Size of a cell */
+    float cell_size;
+
+    /** Index of the points stored in each bucket */
+    std::vector<std::vector<int> > buckets;
+    /** Cell, bucket, and position in the bucket of each point */
+    std::vector<int3> point_cell;
+    std::vector<int> point_bucket;
+    std::vector<int> point_slot;
+
+    spatial_hash();
+
+    /** Build the grid from scratch for the given positions */
+    void initialize(const buffer<vec3>& position, float cell_size);
+    /** Move the points that changed of cell, and insert the points added at the end of the buffer. Return the number of moved or inserted points. */
+    size_t update(const buffer<vec3>& position);
+
+    int3 cell(const vec3& p) const;
+    int bucket(const int3& cell) const;
+
+    /** Call f(index) for each point stored in the cells intersecting the cube of center p and half size radius
+     * All the points at a distance smaller than radius are visited (p itself being included if it is a stored point), as well as some farther ones. */
+    template <typename F> void query(const vec3& p, float radius, F f) const;
+};
+
+
+template <typename F> void spatial_hash::query(const vec3& p, float radius, F f) const
+{
+    const int3 c_min = cell(p-vec3(radius,radius,radius));
+    const int3 c_max = cell(p+vec3(radius,radius,radius));
+    for(int x=c_min[0]; x<=c_max[0]; ++x) {
+        for(int y=c_min[1]; y<=c_max[1]; ++y) {
+            for(int z=c_min[2]; z<=c_max[2]; ++z) {
+                const int3 neighbor = {x, y, z};
+                // Buckets are shared between cells: only keep the points actually stored in the neighbor cell
+                for(const int index : buckets[bucket(neighbor)])
+                    if(point_cell[index]==neighbor)
+                        f(index);
+            }
+        }
+    }
+}
+
+}
@@ -0,0 +1,120 @@
+#include "sweep_and_prune.hpp"
+
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace vcl
+{
+
+sweep_and_prune::sweep_and_prune()
+    :axis(0), swaps(0)
+{}
+
+void sweep_and_prune::update(const buffer<vec3>& box_min, const buffer<vec3>& box_max)
+{
+    const size_t N = box_min.size();
+    assert_vcl(box_max.size()==N, "The sweep and prune needs the same number of lower and upper bounds");
+
+    // Axis where the lower bounds are the most spread: it only changes when another axis is clearly better, as it requires a full sort
+    double sum[3] = {0,0,0}, sum2[3] = {0,0,0};
+    size_t finite = 0;
+    for(size_t k=0; k<N; ++k) {
+        const vec3& p = box_min[k];
+        if(!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z))
+            continue;
+        const float c[3] = {p.x, p.y, p.z};
+        for(int a=0; a<3; ++a) {
+            sum[a] += c[a];
+            sum2[a] += double(c[a])*c[a];
+        }
+        finite++;
+    }
+    const int previous_axis = axis;
+    if(finite>0) {
+        double variance[3];
+        for(int a=0; a<3; ++a)
+            variance[a] = sum2[a]/finite - (sum[a]/finite)*(sum[a]/finite);
+        int best = axis;
+        for(int a=0; a<3; ++a)
+            if(variance[a]>variance[best])
+                best = a;
+        if(variance[best]>1.5*variance[axis])
+            axis = best;
+    }
+
+    // Order of the previous update: the removed indices are dropped, the new ones are added at the end
+    size_t kept = 0;
+    for(size_t k=0; k<sorted.size(); ++k)
+        if(size_t(sorted[k])<N)
+            sorted[kept++] = sorted[k];
+    const size_t previous_size = kept;
+    sorted.resize(kept);
+    for(size_t k=previous_size; k<N; ++k)
+        sorted.push_back(int(k));
+
+    // Lower bounds along the axis (the non finite ones are placed at the end)
+    const float infinity = std::numeric_limits<float>::infinity();
+    endpoint.resize(N);
+    for(size_t k=0; k<N; ++k) {
+        const int i = sorted[k];
+        const float value = box_min[i][axis];
+        endpoint[k] = std::isnan(value)? infinity : value;
+    }
+
+    sort_endpoints(axis!=previous_axis || previous_size==0);
+
+    // Boxes in the sorted order
+    for(int a=0; a<3; ++a) {
+        lower[a].resize(N);
+        upper[a].resize(N);
+    }
+    for(size_t k=0; k<N; ++k) {
+        const vec3& p_min = box_min[sorted[k]];
+        const vec3& p_max = box_max[sorted[k]];
+        lower[0][k] = p_min.x;  lower[1][k] = p_min.y;  lower[2][k] = p_min.z;
+        upper[0][k] = p_max.x;  upper[1][k] = p_max.y;  upper[2][k] = p_max.z;
+    }
+}
+
+// Insertion sort of the endpoints (with their index), from the order of the previous update. If the order changed too much
+//  (more than a few swaps per endpoint), or from_scratch is set, the endpoints are sorted from scratch. Both sorts give the same
+//  order: the equal endpoints are sorted by index.
+void sweep_and_prune::sort_endpoints(bool from_scratch)
+{
+    const size_t N = endpoint.size();
+    auto before = [](float value_a, int index_a, float value_b, int index_b) {
+        return value_a<value_b || (value_a==value_b && index_a<index_b);
+    };
+
+    const size_t max_swaps = 8*N;
+    swaps = 0;
+    for(size_t k=1; k<N && !from_scratch && swaps<=max_swaps; ++k)
+    {
+        const float value = endpoint[k];
+        const int index = sorted[k];
+        size_t m = k;
+        while(m>0 && before(value, index, endpoint[m-1], sorted[m-1])) {
+            endpoint[m] = endpoint[m-1];
+            sorted[m] = sorted[m-1];
+            --m;
+            ++swaps;
+        }
+        endpoint[m] = value;
+        sorted[m] = index;
+    }
+
+    if(from_scratch || swaps>max_swaps)
+    {
+        std::vector<std::pair<float,int> > entries(N);
+        for(size_t k=0; k<N; ++k)
+            entries[k] = {endpoint[k], sorted[k]};
+        std::sort(entries.begin(), entries.end());
+        for(size_t k=0; k<N; ++k) {
+            endpoint[k] = entries[k].first;
+            sorted[k] = entries[k].second;
+        }
+    }
+}
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "vcl/math/math.hpp"
+#include "vcl/containers/containers.hpp"
+
+#include <algorithm>
+
+namespace vcl
+{
+
+/** \brief Sort and sweep broadphase of a set of boxes, along the axis where the boxes are the most spread.
+ *
+ * The boxes are sorted by their lower bound along the axis. The order is kept between two calls to update(), and restored with
+ * an insertion sort: when the boxes move little between two steps, the update costs close to O(N).
+ * The pairs of overlapping boxes are found by sweeping the sorted bounds: a box is only compared to the following ones whose lower
+ * bound is smaller than its upper bound. Unlike the grids, the cost doesn't depend on the size of the largest box: it suits
+ * objects of very different sizes (or boxes enlarged by the motion of fast objects).
+ * The sweeps only read the structure: they can be run in parallel.
+ */
+struct sweep_and_prune
+{
+    int axis;                          // Axis of the sort (0: x, 1: y, 2: z)
+    std::vector<float> endpoint;       // Lower bounds of the boxes along the axis, sorted (kept between the updates)
+    std::vector<int> sorted;           // Index of the box of each endpoint
+    std::vector<float> lower[3];       // Bounds of the boxes, in the order of sorted
+    std::vector<float> upper[3];
+    size_t swaps;                      // Number of swaps of the insertion sort at the last update
+
+    sweep_and_prune();
+
+    /** Sort the boxes [box_min[k],box_max[k]], from the order of the previous call (boxes can be added or removed between two calls) */
+    void update(const buffer<vec3>& box_min, const buffer<vec3>& box_max);
+
+    /** Call f(i,j) for the pairs of overlapping boxes, the box i being at a position in [begin,end[ of the sorted order.
+     * Each pair is visited once when [begin,end[ covers all the boxes: the ranges can be swept in parallel. */
+    template <typename F> void sweep(size_t begin, size_t end, F f) const;
+
+private:
+    void sort_endpoints(bool from_scratch);
+};
+
+
+template <typename F> void sweep_and_prune::sweep(size_t begin, size_t end, F f) const
+{
+    const size_t N = sorted.size();
+    const int a1 = (axis+1)%3, a2 = (axis+2)%3;
+    const float* lower_1 = lower[a1].data();
+    const float* upper_1 = upper[a1].data();
+    const float* lower_2 = lower[a2].data();
+    const float* upper_2 = upper[a2].data();
+    for(size_t k=begin; k<end; ++k)
+    {
+        const float upper_axis = upper[axis][k];
+        const float l1 = lower_1[k], u1 = upper_1[k], l2 = lower_2[k], u2 = upper_2[k];
+        for(size_t k2=k+1; k2<N && endpoint[k2]<=upper_axis; ++k2)
+        {
+            // Most of the candidates are rejected: the four comparisons are combined without branches
+            const bool overlap = (lower_1[k2]<=u1) & (l1<=upper_1[k2]) & (lower_2[k2]<=u2) & (l2<=upper_2[k2]);
+            if(overlap)
+                f(sorted[k], sorted[k2]);
+        }
+    }
+}
+
+}
@@ -0,0 +1,76 @@
+#include "uniform_grid.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+namespace vcl
+{
+
+uniform_grid::uniform_grid()
+    :cell_size(1.0f), origin(0,0,0), dimension({1,1,1}), cell_offset(2,0)
+{}
+
+void uniform_grid::build(const buffer<vec3>& position, float cell_size_arg)
+{
+    assert_vcl(cell_size_arg>0, "Cell size of the uniform grid must be positive");
+    const size_t N = position.size();
+
+    // Bounding box of the points (points with non finite coordinates are stored in the cell 0)
+    const float infinity = std::numeric_limits<float>::infinity();
+    vec3 p_min = {infinity, infinity, infinity};
+    vec3 p_max = -p_min;
+    for(size_t k=0; k<N; ++k) {
+        const vec3& p = position[k];
+        if(!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z))
+            continue;
+        p_min = {std::min(p_min.x,p.x), std::min(p_min.y,p.y), std::min(p_min.z,p.z)};
+        p_max = {std::max(p_max.x,p.x), std::max(p_max.y,p.y), std::max(p_max.z,p.z)};
+    }
+    if(p_min.x>p_max.x)
+        p_min = p_max = {0,0,0};
+
+    // Larger cells when the points are spread in a large box: the number of cells remains in O(N) (with a minimal budget of 2^20 cells
+    //  so that small sets of points in a large box keep small cells)
+    const vec3 extent = p_max-p_min;
+    const double max_cells = std::max(8.0*double(N), double(1<<20));
+    cell_size = cell_size_arg;
+    while( double(std::floor(extent.x/cell_size)+1)*double(std::floor(extent.y/cell_size)+1)*double(std::floor(extent.z/cell_size)+1) > max_cells )
+        cell_size *= 1.5f;
+
+    origin = p_min;
+    dimension = { int(std::floor(extent.x/cell_size))+1, int(std::floor(extent.y/cell_size))+1, int(std::floor(extent.z/cell_size))+1 };
+    const size_t N_cell = size_t(dimension[0])*size_t(dimension[1])*size_t(dimension[2]);
+
+    // Counting sort of the points by cell
+    cell_offset.assign(N_cell+1, 0);
+    point_cell.resize(N);
+    for(size_t k=0; k<N; ++k) {
+        point_cell[k] = cell_index(cell(position[k]));
+        cell_offset[point_cell[k]+1]++;
+    }
+    for(size_t c=0; c<N_cell; ++c)
+        cell_offset[c+1] += cell_offset[c];
+
+    sorted.resize(N);
+    std::vector<int> counter(cell_offset.begin(), cell_offset.end()-1);
+    for(size_t k=0; k<N; ++k)
+        sorted[counter[point_cell[k]]++] = int(k);
+}
+
+int3 uniform_grid::cell(const vec3& p) const
+{
+    // Points outside of the grid (queries) are clamped to the border cells, the comparisons also send the NaN coordinates to the cell 0
+    auto clamp = [this](float x, int n) {
+        const float c = std::floor(x/cell_size);
+        return c>=0? (c<float(n-1)? int(c) : n-1) : 0;
+    };
+    return { clamp(p.x-origin.x,dimension[0]), clamp(p.y-origin.y,dimension[1]), clamp(p.z-origin.z,dimension[2]) };
+}
+
+int uniform_grid::cell_index(const int3& c) const
+{
+    return (c[0]*dimension[1]+c[1])*dimension[2]+c[2];
+}
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "vcl/math/math.hpp"
+#include "vcl/containers/containers.hpp"
+
+namespace vcl
+{
+
+/** \brief Uniform grid of a set of points, rebuilt from scratch in O(N) with a counting sort.
+ *
+ * The grid covers the bounding box of the points with cubic cells of size cell_size (enlarged if needed to bound the number of
+ * cells by a few times the number of points). The points of each cell are stored contiguously, in increasing index:
+ * the points of cell c are sorted[cell_offset[c] .. cell_offset[c+1][.
+ * Unlike spatial_hash (incremental updates, suited to points moving little between two steps), the grid is rebuilt at each call
+ * to build(): it suits sets of points whose size changes at each step.
+ * Neighborhood queries only read the structure: they can be run in parallel.
+ */
+struct uniform_grid
+{
+    float cell_size;
+    vec3 origin;          // Corner of the cell (0,0,0)
+    int3 dimension;       // Number of cells along each axis
+
+    std::vector<int> cell_offset; // Offset of the points of each cell in sorted (size: number of cells + 1)
+    std::vector<int> sorted;      // Index of the points sorted by cell
+    std::vector<int> point_cell;  // Cell of each point
+
+    uniform_grid();
+
+    /** Sort the points in cells of size at least cell_size */
+    void build(const buffer<vec3>& position, float cell_size);
+
+    int3 cell(const vec3& p) const;
+    int cell_index(const int3& c) const;
+
+    /** Call f(index) for each point stored in the 27 cells around the cell of p.
+     * All the points at a distance smaller than cell_size from p are visited (p itself being included if it is a stored point), as well as some farther ones. */
+    template <typename F> void query(const vec3& p, F f) const;
+    /** Same visit as query, by ranges: call f(begin,end) for the points sorted[begin..end[ of each of the 27 cells around the cell of p.
+     * Allows to read data stored in the order of sorted contiguously. */
+    template <typename F> void query_ranges(const vec3& p, F f) const;
+    /** Call f(index) for each point stored in the cells overlapping the box [p_min,p_max] (the cells around a swept volume for instance).
+     * All the points inside the box are visited, as well as some outside. */
+    template <typename F> void query_box(const vec3& p_min, const vec3& p_max, F f) const;
+};
+
+
+template <typename F> void uniform_grid::query(const vec3& p, F f) const
+{
+    query_ranges(p, [&](int begin, int end)
+    {
+        for(int k=begin; k<end; ++k)
+            f(sorted[k]);
+    });
+}
+
+template <typename F> void uniform_grid::query_ranges(const vec3& p, F f) const
+{
+    const int3 c = cell(p);
+    const int x_min = std::max(c[0]-1,0), x_max = std::min(c[0]+1,dimension[0]-1);
+    const int y_min = std::max(c[1]-1,0), y_max = std::min(c[1]+1,dimension[1]-1);
+    const int z_min = std::max(c[2]-1,0), z_max = std::min(c[2]+1,dimension[2]-1);
+    for(int x=x_min; x<=x_max; ++x) {
+        for(int y=y_min; y<=y_max; ++y) {
+            // The cells along z are contiguous: their points form a single range
+            const int first = cell_index({x,y,z_min});
+            const int last = cell_index({x,y,z_max});
+            if(cell_offset[first]<cell_offset[last+1])
+                f(cell_offset[first], cell_offset[last+1]);
+        }
+    }
+}
+
+template <typename F> void uniform_grid::query_box(const vec3& p_min, const vec3& p_max, F f) const
+{
+    const int3 c_min = cell(p_min);
+    const int3 c_max = cell(p_max);
+    for(int x=c_min[0]; x<=c_max[0]; ++x) {
+        for(int y=c_min[1]; y<=c_max[1]; ++y) {
+            const int first = cell_index({x,y,c_min[2]});
+            const int last = cell_index({x,y,c_max[2]});
+            for(int k=cell_offset[first]; k<cell_offset[last+1]; ++k)
+                f(sorted[k]);
+        }
+    }
+}
+
+}
@@ -0,0 +1,186 @@
+#include "mass_spring_system.hpp"
+
+#include <cmath>
+
+namespace vcl
+{
+
+template <typename T>
+basic_mass_spring_system<T>::basic_mass_spring_system()
+    :offset(1,0), gravity(0,-9.81f,0), damping(0)
+{}
+
+template <typename T>
+size_t basic_mass_spring_system<T>::size() const
+{
+    return px.size();
+}
+
+template <typename T>
+size_t basic_mass_spring_system<T>::add_particle(const vec3& p, T m, bool is_pinned)
+{
+    return add_particle(T(p.x), T(p.y), T(p.z), m, is_pinned);
+}
+
+template <typename T>
+size_t basic_mass_spring_system<T>::add_particle(T x, T y, T z, T m, bool is_pinned)
+{
+    assert_vcl(m>0, "The mass of the particles must be positive");
+    px.push_back(x);   py.push_back(y);   pz.push_back(z);
+    vx.push_back(0);   vy.push_back(0);   vz.push_back(0);
+    mass.push_back(m);
+    pinned.push_back(is_pinned? 1 : 0);
+    return px.size()-1;
+}
+
+template <typename T>
+void basic_mass_spring_system<T>::add_spring(size_t i, size_t j, T K, T L0)
+{
+    assert_vcl(i<size() && j<size() && i!=j, "Invalid extremities of spring");
+    spring_i.push_back(int(i));
+    spring_j.push_back(int(j));
+    spring_L0.push_back(L0>=0? L0 : T(norm(position(j)-position(i))));
+    spring_K.push_back(K);
+}
+
+// Counting sort of the extremities: the springs of each particle are stored in the order they were added
+template <typename T>
+void basic_mass_spring_system<T>::update_adjacency()
+{
+    const size_t N = size();
+    const size_t N_spring = spring_i.size();
+    offset.assign(N+1, 0);
+    for(size_t s=0; s<N_spring; ++s) {
+        offset[spring_i[s]+1]++;
+        offset[spring_j[s]+1]++;
+    }
+    for(size_t k=0; k<N; ++k)
+        offset[k+1] += offset[k];
+
+    std::vector<int> counter(offset.begin(), offset.end()-1);
+    neighbor.resize(2*N_spring);
+    rest_length.resize(2*N_spring);
+    stiffness.resize(2*N_spring);
+    for(size_t s=0; s<N_spring; ++s) {
+        const int ki = counter[spring_i[s]]++;
+        neighbor[ki] = spring_j[s];
+        const int kj = counter[spring_j[s]]++;
+        neighbor[kj] = spring_i[s];
+        rest_length[ki] = rest_length[kj] = spring_L0[s];
+        stiffness[ki] = stiffness[kj] = spring_K[s];
+    }
+
+    fx.assign(N, 0); fy.assign(N, 0); fz.assign(N, 0);
+}
+
+template <typename T>
+void basic_mass_spring_system<T>::clear()
+{
+    *this = basic_mass_spring_system<T>();
+}
+
+template <typename T>
+vec3 basic_mass_spring_system<T>::position(size_t k) const
+{
+    return {float(px[k]), float(py[k]), float(pz[k])};
+}
+
+template <typename T>
+vec3 basic_mass_spring_system<T>::speed(size_t k) const
+{
+    return {float(vx[k]), float(vy[k]), float(vz[k])};
+}
+
+template <typename T>
+void basic_mass_spring_system<T>::set_position(size_t k, const vec3& p)
+{
+    px[k] = p.x; py[k] = p.y; pz[k] = p.z;
+}
+
+template <typename T>
+void basic_mass_spring_system<T>::position(size_t k, T& x, T& y, T& z) const
+{
+    x = px[k]; y = py[k]; z = pz[k];
+}
+
+template <typename T>
+void basic_mass_spring_system<T>::speed(size_t k, T& x, T& y, T& z) const
+{
+    x = vx[k]; y = vy[k]; z = vz[k];
+}
+
+template <typename T>
+void basic_mass_spring_system<T>::set_position(size_t k, T x, T y, T z)
+{
+    px[k] = x; py[k] = y; pz[k] = z;
+}
+
+template <typename T>
+void basic_mass_spring_system<T>::set_pinned(size_t k, bool is_pinned)
+{
+    pinned[k] = is_pinned? 1 : 0;
+    if(is_pinned)
+        vx[k] = vy[k] = vz[k] = 0;
+}
+
+// Same formula as spring_force(), written on the coordinates
+template <typename T>
+void basic_mass_spring_system<T>::compute_forces(const T* x, const T* y, const T* z, const T* u, const T* v, const T* w)
+{
+    const size_t N = size();
+    const T gx = gravity.x, gy = gravity.y, gz = gravity.z, mu = damping;
+    for(size_t k=0; k<N; ++k)
+    {
+        if(pinned[k]) {
+            fx[k] = fy[k] = fz[k] = 0;
+            continue;
+        }
+
+        const T m = mass[k];
+        T f_x = m*gx - mu*u[k];
+        T f_y = m*gy - mu*v[k];
+        T f_z = m*gz - mu*w[k];
+
+        const T xk = x[k], yk = y[k], zk = z[k];
+        for(int e=offset[k]; e<offset[k+1]; ++e)
+        {
+            const int j = neighbor[e];
+            const T dx = x[j]-xk, dy = y[j]-yk, dz = z[j]-zk;
+            const T L = std::sqrt(dx*dx+dy*dy+dz*dz);
+            if(L>0) {
+                const T a = stiffness[e]*(L-rest_length[e])/L;
+                f_x += a*dx;
+                f_y += a*dy;
+                f_z += a*dz;
+            }
+        }
+
+        fx[k] = f_x;
+        fy[k] = f_y;
+        fz[k] = f_z;
+    }
+}
+
+template <typename T>
+double basic_mass_spring_system<T>::energy() const
+{
+    double E = 0;
+    const size_t N = size();
+    for(size_t k=0; k<N; ++k) {
+        const double v2 = double(vx[k])*vx[k] + double(vy[k])*vy[k] + double(vz[k])*vz[k];
+        E += 0.5*mass[k]*v2 - mass[k]*(double(gravity.x)*px[k] + double(gravity.y)*py[k] + double(gravity.z)*pz[k]);
+    }
+    const size_t N_spring = spring_i.size();
+    for(size_t s=0; s<N_spring; ++s) {
+        const int i = spring_i[s], j = spring_j[s];
+        const double dx = double(px[j])-px[i], dy = double(py[j])-py[i], dz = double(pz[j])-pz[i];
+        const double L = std::sqrt(dx*dx+dy*dy+dz*dz);
+        E += 0.5*spring_K[s]*(L-spring_L0[s])*(L-spring_L0[s]);
+    }
+    return E;
+}
+
+template struct basic_mass_spring_system<float>;
+template struct basic_mass_spring_system<double>;
+
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include "vcl/base/base.hpp"
+#include "vcl/math/math.hpp"
+
+#include <vector>
+
+namespace vcl
+{
+
+/** Force applied on the particle at pi by a spring of rest length L0 and stiffness K linking it to the particle at pj */
+inline vec3 spring_force(const vec3& pi, const vec3& pj, float L0, float K)
+{
+    const vec3 pji = pj - pi;
+    const float L = norm(pji);
+    return K * (L - L0) * pji / L;
+}
+
+/** \brief Network of particles linked by springs, independent of the rendering (chains, ropes, cloths, soft bodies)
+ *
+ * The state is stored as a structure of arrays (one array per coordinate). The springs are stored once per extremity in a
+ * compressed adjacency: the springs of particle k are [offset[k], offset[k+1][, with the other extremity, the rest length and the
+ * stiffness. Each particle gathers the forces of its own springs: the forces are computed in a fixed order, without write conflicts.
+ * The pinned particles receive no force and keep a zero speed: they don't move whatever the integrator.
+ * The integration scheme is a template parameter of step(): its loops are compiled for each scheme (symplectic_euler,
+ * velocity_verlet, runge_kutta_4), there is no dispatch inside the steps.
+ * The state is stored in single (mass_spring_system) or double precision (mass_spring_system_double): the relative precision of the
+ * float coordinates limits the length of the springs to about 10^-6 times the extent of the network (long ropes for instance).
+ */
+template <typename T>
+struct basic_mass_spring_system
+{
+    // Particles
+    std::vector<T> px, py, pz;     // Position
+    std::vector<T> vx, vy, vz;     // Speed
+    std::vector<T> mass;
+    std::vector<char> pinned;      // 1 for the fixed particles
+
+    // Springs
+    std::vector<int> spring_i, spring_j;             // Extremities of the springs (as added)
+    std::vector<T> spring_L0, spring_K;              // Rest length and stiffness of the springs
+    std::vector<int> offset;       // Springs adjacent to each particle: [offset[k], offset[k+1][ (size: number of particles + 1)
+    std::vector<int> neighbor;     // Other extremity of the spring
+    std::vector<T> rest_length;
+    std::vector<T> stiffness;
+
+    vec3 gravity;
+    float damping;                 // Drag: force -damping*v applied on each particle
+
+    // Forces of the last evaluation
+    std::vector<T> fx, fy, fz;
+
+    basic_mass_spring_system();
+
+    size_t size() const;
+    /** Add a particle at rest at position p, return its index */
+    size_t add_particle(const vec3& p, T m, bool is_pinned=false);
+    /** Same with the coordinates in the precision of the system */
+    size_t add_particle(T x, T y, T z, T m, bool is_pinned=false);
+    /** Link particles i and j with a spring of stiffness K and rest length L0 (negative: current distance between the particles).
+     * The adjacency must be rebuilt with update_adjacency() before the next step. */
+    void add_spring(size_t i, size_t j, T K, T L0=-1);
+    /** Build the adjacency of the springs from spring_i and spring_j */
+    void update_adjacency();
+    void clear();
+
+    vec3 position(size_t k) const;
+    vec3 speed(size_t k) const;
+    void set_position(size_t k, const vec3& p);
+    // Same with the coordinates in the precision of the system (vec3 rounds them to float)
+    void position(size_t k, T& x, T& y, T& z) const;
+    void speed(size_t k, T& x, T& y, T& z) const;
+    void set_position(size_t k, T x, T y, T z);
+    void set_pinned(size_t k, bool is_pinned);
+
+    /** Compute the forces (fx,fy,fz) of the particles at positions (x,y,z) with speeds (u,v,w) */
+    void compute_forces(const T* x, const T* y, const T* z, const T* u, const T* v, const T* w);
+    /** Kinetic, gravitational and elastic energy (without damping the energy is conserved by the exact motion) */
+    double energy() const;
+
+    /** Advance the particles by dt with the scheme Integrator */
+    template <typename Integrator> void step(float dt);
+
+    // Storage of the intermediate states of the multi-stage integrators
+    std::vector<T> scratch[12];
+};
+
+using mass_spring_system = basic_mass_spring_system<float>;
+using mass_spring_system_double = basic_mass_spring_system<double>;
+
+/** Symplectic (semi-implicit) Euler: v += dt a(p,v), then p += dt v. One force evaluation per step */
+struct symplectic_euler
+{
+    template <typename T> static void step(basic_mass_spring_system<T>& system, float dt);
+};
+
+/** Velocity Verlet: half step on the speed, full step on the position, half step with the forces at the new position.
+ * Second order, two force evaluations per step (the forces depend on the speed through the damping) */
+struct velocity_verlet
+{
+    template <typename T> static void step(basic_mass_spring_system<T>& system, float dt);
+};
+
+/** Classical fourth order Runge-Kutta on the positions and speeds. Four force evaluations per step */
+struct runge_kutta_4
+{
+    template <typename T> static void step(basic_mass_spring_system<T>& system, float dt);
+};
+
+
+template <typename T> template <typename Integrator> void basic_mass_spring_system<T>::step(float dt)
+{
+    assert_vcl(offset.size()==size()+1, "The adjacency of the springs must be updated after adding particles or springs");
+    Integrator::step(*this, dt);
+}
+
+
+template <typename T> void symplectic_euler::step(basic_mass_spring_system<T>& s, float dt_arg)
+{
+    const T dt = dt_arg;
+    s.compute_forces(s.px.data(), s.py.data(), s.pz.data(), s.vx.data(), s.vy.data(), s.vz.data());
+    const size_t N = s.size();
+    for(size_t k=0; k<N; ++k)
+    {
+        const T h = dt/s.mass[k];
+        s.vx[k] += h*s.fx[k];  s.vy[k] += h*s.fy[k];  s.vz[k] += h*s.fz[k];
+        s.px[k] += dt*s.vx[k]; s.py[k] += dt*s.vy[k]; s.pz[k] += dt*s.vz[k];
+    }
+}
+
+template <typename T> void velocity_verlet::step(basic_mass_spring_system<T>& s, float dt_arg)
+{
+    const T dt = dt_arg;
+    const size_t N = s.size();
+    s.compute_forces(s.px.data(), s.py.data(), s.pz.data(), s.vx.data(), s.vy.data(), s.vz.data());
+    for(size_t k=0; k<N; ++k)
+    {
+        const T h = dt/(2*s.mass[k]);
+        s.vx[k] += h*s.fx[k];  s.vy[k] += h*s.fy[k];  s.vz[k] += h*s.fz[k];
+        s.px[k] += dt*s.vx[k]; s.py[k] += dt*s.vy[k]; s.pz[k] += dt*s.vz[k];
+    }
+    s.compute_forces(s.px.data(), s.py.data(), s.pz.data(), s.vx.data(), s.vy.data(), s.vz.data());
+    for(size_t k=0; k<N; ++k)
+    {
+        const T h = dt/(2*s.mass[k]);
+        s.vx[k] += h*s.fx[k];  s.vy[k] += h*s.fy[k];  s.vz[k] += h*s.fz[k];
+    }
+}
+
+template <typename T> void runge_kutta_4::step(basic_mass_spring_system<T>& s, float dt_arg)
+{
+    const T dt = dt_arg;
+    const size_t N = s.size();
+    for(std::vector<T>& buffer : s.scratch)
+        buffer.resize(N);
+
+    // Intermediate state (x,v), and sum of the weighted increments of the stages (dx,dv)
+    T* x[3] = {s.scratch[0].data(), s.scratch[1].data(), s.scratch[2].data()};
+    T* v[3] = {s.scratch[3].data(), s.scratch[4].data(), s.scratch[5].data()};
+    T* dx[3] = {s.scratch[6].data(), s.scratch[7].data(), s.scratch[8].data()};
+    T* dv[3] = {s.scratch[9].data(), s.scratch[10].data(), s.scratch[11].data()};
+    T* p0[3] = {s.px.data(), s.py.data(), s.pz.data()};
+    T* v0[3] = {s.vx.data(), s.vy.data(), s.vz.data()};
+    const T* f[3] = {s.fx.data(), s.fy.data(), s.fz.data()};
+
+    // Stage 1 at the current state
+    s.compute_forces(p0[0], p0[1], p0[2], v0[0], v0[1], v0[2]);
+    for(int c=0; c<3; ++c) {
+        for(size_t k=0; k<N; ++k) {
+            const T a = f[c][k]/s.mass[k];
+            dx[c][k] = v0[c][k];
+            dv[c][k] = a;
+            x[c][k] = p0[c][k] + dt/2*v0[c][k];
+            v[c][k] = v0[c][k] + dt/2*a;
+        }
+    }
+
+    // Stages 2 and 3: the increments are evaluated at the intermediate state, which is moved from the initial state
+    const T next[2] = {dt/2, dt};
+    for(int stage=0; stage<2; ++stage)
+    {
+        s.compute_forces(x[0], x[1], x[2], v[0], v[1], v[2]);
+        for(int c=0; c<3; ++c) {
+            for(size_t k=0; k<N; ++k) {
+                const T a = f[c][k]/s.mass[k];
+                const T u = v[c][k];
+                dx[c][k] += 2*u;
+                dv[c][k] += 2*a;
+                x[c][k] = p0[c][k] + next[stage]*u;
+                v[c][k] = v0[c][k] + next[stage]*a;
+            }
+        }
+    }
+
+    // Stage 4 and combination
+    s.compute_forces(x[0], x[1], x[2], v[0], v[1], v[2]);
+    for(int c=0; c<3; ++c) {
+        for(size_t k=0; k<N; ++k) {
+            const T a = f[c][k]/s.mass[k];
+            p0[c][k] += dt/6*(dx[c][k] + v[c][k]);
+            v0[c][k] += dt/6*(dv[c][k] + a);
+        }
+    }
+}
+
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+#include "mass_spring_system/mass_spring_system.hpp"